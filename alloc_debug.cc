@@ -0,0 +1,125 @@
+#if defined(GLPG_ALLOC_DEBUG)
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <atomic>
+#include <new>
+
+#include "common.hh"
+#include "alloc_debug.hh"
+
+// glibc's own entry points, the hooks below replace the public ones for the
+// whole process, the driver included
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+// the bounds of our own code, set up by the linker
+extern "C" char __executable_start;
+extern "C" char etext;
+
+// allocations made by our code and by libraries (libc, the GL driver, ...),
+// only ours are something we can fix
+struct AllocStats {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    // where the first allocation of the frame came from, for addr2line
+    std::atomic<void*> first_caller{nullptr};
+};
+
+static std::atomic<bool> tracking{false};
+static AllocStats own_allocs;
+static AllocStats library_allocs;
+static uint64_t frame = 0;
+
+static inline void record(size_t size, void* caller) {
+    if (!tracking.load(std::memory_order_relaxed)) return;
+
+    bool own = cast(char*) caller >= &__executable_start && cast(char*) caller < &etext;
+    AllocStats& stats = own ? own_allocs : library_allocs;
+
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.bytes.fetch_add(size, std::memory_order_relaxed);
+
+    void* expected = nullptr;
+    stats.first_caller.compare_exchange_strong(expected, caller, std::memory_order_relaxed);
+}
+
+extern "C" void* malloc(size_t size) {
+    record(size, __builtin_return_address(0));
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    record(count * size, __builtin_return_address(0));
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    record(size, __builtin_return_address(0));
+    return __libc_realloc(ptr, size);
+}
+
+// NOTE: hooked separately so the caller is the code doing the `new` and not the C++ runtime
+static inline void* checked_new(size_t size, size_t alignment, void* caller) {
+    record(size, caller);
+
+    if (size == 0) size = 1;
+    void* ptr = alignment > alignof(std::max_align_t) ? __libc_memalign(alignment, size) : __libc_malloc(size);
+    if (!ptr) throw std::bad_alloc();
+
+    return ptr;
+}
+
+void* operator new(size_t size) {
+    return checked_new(size, 0, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size) {
+    return checked_new(size, 0, __builtin_return_address(0));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return checked_new(size, cast(size_t) alignment, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return checked_new(size, cast(size_t) alignment, __builtin_return_address(0));
+}
+
+static void report(const char* what, AllocStats& stats) {
+    uint64_t count = stats.count.exchange(0);
+    uint64_t bytes = stats.bytes.exchange(0);
+    void* caller = stats.first_caller.exchange(nullptr);
+
+    if (count == 0) return;
+
+    fprintf(stderr, "frame %lu: %lu heap allocations (%lu bytes) in %s, the first from %p\n",
+            cast(unsigned long) frame, cast(unsigned long) count, cast(unsigned long) bytes, what, caller);
+}
+
+void alloc_debug_begin() {
+    frame = 0;
+
+    tracking = true;
+}
+
+void alloc_debug_frame() {
+    // the report itself may allocate, keep it out of the next frame
+    tracking = false;
+    report("our code", own_allocs);
+    report("libraries", library_allocs);
+    tracking = true;
+
+    frame++;
+}
+
+void alloc_debug_end() {
+    tracking = false;
+}
+
+#endif
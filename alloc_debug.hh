@@ -0,0 +1,17 @@
+#pragma once
+
+// Built with -DGLPG_ALLOC_DEBUG (e.g. `CXXFLAGS=-DGLPG_ALLOC_DEBUG ./build.sh`),
+// malloc and operator new are hooked and every heap allocation made on any
+// thread between alloc_debug_begin and alloc_debug_end is counted. Each
+// alloc_debug_frame reports what the frame allocated, split into our code and
+// libraries (libc, the GL driver), a steady frame should report nothing for
+// our code. Without the define these do nothing.
+#if defined(GLPG_ALLOC_DEBUG)
+void alloc_debug_begin();
+void alloc_debug_frame();
+void alloc_debug_end();
+#else
+inline void alloc_debug_begin() {}
+inline void alloc_debug_frame() {}
+inline void alloc_debug_end() {}
+#endif
@@ -0,0 +1,77 @@
+#include "arena.hh"
+
+void Arena::init(size_t size) {
+    if (base) die("arena initialized twice");
+
+    base = new uint8_t[size];
+    capacity = size;
+    used = 0;
+    blocks[0] = base;
+}
+
+Arena::~Arena() {
+    for (auto& block : blocks) delete[] block.load();
+}
+
+uint8_t* Arena::grow(int index) {
+    if (index >= ARENA_MAX_BLOCKS) die("arena out of memory");
+
+    std::lock_guard<std::mutex> lock(grow_mutex);
+
+    // NOTE: another thread may have made it while this one waited
+    uint8_t* block = blocks[index].load(std::memory_order_acquire);
+    if (!block) {
+        block = new uint8_t[block_end(index) - block_begin(index)];
+        blocks[index].store(block, std::memory_order_release);
+    }
+
+    return block;
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    size_t offset = used.load(std::memory_order_relaxed);
+
+    for (;;) {
+        // the block the offset is in, the blocks double in size after the first one
+        int index = 0;
+        while (offset >= block_end(index)) index++;
+
+        uint8_t* block = index < ARENA_MAX_BLOCKS ? blocks[index].load(std::memory_order_acquire) : nullptr;
+        if (!block) block = grow(index);
+
+        uint8_t* at = block + (offset - block_begin(index));
+        uintptr_t start = (cast(uintptr_t) at + alignment - 1) & ~(cast(uintptr_t) alignment - 1);
+        size_t end = start - cast(uintptr_t) block + block_begin(index) + size;
+
+        // doesn't fit, the rest of this block is skipped
+        size_t next = end > block_end(index) ? block_end(index) : end;
+
+        if (used.compare_exchange_weak(offset, next, std::memory_order_relaxed)) {
+            if (next == end) return cast(void*) start;
+            offset = next;
+        }
+    }
+}
+
+void FrameArena::init(size_t capacity) {
+    arenas[0].init(capacity);
+    arenas[1].init(capacity);
+}
+
+Arena& FrameArena::next() {
+    frame++;
+
+    Arena& arena = current();
+    arena.reset();
+
+    return arena;
+}
+
+Arena& scratch_arena() {
+    static thread_local Arena arena;
+
+    // NOTE: reserved on first use, so a thread's first frame is the only one that allocates
+    if (!arena.base) arena.init(SCRATCH_ARENA_SIZE);
+
+    return arena;
+}
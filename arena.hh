@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+
+#include "common.hh"
+
+constexpr size_t ARENA_ALIGNMENT = 16;
+
+constexpr size_t FRAME_ARENA_SIZE = 8 * 1024 * 1024;
+constexpr size_t SCRATCH_ARENA_SIZE = 1024 * 1024;
+// the first block and then blocks of twice the size of everything before them
+constexpr int ARENA_MAX_BLOCKS = 16;
+
+// A bump allocator over one block reserved up front. Allocating is a single
+// compare-exchange, so the jobs of a frame can share one arena, and
+// everything is freed at once by resetting it. A frame that needs more than
+// the block chains another one, as big as all the blocks before it; the
+// blocks are kept, so only the first frame that gets that big allocates.
+struct Arena {
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void init(size_t capacity);
+
+    void* allocate(size_t size, size_t alignment = ARENA_ALIGNMENT);
+
+    template <class T>
+    inline T* allocate_array(size_t count) {
+        return cast(T*) allocate(count * sizeof(T), alignof(T) > ARENA_ALIGNMENT ? alignof(T) : ARENA_ALIGNMENT);
+    }
+
+    inline void reset() {
+        used.store(0, std::memory_order_relaxed);
+    }
+
+    // only when nothing else allocates from the arena concurrently
+    inline size_t mark() const {
+        return used.load(std::memory_order_relaxed);
+    }
+
+    inline void rewind(size_t mark) {
+        used.store(mark, std::memory_order_relaxed);
+    }
+
+    // the offsets of block `index`, one address space over all of them
+    inline size_t block_begin(int index) const {
+        return index == 0 ? 0 : capacity << (index - 1);
+    }
+
+    inline size_t block_end(int index) const {
+        return capacity << index;
+    }
+
+    uint8_t* grow(int index);
+
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    std::atomic<size_t> used{0};
+
+    // base is the first one, the rest are made on demand
+    std::atomic<uint8_t*> blocks[ARENA_MAX_BLOCKS] = {};
+    std::mutex grow_mutex;
+};
+
+// Two arenas used on alternate frames: what was allocated for the last frame
+// stays valid while the next one is being built, which is what a consumer
+// running a frame behind needs.
+struct FrameArena {
+    void init(size_t capacity);
+
+    // resets and returns the arena of the new frame
+    Arena& next();
+
+    inline Arena& current() {
+        return arenas[frame & 1];
+    }
+
+    Arena arenas[2];
+    uint64_t frame = 0;
+};
+
+// Per thread, for temporaries that die before the function that made them
+// returns. Use through ScratchScope so nested users don't clobber each other.
+Arena& scratch_arena();
+
+struct ScratchScope {
+    inline ScratchScope() : arena(scratch_arena()), saved(arena.mark()) {}
+
+    inline ~ScratchScope() {
+        arena.rewind(saved);
+    }
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    Arena& arena;
+    size_t saved;
+};
@@ -3,8 +3,12 @@
 set -xe
 
 CXX=${CXX:-g++}
-CXXFLAGS="$CXXFLAGS -g -lglfw -lGL -std=c++20"
+CXXFLAGS="$CXXFLAGS -g -march=native -pthread -lglfw -lGL -std=c++20"
 
-SOURCES="main.cc"
+SOURCES="main.cc gl.cc cull.cc bvh.cc occlusion.cc gpu_cull.cc transform.cc jobs.cc sim.cc render_queue.cc command_list.cc arena.cc alloc_debug.cc resources.cc camera.cc fast_trig.cc file.cc mesh.cc obj.cc json.cc gltf.cc mesh_cache.cc lz.cc pack.cc io.cc gpu_loader.cc"
 
-$CXX -o main ${CXXFLAGS} main.cc
+# the offline asset cooker, see cook.cc
+COOK_SOURCES="cook.cc jobs.cc file.cc mesh.cc obj.cc mesh_opt.cc mesh_simplify.cc mesh_cache.cc lz.cc pack.cc io.cc"
+
+$CXX -o main ${SOURCES} ${CXXFLAGS}
+$CXX -o glpg-cook ${COOK_SOURCES} ${CXXFLAGS}
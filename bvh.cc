@@ -0,0 +1,496 @@
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "bvh.hh"
+
+constexpr int SAH_BINS = 16;
+constexpr uint32_t LEAF_MIN = 2;
+constexpr uint32_t LEAF_MAX = 8;
+// cost of visiting a node relative to testing one object
+constexpr float SAH_TRAVERSAL_COST = 1.0f;
+// every level of the tree leaves at most 3 siblings on the traversal stack
+constexpr int TRAVERSAL_STACK_SIZE = 192;
+constexpr int MAX_DEPTH = (TRAVERSAL_STACK_SIZE - 1) / 3;
+// from this depth on nodes split at the median, which halves them down to leaves within 32 more levels, so a skewed
+// scene that makes SAH peel off one object per level can't get deeper than MAX_DEPTH
+constexpr int MEDIAN_SPLIT_DEPTH = MAX_DEPTH - 32;
+
+namespace {
+
+struct BuildNode {
+    Aabb box;
+    int32_t left, right;
+    uint32_t first, count;
+};
+
+struct Builder {
+    const Aabb* boxes;
+    std::vector<Vec3> centroids;
+    std::vector<uint32_t>* indices;
+    std::vector<BuildNode> nodes;
+
+    int32_t build(uint32_t first, uint32_t count, int depth);
+};
+
+struct Bin {
+    Aabb box = Aabb::empty();
+    uint32_t count = 0;
+};
+
+}
+
+int32_t Builder::build(uint32_t first, uint32_t count, int depth) {
+    uint32_t* idx = indices->data() + first;
+
+    Aabb box = Aabb::empty();
+    Aabb centroid_box = Aabb::empty();
+    for (uint32_t i = 0; i < count; i++) {
+        box.grow(boxes[idx[i]]);
+        centroid_box.grow(centroids[idx[i]]);
+    }
+
+    int32_t node_index = nodes.size();
+    nodes.push_back(BuildNode{box, -1, -1, first, count});
+
+    if (count <= LEAF_MIN) return node_index;
+
+    Vec3 ext = centroid_box.max - centroid_box.min;
+    int axis = 0;
+    if (ext.y > ext.x) axis = 1;
+    if (ext.z > (axis == 0 ? ext.x : ext.y)) axis = 2;
+
+    auto comp = [](Vec3 v, int a) { return a == 0 ? v.x : a == 1 ? v.y : v.z; };
+    float cmin = comp(centroid_box.min, axis);
+    float cext = comp(ext, axis);
+
+    // 0 until a split was picked, the median along the axis if none is
+    uint32_t mid = 0;
+
+    if (cext > 0 && depth < MEDIAN_SPLIT_DEPTH) {
+        const float scale = SAH_BINS / cext;
+        auto bin_of = [&](uint32_t i) {
+            int b = (int)((comp(centroids[i], axis) - cmin) * scale);
+            return std::min(b, SAH_BINS - 1);
+        };
+
+        Bin bins[SAH_BINS];
+        for (uint32_t i = 0; i < count; i++) {
+            Bin& b = bins[bin_of(idx[i])];
+            b.box.grow(boxes[idx[i]]);
+            b.count++;
+        }
+
+        // sweep from the right to get the cost of every right side, then from the left
+        float right_area[SAH_BINS];
+        uint32_t right_count[SAH_BINS];
+        Aabb acc = Aabb::empty();
+        uint32_t acc_count = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            acc.grow(bins[i].box);
+            acc_count += bins[i].count;
+            right_area[i] = acc.surface_area();
+            right_count[i] = acc_count;
+        }
+
+        float best_cost = INFINITY;
+        int best_split = -1;
+        acc = Aabb::empty();
+        acc_count = 0;
+        for (int i = 1; i < SAH_BINS; i++) {
+            acc.grow(bins[i - 1].box);
+            acc_count += bins[i - 1].count;
+            if (acc_count == 0 || right_count[i] == 0) continue;
+
+            float cost = acc.surface_area() * acc_count + right_area[i] * right_count[i];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = i;
+            }
+        }
+
+        float area = box.surface_area();
+        float leaf_cost = area * count;
+        best_cost = SAH_TRAVERSAL_COST * area + best_cost;
+        if (best_cost >= leaf_cost && count <= LEAF_MAX) return node_index;
+
+        // a leaf too big to keep splits at the best bin even where it costs more, or at the median when all
+        // centroids landed in one bin
+        if (best_split >= 0) {
+            uint32_t* pivot = std::partition(idx, idx + count, [&](uint32_t i) { return bin_of(i) < best_split; });
+            mid = pivot - idx;
+        }
+    } else if (count <= LEAF_MAX) {
+        // all centroids in one spot, splitting would not help, or deep enough that a leaf is the better bet
+        return node_index;
+    }
+
+    if (mid == 0 || mid == count) {
+        mid = count / 2;
+        std::nth_element(idx, idx + mid, idx + count, [&](uint32_t a, uint32_t b) {
+            return comp(centroids[a], axis) < comp(centroids[b], axis);
+        });
+    }
+
+    int32_t left = build(first, mid, depth + 1);
+    int32_t right = build(first + mid, count - mid, depth + 1);
+    nodes[node_index].left = left;
+    nodes[node_index].right = right;
+
+    return node_index;
+}
+
+static void set_slot_box(BvhNode4& node, int slot, const Aabb& box) {
+    node.min_x[slot] = box.min.x;
+    node.min_y[slot] = box.min.y;
+    node.min_z[slot] = box.min.z;
+    node.max_x[slot] = box.max.x;
+    node.max_y[slot] = box.max.y;
+    node.max_z[slot] = box.max.z;
+}
+
+static Aabb slot_box(const BvhNode4& node, int slot) {
+    return Aabb{Vec3{node.min_x[slot], node.min_y[slot], node.min_z[slot]},
+                Vec3{node.max_x[slot], node.max_y[slot], node.max_z[slot]}};
+}
+
+// collapses the binary tree under `bin` into 4-wide nodes, pulling up the
+// grandchildren with the largest surface area first
+static int32_t collapse(const std::vector<BuildNode>& bin_nodes, int32_t bin, std::vector<BvhNode4>& out, int depth) {
+    // NOTE: never deeper than the binary tree, which the builder keeps within MAX_DEPTH
+    assert(depth <= MAX_DEPTH && "BVH is too deep for the traversal stack");
+
+    int32_t index = out.size();
+    out.emplace_back();
+
+    int32_t children[4];
+    int child_count = 0;
+
+    const BuildNode& root = bin_nodes[bin];
+    if (root.left < 0) {
+        children[child_count++] = bin;
+    } else {
+        children[child_count++] = root.left;
+        children[child_count++] = root.right;
+    }
+
+    while (child_count < 4) {
+        int best = -1;
+        float best_area = -1;
+        for (int i = 0; i < child_count; i++) {
+            const BuildNode& n = bin_nodes[children[i]];
+            if (n.left >= 0 && n.box.surface_area() > best_area) {
+                best_area = n.box.surface_area();
+                best = i;
+            }
+        }
+        if (best < 0) break;
+
+        const BuildNode& n = bin_nodes[children[best]];
+        children[best] = n.left;
+        children[child_count++] = n.right;
+    }
+
+    for (int slot = 0; slot < 4; slot++) {
+        if (slot >= child_count) {
+            set_slot_box(out[index], slot, Aabb::empty());
+            out[index].child[slot] = -1;
+            out[index].first[slot] = 0;
+            out[index].count[slot] = 0;
+            continue;
+        }
+
+        const BuildNode& n = bin_nodes[children[slot]];
+        int32_t child = n.left < 0 ? -1 : collapse(bin_nodes, children[slot], out, depth + 1);
+
+        // NOTE: `out` may have been reallocated by the recursion
+        BvhNode4& node = out[index];
+        set_slot_box(node, slot, n.box);
+        node.child[slot] = child;
+        node.first[slot] = n.first;
+        node.count[slot] = n.count;
+    }
+
+    return index;
+}
+
+void Bvh::build(const Aabb* boxes, size_t count) {
+    nodes.clear();
+    indices.resize(count);
+    leaf_boxes.resize(count);
+    leaf_bounds.resize(count);
+
+    if (count == 0) return;
+
+    Builder builder;
+    builder.boxes = boxes;
+    builder.indices = &indices;
+    builder.centroids.resize(count);
+    builder.nodes.reserve(count * 2);
+
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = i;
+        builder.centroids[i] = boxes[i].center();
+    }
+
+    builder.build(0, count, 1);
+
+    nodes.reserve(builder.nodes.size() / 3 + 1);
+    collapse(builder.nodes, 0, nodes, 1);
+
+    for (size_t i = 0; i < count; i++) {
+        leaf_boxes[i] = boxes[indices[i]];
+        leaf_bounds.set(i, leaf_boxes[i].center(), leaf_boxes[i].extents());
+    }
+}
+
+void Bvh::refit(const Aabb* boxes) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        leaf_boxes[i] = boxes[indices[i]];
+        leaf_bounds.set(i, leaf_boxes[i].center(), leaf_boxes[i].extents());
+    }
+
+    // children always come after their parents, so walking backwards is bottom-up
+    for (size_t n = nodes.size(); n-- > 0;) {
+        BvhNode4& node = nodes[n];
+
+        for (int slot = 0; slot < 4; slot++) {
+            if (node.count[slot] == 0) continue;
+
+            Aabb box = Aabb::empty();
+            if (node.child[slot] >= 0) {
+                const BvhNode4& child = nodes[node.child[slot]];
+                for (int c = 0; c < 4; c++) {
+                    box.grow(slot_box(child, c));
+                }
+            } else {
+                for (uint32_t i = 0; i < node.count[slot]; i++) {
+                    box.grow(leaf_boxes[node.first[slot] + i]);
+                }
+            }
+
+            set_slot_box(node, slot, box);
+        }
+    }
+}
+
+// Classifies the four child boxes against the planes in the `planes` mask.
+// Returns the mask of slots that are not fully outside; `child_planes`
+// receives, per slot, the planes the box still straddles, so an empty mask
+// means the box is fully inside.
+static unsigned test_node(const BvhNode4& node, const Frustum& frustum, unsigned planes, unsigned child_planes[4]) {
+    for (int slot = 0; slot < 4; slot++) child_planes[slot] = planes;
+
+#if defined(__SSE__)
+    __m128 min_x = _mm_load_ps(node.min_x), min_y = _mm_load_ps(node.min_y), min_z = _mm_load_ps(node.min_z);
+    __m128 max_x = _mm_load_ps(node.max_x), max_y = _mm_load_ps(node.max_y), max_z = _mm_load_ps(node.max_z);
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        if (!(planes & (1u << p))) continue;
+
+        const Plane& plane = frustum.planes[p];
+        __m128 nx = _mm_set1_ps(plane.normal.x);
+        __m128 ny = _mm_set1_ps(plane.normal.y);
+        __m128 nz = _mm_set1_ps(plane.normal.z);
+
+        // the corner furthest along the normal decides if the box is outside,
+        // the nearest one if it is fully inside
+        __m128 far_x  = plane.normal.x >= 0 ? max_x : min_x;
+        __m128 near_x = plane.normal.x >= 0 ? min_x : max_x;
+        __m128 far_y  = plane.normal.y >= 0 ? max_y : min_y;
+        __m128 near_y = plane.normal.y >= 0 ? min_y : max_y;
+        __m128 far_z  = plane.normal.z >= 0 ? max_z : min_z;
+        __m128 near_z = plane.normal.z >= 0 ? min_z : max_z;
+
+        __m128 d = _mm_set1_ps(plane.d);
+        __m128 far_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, far_x), _mm_mul_ps(ny, far_y)),
+                                     _mm_add_ps(_mm_mul_ps(nz, far_z), d));
+        __m128 near_dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, near_x), _mm_mul_ps(ny, near_y)),
+                                      _mm_add_ps(_mm_mul_ps(nz, near_z), d));
+
+        visible = _mm_and_ps(visible, _mm_cmpge_ps(far_dist, zero));
+
+        unsigned inside = _mm_movemask_ps(_mm_cmpge_ps(near_dist, zero));
+        while (inside) {
+            child_planes[__builtin_ctz(inside)] &= ~(1u << p);
+            inside &= inside - 1;
+        }
+    }
+
+    return _mm_movemask_ps(visible);
+#else
+    unsigned visible_mask = 0;
+
+    for (int slot = 0; slot < 4; slot++) {
+        Aabb box = slot_box(node, slot);
+        bool visible = true;
+
+        for (int p = 0; p < Frustum::PLANE_COUNT && visible; p++) {
+            if (!(planes & (1u << p))) continue;
+
+            const Plane& plane = frustum.planes[p];
+            Vec3 far_corner = {plane.normal.x >= 0 ? box.max.x : box.min.x,
+                               plane.normal.y >= 0 ? box.max.y : box.min.y,
+                               plane.normal.z >= 0 ? box.max.z : box.min.z};
+            Vec3 near_corner = {plane.normal.x >= 0 ? box.min.x : box.max.x,
+                                plane.normal.y >= 0 ? box.min.y : box.max.y,
+                                plane.normal.z >= 0 ? box.min.z : box.max.z};
+
+            visible = plane.distance(far_corner) >= 0;
+            if (plane.distance(near_corner) >= 0) child_planes[slot] &= ~(1u << p);
+        }
+
+        if (visible) visible_mask |= 1u << slot;
+    }
+
+    return visible_mask;
+#endif
+}
+
+size_t Bvh::cull(const Frustum& frustum, uint32_t* out_visible) const {
+    if (nodes.empty()) return 0;
+
+    constexpr unsigned ALL_PLANES = (1u << Frustum::PLANE_COUNT) - 1;
+
+    struct Entry { int32_t node; unsigned planes; };
+    Entry stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = Entry{0, ALL_PLANES};
+
+    size_t visible = 0;
+
+    while (top > 0) {
+        Entry e = stack[--top];
+        const BvhNode4& node = nodes[e.node];
+
+        unsigned child_planes[4];
+        unsigned mask = test_node(node, frustum, e.planes, child_planes);
+
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            uint32_t first = node.first[slot];
+            uint32_t count = node.count[slot];
+            if (count == 0) continue;
+
+            if (child_planes[slot] == 0) {
+                memcpy(out_visible + visible, indices.data() + first, count * sizeof(uint32_t));
+                visible += count;
+            } else if (node.child[slot] >= 0) {
+                stack[top++] = Entry{node.child[slot], child_planes[slot]};
+            } else {
+                // NOTE: a leaf is at most LEAF_MAX = 8 objects, one pass of the AVX kernel
+                uint32_t* out = out_visible + visible;
+                size_t n = frustum_cull_aabbs(frustum, leaf_bounds, first, first + count, out);
+                for (size_t k = 0; k < n; k++) out[k] = indices[out[k]];
+                visible += n;
+            }
+        }
+    }
+
+    return visible;
+}
+
+static inline bool ray_box(const Aabb& box, Vec3 origin, Vec3 inv_dir, float max_t, float* out_t) {
+    float tx0 = (box.min.x - origin.x) * inv_dir.x, tx1 = (box.max.x - origin.x) * inv_dir.x;
+    float ty0 = (box.min.y - origin.y) * inv_dir.y, ty1 = (box.max.y - origin.y) * inv_dir.y;
+    float tz0 = (box.min.z - origin.z) * inv_dir.z, tz1 = (box.max.z - origin.z) * inv_dir.z;
+
+    float t_enter = fmaxf(fmaxf(fminf(tx0, tx1), fminf(ty0, ty1)), fmaxf(fminf(tz0, tz1), 0.0f));
+    float t_exit  = fminf(fminf(fmaxf(tx0, tx1), fmaxf(ty0, ty1)), fminf(fmaxf(tz0, tz1), max_t));
+
+    *out_t = t_enter;
+    return t_enter <= t_exit;
+}
+
+int64_t Bvh::raycast(const Ray& ray, float max_t, float* out_t) const {
+    if (nodes.empty()) return -1;
+
+    Vec3 inv_dir = {1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z};
+
+    int32_t stack[TRAVERSAL_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    int64_t hit = -1;
+    float best_t = max_t;
+
+    while (top > 0) {
+        const BvhNode4& node = nodes[stack[--top]];
+
+        float t_enter[4];
+        unsigned mask = 0;
+
+#if defined(__SSE__)
+        __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+        __m128 ix = _mm_set1_ps(inv_dir.x), iy = _mm_set1_ps(inv_dir.y), iz = _mm_set1_ps(inv_dir.z);
+
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), ox), ix);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), ox), ix);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), oy), iy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), oy), iy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), oz), iz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), oz), iz);
+
+        __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                                  _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+        __m128 t_exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                                 _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(best_t)));
+
+        _mm_storeu_ps(t_enter, enter);
+        mask = _mm_movemask_ps(_mm_cmple_ps(enter, t_exit));
+#else
+        for (int slot = 0; slot < 4; slot++) {
+            if (ray_box(slot_box(node, slot), ray.origin, inv_dir, best_t, &t_enter[slot])) mask |= 1u << slot;
+        }
+#endif
+
+        // push the far children first so the nearest one is visited next and
+        // tightens `best_t` early
+        int order[4];
+        int order_count = 0;
+        while (mask) {
+            int slot = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (node.count[slot] == 0) continue;
+
+            int j = order_count++;
+            while (j > 0 && t_enter[order[j - 1]] < t_enter[slot]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = slot;
+        }
+
+        for (int k = 0; k < order_count; k++) {
+            int slot = order[k];
+
+            if (node.child[slot] >= 0) {
+                stack[top++] = node.child[slot];
+                continue;
+            }
+
+            for (uint32_t i = node.first[slot]; i < node.first[slot] + node.count[slot]; i++) {
+                float t;
+                if (ray_box(leaf_boxes[i], ray.origin, inv_dir, best_t, &t)) {
+                    best_t = t;
+                    hit = indices[i];
+                }
+            }
+        }
+    }
+
+    if (out_t && hit >= 0) *out_t = best_t;
+
+    return hit;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "math.hh"
+#include "cull.hh"
+
+struct Ray {
+    Vec3 origin;
+    // does not have to be normalized, hit distances are in multiples of it
+    Vec3 dir;
+};
+
+// A 4-wide node, the child boxes are stored SoA so one node is tested with a
+// single SSE pass.
+//
+// Every slot is one of:
+//  - inner: child >= 0 is the index of the child node
+//  - leaf:  child <  0, count > 0
+//  - empty: child <  0, count == 0, the box is inverted so nothing ever hits it
+//
+// `first`/`count` always span the objects under the slot, which are contiguous
+// in `Bvh::indices`, so fully visible subtrees are emitted without descending.
+struct alignas(64) BvhNode4 {
+    float min_x[4], min_y[4], min_z[4];
+    float max_x[4], max_y[4], max_z[4];
+    int32_t child[4];
+    uint32_t first[4];
+    uint32_t count[4];
+};
+
+struct Bvh {
+    // binned SAH build over the object boxes, replaces the previous tree
+    void build(const Aabb* boxes, size_t count);
+
+    // recomputes the node boxes bottom-up after the objects have moved, the
+    // topology stays the same so quality degrades if they move a lot
+    void refit(const Aabb* boxes);
+
+    // writes the indices of the objects that are (conservatively) inside the
+    // frustum to `out_visible`, which must have room for all objects; the order is
+    // not sorted
+    size_t cull(const Frustum& frustum, uint32_t* out_visible) const;
+
+    // returns the closest object whose box is hit within `max_t`, or -1
+    int64_t raycast(const Ray& ray, float max_t, float* out_t = nullptr) const;
+
+    inline bool is_empty() const {
+        return nodes.empty();
+    }
+
+    // nodes are in depth-first order, parents always come before their children
+    std::vector<BvhNode4> nodes;
+    // object indices, permuted so the objects of every subtree are contiguous
+    std::vector<uint32_t> indices;
+    // copy of the object boxes in `indices` order, kept close for the leaf tests
+    std::vector<Aabb> leaf_boxes;
+    // the same in SoA, for the frustum kernel
+    BoundsSoA leaf_bounds;
+};
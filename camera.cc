@@ -0,0 +1,66 @@
+#include <cmath>
+
+#include "camera.hh"
+
+constexpr float CAMERA_PITCH_MAX =  89.0f;
+constexpr float CAMERA_PITCH_MIN = -89.0f;
+
+void Camera::set_projection(const Mat4& proj, float far) {
+    projection = proj;
+    z_far = far;
+    dirty = true;
+}
+
+bool Camera::update() {
+    if (pending_dx != 0 || pending_dy != 0) {
+        yaw   += pending_dx * sensitivity;
+        pitch -= pending_dy * sensitivity;
+
+        if      (pitch > CAMERA_PITCH_MAX) pitch = CAMERA_PITCH_MAX;
+        else if (pitch < CAMERA_PITCH_MIN) pitch = CAMERA_PITCH_MIN;
+
+        // NOTE: the trig happens once per frame here, not once per cursor event
+        Quat yaw_rotation = Quat::from_axis_angle(Vec3{0, 1, 0}, -deg_to_rad(yaw + 90.f));
+        Quat pitch_rotation = Quat::from_axis_angle(Vec3{1, 0, 0}, deg_to_rad(pitch));
+
+        // pitch around the camera's own x axis, then yaw around the world up
+        orientation = (yaw_rotation * pitch_rotation).normalized();
+
+        front = orientation.rotate(Vec3{0, 0, -1});
+        right = orientation.rotate(Vec3{1, 0, 0});
+        up = orientation.rotate(Vec3{0, 1, 0});
+
+        pending_dx = 0;
+        pending_dy = 0;
+        dirty = true;
+    }
+
+    if (pending_forward != 0 || pending_right != 0) {
+        position += front * pending_forward;
+        position += right * pending_right;
+
+        pending_forward = 0;
+        pending_right = 0;
+        dirty = true;
+    }
+
+    if (!dirty) return false;
+
+    // the inverse of the camera transform: the transposed rotation, then the
+    // position moved into view space
+    Quat inverse = orientation.conjugate();
+    Vec3 eye = inverse.rotate(position);
+
+    view = inverse.to_mat4();
+    view.elems[12] = -eye.x;
+    view.elems[13] = -eye.y;
+    view.elems[14] = -eye.z;
+
+    view_projection = projection * view;
+    frustum = Frustum::from_matrix(view_projection);
+
+    dirty = false;
+    version++;
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include "math.hh"
+#include "cull.hh"
+
+// A fly camera. Mouse and movement input only accumulates, `update` applies
+// all of it at once and rebuilds the matrices and frustum planes, and only
+// if anything changed since the last update. The orientation is a quaternion
+// built from yaw and pitch, which are kept around to clamp the pitch.
+struct Camera {
+    // `z_far` has to be the far plane `projection` was built with
+    void set_projection(const Mat4& projection, float z_far);
+
+    // raw cursor movement in pixels, any number of times per frame
+    inline void add_mouse_delta(float dx, float dy) {
+        pending_dx += dx;
+        pending_dy += dy;
+    }
+
+    // along the view direction and its right, in world units
+    inline void move(float forward_amount, float right_amount) {
+        pending_forward += forward_amount;
+        pending_right += right_amount;
+    }
+
+    // true if the camera changed, `version` was bumped then
+    bool update();
+
+    Vec3 position = {0.f, 0.f, 3.f};
+    Quat orientation = Quat::identity();
+    // -z, x and y of the orientation
+    Vec3 front = {0.f, 0.f, -1.f};
+    Vec3 right = {1.f, 0.f, 0.f};
+    Vec3 up = {0.f, 1.f, 0.f};
+
+    // degrees, -90 looks down -z
+    float yaw = -90.f;
+    float pitch = 0.f;
+    float sensitivity = 0.1f;
+
+    float z_far = 0;
+
+    Mat4 view;
+    Mat4 projection;
+    Mat4 view_projection;
+    Frustum frustum;
+
+    // bumped on every change, for whatever caches results per camera state
+    uint64_t version = 0;
+
+    float pending_dx = 0;
+    float pending_dy = 0;
+    float pending_forward = 0;
+    float pending_right = 0;
+    bool dirty = true;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "meshlet.hh"
+
+// A DAG of clusters gives very large meshes a level of detail that varies
+// across the mesh instead of one per object. Level 0 are the meshlets of the
+// mesh; every level above it groups a few neighbouring clusters of the one
+// below, simplifies each group with its outline locked so groups still meet,
+// and splits the result into clusters again. A cluster is drawn where its own
+// error is small enough on screen and that of the group it was simplified
+// into isn't, so every part of the mesh is drawn by exactly one level: the
+// errors only grow upwards and the spheres they are measured from only get
+// bigger, so the two tests never both pass or both fail for a parent and its
+// children. See build_cluster_dag for the cooking and GpuCuller for the cut.
+
+constexpr uint32_t CLUSTER_MAX_LEVELS = 16;
+
+struct Cluster {
+    // bounds, normal cone and index range
+    Meshlet meshlet;
+
+    // the error of the group it was made in, and the sphere it's measured from, in the mesh's space; 0 on level 0
+    float lod_sphere[4];
+    // the same for the group it's simplified into, an error of FLT_MAX if it's on the top level
+    float parent_sphere[4];
+    float error;
+    float parent_error;
+
+    uint32_t level;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Cluster) == 96, "clusters are part of the mesh cache, and std430 structs on the GPU");
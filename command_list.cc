@@ -0,0 +1,131 @@
+#include <cstring>
+
+#include "common.hh"
+#include "command_list.hh"
+
+// keeps every command aligned for its widest member
+constexpr size_t COMMAND_ALIGNMENT = 8;
+
+void CommandList::reset(Arena& new_arena) {
+    arena = &new_arena;
+    blocks.clear();
+    command_count = 0;
+}
+
+void* CommandList::allocate(CommandType type, size_t size) {
+    size = (size + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+    if (size > COMMAND_BLOCK_SIZE) die("command does not fit in a command block");
+
+    if (!arena) die("command recorded into a list that was never reset");
+
+    // commands never straddle blocks, start a new one when this one is full
+    if (blocks.empty() || blocks.back().used + size > COMMAND_BLOCK_SIZE) {
+        blocks.push_back(CommandBlock{arena->allocate_array<uint8_t>(COMMAND_BLOCK_SIZE), 0});
+    }
+
+    CommandBlock& block = blocks.back();
+    auto* header = cast(CommandHeader*) (block.data + block.used);
+    header->type = type;
+    header->size = size;
+
+    block.used += size;
+    command_count++;
+
+    return header;
+}
+
+void CommandList::use_program(GLuint program) {
+    auto* cmd = cast(UseProgramCommand*) allocate(COMMAND_USE_PROGRAM, sizeof(UseProgramCommand));
+    cmd->program = program;
+}
+
+void CommandList::bind_vertex_array(GLuint vao) {
+    auto* cmd = cast(BindVertexArrayCommand*) allocate(COMMAND_BIND_VERTEX_ARRAY, sizeof(BindVertexArrayCommand));
+    cmd->vao = vao;
+}
+
+void CommandList::uniform_float(GLint location, float value) {
+    auto* cmd = cast(UniformFloatCommand*) allocate(COMMAND_UNIFORM_FLOAT, sizeof(UniformFloatCommand));
+    cmd->location = location;
+    cmd->value = value;
+}
+
+void CommandList::uniform_mat4(GLint location, const Mat4& value) {
+    auto* cmd = cast(UniformMat4Command*) allocate(COMMAND_UNIFORM_MAT4, sizeof(UniformMat4Command));
+    cmd->location = location;
+    memcpy(cmd->value, value.elems, sizeof(cmd->value));
+}
+
+void CommandList::update_uniform_block(GLuint buffer, GLuint binding, const void* data, size_t size) {
+    auto* cmd = cast(UpdateUniformBlockCommand*) allocate(COMMAND_UPDATE_UNIFORM_BLOCK,
+                                                           sizeof(UpdateUniformBlockCommand) + size);
+    cmd->buffer = buffer;
+    cmd->binding = binding;
+    cmd->size = size;
+    memcpy(cmd + 1, data, size);
+}
+
+void CommandList::draw_arrays(GLenum mode, GLint first, GLsizei count) {
+    auto* cmd = cast(DrawArraysCommand*) allocate(COMMAND_DRAW_ARRAYS, sizeof(DrawArraysCommand));
+    cmd->mode = mode;
+    cmd->first = first;
+    cmd->count = count;
+}
+
+void CommandList::draw_elements(GLenum mode, GLenum type, GLint first, GLsizei count) {
+    auto* cmd = cast(DrawElementsCommand*) allocate(COMMAND_DRAW_ELEMENTS, sizeof(DrawElementsCommand));
+    cmd->mode = mode;
+    cmd->type = type;
+    cmd->count = count;
+
+    const size_t index_size = type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+    cmd->offset = first * index_size;
+}
+
+void CommandList::execute() const {
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const uint8_t* at = blocks[b].data;
+        const uint8_t* end = at + blocks[b].used;
+
+        while (at < end) {
+            auto* header = cast(const CommandHeader*) at;
+
+            switch (header->type) {
+                case COMMAND_USE_PROGRAM: {
+                    auto* cmd = cast(const UseProgramCommand*) at;
+                    glUseProgram(cmd->program);
+                } break;
+                case COMMAND_BIND_VERTEX_ARRAY: {
+                    auto* cmd = cast(const BindVertexArrayCommand*) at;
+                    glBindVertexArray(cmd->vao);
+                } break;
+                case COMMAND_UNIFORM_FLOAT: {
+                    auto* cmd = cast(const UniformFloatCommand*) at;
+                    glUniform1f(cmd->location, cmd->value);
+                } break;
+                case COMMAND_UNIFORM_MAT4: {
+                    auto* cmd = cast(const UniformMat4Command*) at;
+                    glUniformMatrix4fv(cmd->location, 1, GL_FALSE, cmd->value);
+                } break;
+                case COMMAND_UPDATE_UNIFORM_BLOCK: {
+                    auto* cmd = cast(const UpdateUniformBlockCommand*) at;
+                    glBindBuffer(GL_UNIFORM_BUFFER, cmd->buffer);
+                    glBufferSubData(GL_UNIFORM_BUFFER, 0, cmd->size, cmd + 1);
+                    glBindBufferBase(GL_UNIFORM_BUFFER, cmd->binding, cmd->buffer);
+                } break;
+                case COMMAND_DRAW_ARRAYS: {
+                    auto* cmd = cast(const DrawArraysCommand*) at;
+                    glDrawArrays(cmd->mode, cmd->first, cmd->count);
+                } break;
+                case COMMAND_DRAW_ELEMENTS: {
+                    auto* cmd = cast(const DrawElementsCommand*) at;
+                    glDrawElements(cmd->mode, cmd->count, cmd->type, cast(void*) cmd->offset);
+                } break;
+                default:
+                    die("unknown command in a command list");
+            }
+
+            at += header->size;
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "gl.hh"
+#include "math.hh"
+#include "arena.hh"
+
+enum CommandType : uint32_t {
+    COMMAND_USE_PROGRAM,
+    COMMAND_BIND_VERTEX_ARRAY,
+    COMMAND_UNIFORM_FLOAT,
+    COMMAND_UNIFORM_MAT4,
+    COMMAND_UPDATE_UNIFORM_BLOCK,
+    COMMAND_DRAW_ARRAYS,
+    COMMAND_DRAW_ELEMENTS,
+};
+
+// `size` covers the header, the command and anything stored after it, so
+// replay steps over commands without knowing them
+struct CommandHeader {
+    CommandType type;
+    uint32_t size;
+};
+
+struct UseProgramCommand {
+    CommandHeader header;
+    GLuint program;
+};
+
+struct BindVertexArrayCommand {
+    CommandHeader header;
+    GLuint vao;
+};
+
+struct UniformFloatCommand {
+    CommandHeader header;
+    GLint location;
+    float value;
+};
+
+struct UniformMat4Command {
+    CommandHeader header;
+    GLint location;
+    float value[16];
+};
+
+// the data follows the command
+struct UpdateUniformBlockCommand {
+    CommandHeader header;
+    GLuint buffer;
+    GLuint binding;
+    uint32_t size;
+};
+
+struct DrawArraysCommand {
+    CommandHeader header;
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+};
+
+// Commands are copied into blocks taken from an arena, a list is only valid
+// as long as the arena it was recorded into.
+constexpr size_t COMMAND_BLOCK_SIZE = 64 * 1024;
+
+struct CommandBlock {
+    uint8_t* data;
+    size_t used;
+};
+
+// indices of `type` from the bound element buffer, starting `offset` bytes in
+struct DrawElementsCommand {
+    CommandHeader header;
+    GLenum mode;
+    GLenum type;
+    GLsizei count;
+    size_t offset;
+};
+
+// A list of GL calls recorded on any thread and replayed on the GL thread
+// later. Every list is recorded by one thread at a time, several lists can be
+// recorded in parallel.
+struct CommandList {
+    // drops all the commands, the next ones go into `arena`
+    void reset(Arena& arena);
+
+    void use_program(GLuint program);
+    void bind_vertex_array(GLuint vao);
+    void uniform_float(GLint location, float value);
+    void uniform_mat4(GLint location, const Mat4& value);
+    // copies `size` bytes into the list, replay uploads them to `buffer` and binds it to `binding`
+    void update_uniform_block(GLuint buffer, GLuint binding, const void* data, size_t size);
+    void draw_arrays(GLenum mode, GLint first, GLsizei count);
+    // `type` is GL_UNSIGNED_INT/SHORT/BYTE, `first` in indices
+    void draw_elements(GLenum mode, GLenum type, GLint first, GLsizei count);
+
+    // GL thread only
+    void execute() const;
+
+    inline bool is_empty() const {
+        return command_count == 0;
+    }
+
+    void* allocate(CommandType type, size_t size);
+
+    Arena* arena = nullptr;
+    // NOTE: cleared on reset but keeps its capacity, a steady frame doesn't allocate
+    std::vector<CommandBlock> blocks;
+    size_t command_count = 0;
+};
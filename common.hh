@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <source_location>
+
+#define cast(t) (t)
+#define discard (void)
+
+[[noreturn]]
+inline void die(const char* msg, std::source_location loc = std::source_location::current()) {
+    fprintf(stderr, "%s:%d:%d: FATAL ERROR: %s\n", loc.file_name(), loc.line(), loc.column(), msg);
+    exit(1);
+}
+
+constexpr int WIN_WIDTH = 800;
+constexpr int WIN_HEIGHT = 600;
+
+constexpr float aspect_ratio = (float)WIN_WIDTH / (float)WIN_HEIGHT;
@@ -0,0 +1,231 @@
+// glpg-cook: turns source assets into the formats the runtime maps as they
+// are, so it never has to parse or optimize anything at startup.
+//
+//   glpg-cook [-f] [-j threads] [-o assets.pack] files...
+//
+// Every OBJ becomes <file>.mesh next to it (see mesh_cache.hh), indexed,
+// with its triangles in vertex cache order, its vertices in fetch order and
+// its colors quantized, split into meshlets (see meshlet.hh) if it's big
+// enough, and a chain of coarser levels of detail (see mesh_simplify.hh)
+// sharing its vertices, plus a cluster DAG (see cluster.hh) over the
+// meshlets. Files are cooked in parallel on the job system, and
+// one whose output was made from the same input is skipped unless -f is given.
+// With -o the outputs, and the files that have nothing to cook as they are,
+// go into one pack (see pack.hh) under the names they have on disk.
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "jobs.hh"
+#include "obj.hh"
+#include "mesh.hh"
+#include "mesh_opt.hh"
+#include "mesh_simplify.hh"
+#include "mesh_cache.hh"
+#include "pack.hh"
+
+// smaller meshes are drawn whole, splitting them up costs more draws than culling saves
+constexpr size_t MESHLET_MIN_TRIANGLES = MESHLET_MAX_TRIANGLES * 8;
+
+enum CookStatus {
+    COOK_DONE,
+    COOK_UP_TO_DATE,
+    COOK_SKIPPED,
+    COOK_FAILED,
+};
+
+struct CookJob {
+    const char* input;
+    std::string output;
+    CookStatus status;
+    // what to print about it, in input order once everything is done
+    std::string report;
+};
+
+static bool ends_with(const char* s, const char* suffix) {
+    size_t length = strlen(s);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(s + length - suffix_length, suffix) == 0;
+}
+
+static void cook_obj(CookJob& job, bool force) {
+    job.output = std::string(job.input) + ".mesh";
+
+    if (!force) {
+        MeshCache existing;
+        if (existing.open(job.output.c_str(), job.input)) {
+            // NOTE: the header checks don't see a flipped bit in the data, the hash does
+            if (existing.verify()) {
+                job.status = COOK_UP_TO_DATE;
+                return;
+            }
+
+            fprintf(stderr, "%s is damaged, cooking it again\n", job.output.c_str());
+        }
+    }
+
+    // NOTE: stamped before loading, an edit while cooking makes the output stale instead of wrong
+    SourceStamp stamp;
+    MeshData mesh;
+    if (!stamp_source(job.input, &stamp, true) || !load_obj(job.input, &mesh)) {
+        job.status = COOK_FAILED;
+        return;
+    }
+
+    // the same fit the runtime does for meshes it loads itself
+    mesh.fit_unit_box();
+
+    const size_t vertex_count = mesh.vertex_count();
+    float acmr_before = average_cache_miss_ratio(mesh.indices.data(), mesh.index_count(), vertex_count,
+                                                 VERTEX_CACHE_SIZE);
+
+    optimize_vertex_cache(mesh.indices.data(), mesh.index_count(), vertex_count);
+
+    std::vector<Meshlet> meshlets;
+    if (mesh.index_count() / 3 >= MESHLET_MIN_TRIANGLES) meshlets = build_meshlets(mesh);
+
+    optimize_vertex_fetch(mesh);
+
+    float acmr_after = average_cache_miss_ratio(mesh.indices.data(), mesh.index_count(), mesh.vertex_count(),
+                                                VERTEX_CACHE_SIZE);
+
+    // NOTE: after the fetch order, the LODs index the final vertices
+    MeshLods lods;
+    build_lods(mesh, &lods);
+
+    ClusterDag dag;
+    if (!meshlets.empty()) build_cluster_dag(mesh, meshlets, lods.indices.size(), &dag);
+    const uint32_t dag_levels = dag.clusters.empty() ? 0 : dag.clusters.back().level + 1;
+
+    if (!write_mesh_cache(job.output.c_str(), stamp, mesh, &lods, meshlets.data(), meshlets.size(), &dag)) {
+        job.status = COOK_FAILED;
+        return;
+    }
+
+    char report[512];
+    int length = snprintf(report, sizeof(report),
+                          "%zu vertices, %zu triangles, ACMR %.3f -> %.3f, %zu meshlets, %zu clusters in %u levels, LODs",
+                          mesh.vertex_count(), mesh.index_count() / 3, acmr_before, acmr_after, meshlets.size(),
+                          dag.clusters.size(), dag_levels);
+    for (uint32_t i = 0; i < lods.count && length < cast(int) sizeof(report); i++) {
+        length += snprintf(report + length, sizeof(report) - length, " %u (%g)", lods.lods[i].index_count / 3,
+                           lods.lods[i].error);
+    }
+
+    job.status = COOK_DONE;
+    job.report = report;
+}
+
+static void cook(CookJob& job, bool force) {
+    if (ends_with(job.input, ".obj")) {
+        cook_obj(job, force);
+    } else {
+        // NOTE: glTF is mapped and uploaded as it is already, and nothing else has a runtime format yet
+        job.status = COOK_SKIPPED;
+        job.report = "nothing to cook for this kind of file";
+    }
+}
+
+// everything that was cooked, or didn't need to be, into one pack at `path`
+static bool pack_outputs(const char* path, const std::vector<CookJob>& jobs) {
+    std::deque<MappedFile> files;
+    std::vector<PackInput> inputs;
+
+    for (const CookJob& job : jobs) {
+        if (job.status == COOK_FAILED) continue;
+
+        const char* name = job.status == COOK_SKIPPED ? job.input : job.output.c_str();
+        MappedFile& file = files.emplace_back();
+        if (!file.open(name)) return false;
+
+        inputs.push_back(PackInput{name, file.data, file.size});
+    }
+
+    if (!write_pack(path, inputs.data(), inputs.size(), true)) return false;
+
+    size_t total = 0;
+    for (const PackInput& input : inputs) total += input.size;
+
+    MappedFile written;
+    if (!written.open(path, false)) return false;
+    printf("packed %zu files into %s: %zu -> %zu bytes\n", inputs.size(), path, total, written.size);
+
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: glpg-cook [-f] [-j threads] [-o assets.pack] files...\n");
+    fprintf(stderr, "  -f          cook even the files that are up to date\n");
+    fprintf(stderr, "  -j threads  worker threads besides the main one, one per core by default\n");
+    fprintf(stderr, "  -o pack     also put the results into one compressed pack\n");
+}
+
+int main(int argc, char** argv) {
+    bool force = false;
+    unsigned threads = 0;
+    const char* pack_path = nullptr;
+    std::vector<CookJob> jobs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            force = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = cast(unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            pack_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 1;
+        } else {
+            jobs.push_back(CookJob{argv[i], {}, COOK_FAILED, {}});
+        }
+    }
+
+    if (jobs.empty()) {
+        usage();
+        return 1;
+    }
+
+    jobs_init(threads);
+
+    // one file per job, the loaders split big files up further on their own
+    parallel_for(jobs.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) cook(jobs[i], force);
+    });
+
+    int failed = 0;
+    for (const CookJob& job : jobs) {
+        switch (job.status) {
+            case COOK_DONE:
+                printf("cooked %s -> %s: %s\n", job.input, job.output.c_str(), job.report.c_str());
+                break;
+            case COOK_UP_TO_DATE:
+                printf("%s is up to date\n", job.output.c_str());
+                break;
+            case COOK_SKIPPED:
+                printf("skipped %s: %s\n", job.input, job.report.c_str());
+                break;
+            case COOK_FAILED:
+                // NOTE: the reason went to stderr where it happened
+                fprintf(stderr, "could not cook %s\n", job.input);
+                failed++;
+                break;
+        }
+    }
+
+    // NOTE: the pack is compressed on the workers too, they are shut down after it
+    if (pack_path && !pack_outputs(pack_path, jobs)) {
+        fprintf(stderr, "could not write %s\n", pack_path);
+        failed++;
+    }
+
+    jobs_shutdown();
+
+    return failed ? 1 : 0;
+}
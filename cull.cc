@@ -0,0 +1,163 @@
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "cull.hh"
+
+static Plane make_plane(float a, float b, float c, float d) {
+    float len = sqrtf(a * a + b * b + c * c);
+    return Plane{Vec3{a / len, b / len, c / len}, d / len};
+}
+
+Frustum Frustum::from_matrix(const Mat4& m) {
+    // NOTE: Gribb/Hartmann, the planes are sums/differences of the matrix rows
+    auto row = [&](int r, int c) { return m.elems[c * 4 + r]; };
+
+    Frustum f;
+    for (int i = 0; i < 3; i++) {
+        f.planes[i * 2 + 0] = make_plane(row(3, 0) + row(i, 0), row(3, 1) + row(i, 1),
+                                         row(3, 2) + row(i, 2), row(3, 3) + row(i, 3));
+        f.planes[i * 2 + 1] = make_plane(row(3, 0) - row(i, 0), row(3, 1) - row(i, 1),
+                                         row(3, 2) - row(i, 2), row(3, 3) - row(i, 3));
+    }
+
+    return f;
+}
+
+bool Frustum::test_aabb(Vec3 center, Vec3 extents) const {
+    for (const auto& p : planes) {
+        float r = fabsf(p.normal.x) * extents.x + fabsf(p.normal.y) * extents.y + fabsf(p.normal.z) * extents.z;
+        if (p.distance(center) < -r) return false;
+    }
+
+    return true;
+}
+
+bool Frustum::test_sphere(Vec3 center, float radius) const {
+    for (const auto& p : planes) {
+        if (p.distance(center) < -radius) return false;
+    }
+
+    return true;
+}
+
+void BoundsSoA::resize(size_t new_count) {
+    // NOTE: the padding is never visible, the kernels mask off the lanes past the range
+    count = new_count;
+    center_x.resize(count + 7);
+    center_y.resize(count + 7);
+    center_z.resize(count + 7);
+    extent_x.resize(count + 7);
+    extent_y.resize(count + 7);
+    extent_z.resize(count + 7);
+}
+
+void BoundsSoA::set(size_t i, Vec3 center, Vec3 extents) {
+    center_x[i] = center.x;
+    center_y[i] = center.y;
+    center_z[i] = center.z;
+    extent_x[i] = extents.x;
+    extent_y[i] = extents.y;
+    extent_z[i] = extents.z;
+}
+
+static inline size_t emit_mask(unsigned mask, size_t base, uint32_t* out) {
+    size_t n = 0;
+    while (mask) {
+        out[n++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+
+    return n;
+}
+
+// the lanes of a vector of `width` at `i` that are still before `end`
+static inline unsigned range_mask(size_t i, size_t end, unsigned width) {
+    return end - i >= width ? (1u << width) - 1 : (1u << (end - i)) - 1;
+}
+
+size_t frustum_cull_aabbs(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end,
+                          uint32_t* out_visible) {
+    const float* cx = bounds.center_x.data();
+    const float* cy = bounds.center_y.data();
+    const float* cz = bounds.center_z.data();
+    const float* ex = bounds.extent_x.data();
+    const float* ey = bounds.extent_y.data();
+    const float* ez = bounds.extent_z.data();
+
+    size_t visible = 0;
+    size_t i = begin;
+
+#if defined(__AVX__)
+    __m256 nx[Frustum::PLANE_COUNT], ny[Frustum::PLANE_COUNT], nz[Frustum::PLANE_COUNT], nd[Frustum::PLANE_COUNT];
+    __m256 ax[Frustum::PLANE_COUNT], ay[Frustum::PLANE_COUNT], az[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        const auto& plane = frustum.planes[p];
+        nx[p] = _mm256_set1_ps(plane.normal.x);
+        ny[p] = _mm256_set1_ps(plane.normal.y);
+        nz[p] = _mm256_set1_ps(plane.normal.z);
+        nd[p] = _mm256_set1_ps(plane.d);
+        ax[p] = _mm256_set1_ps(fabsf(plane.normal.x));
+        ay[p] = _mm256_set1_ps(fabsf(plane.normal.y));
+        az[p] = _mm256_set1_ps(fabsf(plane.normal.z));
+    }
+
+    for (; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+        __m256 w = _mm256_loadu_ps(ex + i), h = _mm256_loadu_ps(ey + i), d = _mm256_loadu_ps(ez + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x), _mm256_mul_ps(ny[p], y)),
+                                        _mm256_add_ps(_mm256_mul_ps(nz[p], z), nd[p]));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], w), _mm256_mul_ps(ay[p], h)),
+                                     _mm256_mul_ps(az[p], d));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        unsigned mask = _mm256_movemask_ps(inside) & range_mask(i, end, 8);
+        visible += emit_mask(mask, i, out_visible + visible);
+    }
+#elif defined(__SSE__)
+    __m128 nx[Frustum::PLANE_COUNT], ny[Frustum::PLANE_COUNT], nz[Frustum::PLANE_COUNT], nd[Frustum::PLANE_COUNT];
+    __m128 ax[Frustum::PLANE_COUNT], ay[Frustum::PLANE_COUNT], az[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+        const auto& plane = frustum.planes[p];
+        nx[p] = _mm_set1_ps(plane.normal.x);
+        ny[p] = _mm_set1_ps(plane.normal.y);
+        nz[p] = _mm_set1_ps(plane.normal.z);
+        nd[p] = _mm_set1_ps(plane.d);
+        ax[p] = _mm_set1_ps(fabsf(plane.normal.x));
+        ay[p] = _mm_set1_ps(fabsf(plane.normal.y));
+        az[p] = _mm_set1_ps(fabsf(plane.normal.z));
+    }
+
+    for (; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+        __m128 w = _mm_loadu_ps(ex + i), h = _mm_loadu_ps(ey + i), d = _mm_loadu_ps(ez + i);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)),
+                                     _mm_add_ps(_mm_mul_ps(nz[p], z), nd[p]));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], w), _mm_mul_ps(ay[p], h)),
+                                  _mm_mul_ps(az[p], d));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+        }
+
+        unsigned mask = _mm_movemask_ps(inside) & range_mask(i, end, 4);
+        visible += emit_mask(mask, i, out_visible + visible);
+    }
+#endif
+
+    // without SIMD, the vector loops above always run to the end
+    for (; i < end; i++) {
+        if (frustum.test_aabb(Vec3{cx[i], cy[i], cz[i]}, Vec3{ex[i], ey[i], ez[i]})) {
+            out_visible[visible++] = i;
+        }
+    }
+
+    return visible;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "math.hh"
+
+struct Plane {
+    inline float distance(Vec3 p) const {
+        return normal.x * p.x + normal.y * p.y + normal.z * p.z + d;
+    }
+
+    // NOTE: the normal points into the frustum, points with a negative distance are outside
+    Vec3 normal;
+    float d;
+};
+
+struct Frustum {
+    enum {
+        PLANE_LEFT,
+        PLANE_RIGHT,
+        PLANE_BOTTOM,
+        PLANE_TOP,
+        PLANE_NEAR,
+        PLANE_FAR,
+        PLANE_COUNT,
+    };
+
+    // extracts the planes in world space from `projection * view`
+    static Frustum from_matrix(const Mat4& view_projection);
+
+    bool test_aabb(Vec3 center, Vec3 extents) const;
+    bool test_sphere(Vec3 center, float radius) const;
+
+    Plane planes[PLANE_COUNT];
+};
+
+// World space boxes in SoA layout, so the kernel can load a component of
+// 4/8 objects with one instruction. The arrays run 7 entries past `size()`,
+// so any range is tested in whole vectors.
+struct BoundsSoA {
+    void resize(size_t count);
+    void set(size_t i, Vec3 center, Vec3 extents);
+
+    inline size_t size() const {
+        return count;
+    }
+
+    inline Vec3 center(size_t i) const {
+        return Vec3{center_x[i], center_y[i], center_z[i]};
+    }
+
+    inline Vec3 extents(size_t i) const {
+        return Vec3{extent_x[i], extent_y[i], extent_z[i]};
+    }
+
+    std::vector<float> center_x, center_y, center_z;
+    std::vector<float> extent_x, extent_y, extent_z;
+    size_t count = 0;
+};
+
+// Writes the indices of the visible boxes in [begin, end) in ascending order
+// to `out_visible`, which must have room for `end - begin` entries, and
+// returns their count.
+size_t frustum_cull_aabbs(const Frustum& frustum, const BoundsSoA& bounds, size_t begin, size_t end,
+                          uint32_t* out_visible);
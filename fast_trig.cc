@@ -0,0 +1,186 @@
+#include "fast_trig.hh"
+
+#if defined(__AVX2__)
+static inline __m256 madd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline void sincos8(__m256 angle, __m256* out_sin, __m256* out_cos) {
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+
+    __m256 sin_sign = _mm256_and_ps(angle, sign_mask);
+    __m256 x = _mm256_andnot_ps(sign_mask, angle);
+
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(SINCOS_FOUR_OVER_PI)));
+    j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(j);
+
+    x = madd(y, _mm256_set1_ps(-SINCOS_PI4_A), x);
+    x = madd(y, _mm256_set1_ps(-SINCOS_PI4_B), x);
+    x = madd(y, _mm256_set1_ps(-SINCOS_PI4_C), x);
+
+    const __m256i four = _mm256_set1_epi32(4);
+    sin_sign = _mm256_xor_ps(sin_sign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, four), 29)));
+    __m256i cos_bits = _mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), four);
+    __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(cos_bits, 29));
+
+    __m256 swap = _mm256_castsi256_ps(
+        _mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 c = madd(_mm256_set1_ps(SINCOS_COS_0), z, _mm256_set1_ps(SINCOS_COS_1));
+    c = madd(c, z, _mm256_set1_ps(SINCOS_COS_2));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+    c = madd(_mm256_set1_ps(-0.5f), z, c);
+    c = _mm256_add_ps(c, _mm256_set1_ps(1.0f));
+
+    __m256 s = madd(_mm256_set1_ps(SINCOS_SIN_0), z, _mm256_set1_ps(SINCOS_SIN_1));
+    s = madd(s, z, _mm256_set1_ps(SINCOS_SIN_2));
+    s = madd(_mm256_mul_ps(s, z), x, x);
+
+    *out_sin = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sin_sign);
+    *out_cos = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cos_sign);
+}
+#elif defined(__SSE2__)
+static inline __m128 madd(__m128 a, __m128 b, __m128 c) {
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void sincos4(__m128 angle, __m128* out_sin, __m128* out_cos) {
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+
+    __m128 sin_sign = _mm_and_ps(angle, sign_mask);
+    __m128 x = _mm_andnot_ps(sign_mask, angle);
+
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(SINCOS_FOUR_OVER_PI)));
+    j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+
+    x = madd(y, _mm_set1_ps(-SINCOS_PI4_A), x);
+    x = madd(y, _mm_set1_ps(-SINCOS_PI4_B), x);
+    x = madd(y, _mm_set1_ps(-SINCOS_PI4_C), x);
+
+    const __m128i four = _mm_set1_epi32(4);
+    sin_sign = _mm_xor_ps(sin_sign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29)));
+    __m128i cos_bits = _mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), four);
+    __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(cos_bits, 29));
+
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 c = madd(_mm_set1_ps(SINCOS_COS_0), z, _mm_set1_ps(SINCOS_COS_1));
+    c = madd(c, z, _mm_set1_ps(SINCOS_COS_2));
+    c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+    c = madd(_mm_set1_ps(-0.5f), z, c);
+    c = _mm_add_ps(c, _mm_set1_ps(1.0f));
+
+    __m128 s = madd(_mm_set1_ps(SINCOS_SIN_0), z, _mm_set1_ps(SINCOS_SIN_1));
+    s = madd(s, z, _mm_set1_ps(SINCOS_SIN_2));
+    s = madd(_mm_mul_ps(s, z), x, x);
+
+    *out_sin = _mm_xor_ps(select(swap, c, s), sin_sign);
+    *out_cos = _mm_xor_ps(select(swap, s, c), cos_sign);
+}
+#endif
+
+void sincos_batch(const float* angles, float* out_sin, float* out_cos, size_t count) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 s, c;
+        sincos8(_mm256_loadu_ps(angles + i), &s, &c);
+        _mm256_storeu_ps(out_sin + i, s);
+        _mm256_storeu_ps(out_cos + i, c);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 s, c;
+        sincos4(_mm_loadu_ps(angles + i), &s, &c);
+        _mm_storeu_ps(out_sin + i, s);
+        _mm_storeu_ps(out_cos + i, c);
+    }
+#endif
+
+    for (; i < count; i++) {
+        fast_sincos(angles[i], out_sin + i, out_cos + i);
+    }
+}
+
+void axis_angle_quats(Vec3 axis, const float* angles, float* out_x, float* out_y, float* out_z, float* out_w,
+                      size_t count) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 ax = _mm256_set1_ps(axis.x), ay = _mm256_set1_ps(axis.y), az = _mm256_set1_ps(axis.z);
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 s, c;
+        sincos8(_mm256_mul_ps(_mm256_loadu_ps(angles + i), half), &s, &c);
+        _mm256_storeu_ps(out_x + i, _mm256_mul_ps(ax, s));
+        _mm256_storeu_ps(out_y + i, _mm256_mul_ps(ay, s));
+        _mm256_storeu_ps(out_z + i, _mm256_mul_ps(az, s));
+        _mm256_storeu_ps(out_w + i, c);
+    }
+#elif defined(__SSE2__)
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 ax = _mm_set1_ps(axis.x), ay = _mm_set1_ps(axis.y), az = _mm_set1_ps(axis.z);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 s, c;
+        sincos4(_mm_mul_ps(_mm_loadu_ps(angles + i), half), &s, &c);
+        _mm_storeu_ps(out_x + i, _mm_mul_ps(ax, s));
+        _mm_storeu_ps(out_y + i, _mm_mul_ps(ay, s));
+        _mm_storeu_ps(out_z + i, _mm_mul_ps(az, s));
+        _mm_storeu_ps(out_w + i, c);
+    }
+#endif
+
+    for (; i < count; i++) {
+        Quat q = Quat::from_axis_angle(axis, angles[i]);
+        out_x[i] = q.x;
+        out_y[i] = q.y;
+        out_z[i] = q.z;
+        out_w[i] = q.w;
+    }
+}
+
+void axis_angle_matrices(Vec3 axis, const float* angles, Mat4* out, size_t count) {
+    // the sines and cosines go through a small buffer, the matrices are built
+    // one by one anyway
+    constexpr size_t CHUNK = 64;
+    float sines[CHUNK], cosines[CHUNK];
+
+    const float xx = axis.x * axis.x, yy = axis.y * axis.y, zz = axis.z * axis.z;
+    const float xy = axis.x * axis.y, xz = axis.x * axis.z, yz = axis.y * axis.z;
+
+    for (size_t base = 0; base < count; base += CHUNK) {
+        size_t n = count - base < CHUNK ? count - base : CHUNK;
+        sincos_batch(angles + base, sines, cosines, n);
+
+        for (size_t k = 0; k < n; k++) {
+            const float s = sines[k], c = cosines[k], t = 1.0f - c;
+
+            // Rodrigues' formula
+            out[base + k] = Mat4{t * xx + c,          t * xy - s * axis.z, t * xz + s * axis.y, 0,
+                                 t * xy + s * axis.z, t * yy + c,          t * yz - s * axis.x, 0,
+                                 t * xz - s * axis.y, t * yz + s * axis.x, t * zz + c,          0,
+                                 0,                   0,                   0,                   1};
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+#include "math.hh"
+
+// Batch versions of `fast_sincos` (math.hh), 8 angles at a time with AVX2 and
+// 4 with SSE2. Same reduction and polynomials, so the same error bound; with
+// FMA the lanes can round differently from the scalar version in the last bit.
+void sincos_batch(const float* angles, float* out_sin, float* out_cos, size_t count);
+
+// `count` rotations by `angles[i]` radians around the same normalized `axis`,
+// written as separate quaternion components, which is how TransformHierarchy
+// stores them
+void axis_angle_quats(Vec3 axis, const float* angles, float* out_x, float* out_y, float* out_z, float* out_w,
+                      size_t count);
+
+// same as above, as rotation matrices
+void axis_angle_matrices(Vec3 axis, const float* angles, Mat4* out, size_t count);
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.hh"
+#include "file.hh"
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char* path, bool read_ahead) {
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "Could not stat %s: %s\n", path, strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    // NOTE: mmap refuses empty mappings, an empty file is just no data
+    if (st.st_size > 0) {
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            fprintf(stderr, "Could not map %s: %s\n", path, strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        // the whole file is going to be read, start reading it in right away
+        if (read_ahead) madvise(mapped, st.st_size, MADV_WILLNEED);
+
+        data = cast(const uint8_t*) mapped;
+        size = st.st_size;
+    }
+
+    // the mapping keeps the file alive
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+    if (offset >= this->size) return;
+    if (size > this->size - offset) size = this->size - offset;
+
+    // NOTE: madvise wants a page aligned start
+    const size_t page = cast(size_t) sysconf(_SC_PAGESIZE);
+    const size_t begin = offset & ~(page - 1);
+    madvise(cast(void*) (data + begin), offset + size - begin, MADV_WILLNEED);
+}
+
+void MappedFile::close() {
+    if (data) munmap(cast(void*) data, size);
+
+    data = nullptr;
+    size = 0;
+}
+
+bool write_file(const char* path, const void* data, size_t size) {
+    std::string temp = std::string(path) + ".tmp";
+
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create %s: %s\n", temp.c_str(), strerror(errno));
+        return false;
+    }
+
+    const uint8_t* at = cast(const uint8_t*) data;
+    while (size > 0) {
+        ssize_t written = ::write(fd, at, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) {
+            fprintf(stderr, "Could not write %s: %s\n", temp.c_str(), strerror(errno));
+            ::close(fd);
+            unlink(temp.c_str());
+            return false;
+        }
+
+        at += written;
+        size -= written;
+    }
+
+    ::close(fd);
+
+    if (rename(temp.c_str(), path) < 0) {
+        fprintf(stderr, "Could not rename %s to %s: %s\n", temp.c_str(), path, strerror(errno));
+        unlink(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
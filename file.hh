@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read-only. The pages are only read in as they're
+// touched, several threads can parse different parts of it at once.
+struct MappedFile {
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false (with the reason on stderr) if the file can't be opened or mapped;
+    // with `read_ahead` the whole file starts being read in right away, without
+    // it only what gets touched (or prefetch()ed) is
+    bool open(const char* path, bool read_ahead = true);
+    void close();
+
+    // starts reading [offset, offset + size) in the background
+    void prefetch(size_t offset, size_t size) const;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// writes `size` bytes to `path` through a temporary file that is renamed over
+// it, so nobody ever maps half a file; false (with the reason on stderr) on failure
+bool write_file(const char* path, const void* data, size_t size);
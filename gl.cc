@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "common.hh"
+#include "gl.hh"
+
+#define X(t, name) t name;
+ENUM_GL_PROCS
+#undef X
+
+void load_gl_procs() {
+#define X(t, name) name = cast(t) glfwGetProcAddress(#name);
+ENUM_GL_PROCS
+#undef X
+
+    // NOTE: core only since 4.6, older contexts may still have the ARB version
+    if (gl_version() < 46) {
+        glMultiDrawElementsIndirectCount = nullptr;
+
+        if (glfwExtensionSupported("GL_ARB_indirect_parameters")) {
+            glMultiDrawElementsIndirectCount =
+                cast(PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC) glfwGetProcAddress("glMultiDrawElementsIndirectCountARB");
+        }
+    }
+}
+
+int gl_version() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    return major * 10 + minor;
+}
+
+GLuint create_shader(GLenum type, const char* src) {
+    auto shader = glCreateShader(type);
+    glShaderSource(shader, 1, &src, nullptr);
+
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+    if (status == GL_FALSE) {
+        char info_log[256];
+        glGetShaderInfoLog(shader, sizeof(info_log), nullptr, info_log);
+
+        fprintf(stderr, "Could not compile the shader: %s\n", info_log);
+        exit(1);
+    }
+
+    return shader;
+}
+
+static void check_link_status(GLuint prog) {
+    GLint status;
+    glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        char info_log[256];
+        glGetProgramInfoLog(prog, sizeof(info_log), nullptr, info_log);
+
+        fprintf(stderr, "Could not link the program: %s\n", info_log);
+        exit(1);
+    }
+}
+
+GLuint create_program(GLuint vert, GLuint frag) {
+    auto prog = glCreateProgram();
+
+    glAttachShader(prog, vert);
+    glAttachShader(prog, frag);
+
+    glLinkProgram(prog);
+    check_link_status(prog);
+
+    glDetachShader(prog, vert);
+    glDetachShader(prog, frag);
+
+    return prog;
+}
+
+GLuint create_compute_program(const char* src) {
+    auto shader = create_shader(GL_COMPUTE_SHADER, src);
+    auto prog = glCreateProgram();
+
+    glAttachShader(prog, shader);
+
+    glLinkProgram(prog);
+    check_link_status(prog);
+
+    glDetachShader(prog, shader);
+    glDeleteShader(shader);
+
+    return prog;
+}
+
+void RenderTarget::resize(int w, int h) {
+    if (fbo && w == width && h == height) return;
+
+    width = w;
+    height = h;
+
+    if (!fbo) {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &color);
+        glGenTextures(1, &depth);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        die("render target framebuffer is incomplete");
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderTarget::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+void RenderTarget::blit_to_screen() {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#define ENUM_GL_PROCS \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+    X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLDELETEPROGRAMPROC, glDeleteProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLDETACHSHADERPROC, glDetachShader) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+    X(PFNGLUNIFORM1FPROC, glUniform1f) \
+    X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv) \
+    X(PFNGLUNIFORM1IPROC, glUniform1i) \
+    X(PFNGLUNIFORM1UIPROC, glUniform1ui) \
+    X(PFNGLUNIFORM2IPROC, glUniform2i) \
+    X(PFNGLUNIFORM3FPROC, glUniform3f) \
+    X(PFNGLUNIFORM1FVPROC, glUniform1fv) \
+    X(PFNGLUNIFORM2UIVPROC, glUniform2uiv) \
+    X(PFNGLUNIFORM4FVPROC, glUniform4fv) \
+    X(PFNGLGETUNIFORMBLOCKINDEXPROC, glGetUniformBlockIndex) \
+    X(PFNGLUNIFORMBLOCKBINDINGPROC, glUniformBlockBinding) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
+    X(PFNGLGETBUFFERSUBDATAPROC, glGetBufferSubData) \
+    X(PFNGLCOPYBUFFERSUBDATAPROC, glCopyBufferSubData) \
+    X(PFNGLBINDBUFFERBASEPROC, glBindBufferBase) \
+    X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers) \
+    X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+    X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D) \
+    X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus) \
+    X(PFNGLBLITFRAMEBUFFERPROC, glBlitFramebuffer) \
+    X(PFNGLTEXSTORAGE2DPROC, glTexStorage2D) \
+    X(PFNGLBINDIMAGETEXTUREPROC, glBindImageTexture) \
+    X(PFNGLDISPATCHCOMPUTEPROC, glDispatchCompute) \
+    X(PFNGLDISPATCHCOMPUTEINDIRECTPROC, glDispatchComputeIndirect) \
+    X(PFNGLMEMORYBARRIERPROC, glMemoryBarrier) \
+    X(PFNGLFENCESYNCPROC, glFenceSync) \
+    X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync) \
+    X(PFNGLDELETESYNCPROC, glDeleteSync) \
+    X(PFNGLMULTIDRAWELEMENTSINDIRECTPROC, glMultiDrawElementsIndirect) \
+    X(PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTPROC, glMultiDrawElementsIndirectCount)
+
+#define X(t, name) extern t name;
+ENUM_GL_PROCS
+#undef X
+
+void load_gl_procs();
+
+// major * 10 + minor of the current context, e.g. 45 for 4.5
+int gl_version();
+
+GLuint create_shader(GLenum type, const char* src);
+GLuint create_program(GLuint vert, GLuint frag);
+GLuint create_compute_program(const char* src);
+
+// Offscreen color + depth target, the depth is a texture so it can be read back
+// by later passes.
+struct RenderTarget {
+    // (re)creates the attachments when the size changed
+    void resize(int width, int height);
+
+    void bind();
+    void blit_to_screen();
+
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    int width = 0;
+    int height = 0;
+};
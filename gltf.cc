@@ -0,0 +1,627 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <string_view>
+
+#include "common.hh"
+#include "gltf.hh"
+#include "json.hh"
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67;  // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+constexpr int64_t GLTF_MODE_TRIANGLES = 4;
+
+// node hierarchies deeper than this are taken for cycles
+constexpr int GLTF_MAX_NODE_DEPTH = 64;
+
+// what a material without a baseColorFactor, or a primitive without a material, gets
+constexpr Vec3 GLTF_DEFAULT_COLOR = {1.0f, 1.0f, 1.0f};
+
+static size_t component_size(GLenum type) {
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static int type_components(std::string_view type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static bool decode_base64(std::string_view text, std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(text.size() / 4 * 3);
+
+    uint32_t bits = 0;
+    int bit_count = 0;
+
+    for (char c : text) {
+        if (c == '=') break;
+
+        int value = base64_value(c);
+        if (value < 0) return false;
+
+        bits = bits << 6 | value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            out.push_back(cast(uint8_t) (bits >> bit_count));
+        }
+    }
+
+    return true;
+}
+
+// All the state of one load, the JSON text and the document only live as long as this.
+struct GltfLoader {
+    bool error(const char* message) {
+        fprintf(stderr, "%s: %s\n", path, message);
+        return false;
+    }
+
+    bool load_buffers();
+    bool load_views();
+    bool load_accessors();
+    bool load_materials();
+    bool load_meshes();
+    bool load_nodes();
+    bool add_node(int64_t node, const Mat4& parent, int depth);
+
+    // the index in `array`'s elements, -1 if `value` isn't a valid one
+    int32_t index(const JsonValue* value, const char* array) const;
+
+    GltfModel* model;
+    const char* path;
+    std::string dir;
+
+    Json json;
+    const JsonValue* root;
+
+    // the BIN chunk of a .glb
+    const uint8_t* bin = nullptr;
+    size_t bin_size = 0;
+
+    // the elements of `nodes` and `accessors`, for lookups by index
+    std::vector<const JsonValue*> nodes;
+    std::vector<const JsonValue*> accessor_values;
+
+    // the primitives of each mesh, [first, first + count)
+    std::vector<uint32_t> mesh_first;
+    std::vector<uint32_t> mesh_count;
+};
+
+int32_t GltfLoader::index(const JsonValue* value, const char* array) const {
+    if (!value || !value->is_number()) return -1;
+
+    const JsonValue* elements = json.get(root, array);
+    if (!elements || value->integer < 0 || value->integer >= elements->count) return -1;
+
+    return cast(int32_t) value->integer;
+}
+
+bool GltfLoader::load_buffers() {
+    const JsonValue* buffers = json.get(root, "buffers");
+
+    for (const JsonValue* buffer = json.first(buffers); buffer; buffer = json.next(buffers, buffer)) {
+        const int64_t length = json.get_int(buffer, "byteLength", -1);
+        if (length < 0) return error("a buffer has no byteLength");
+
+        std::string_view uri = json.get_string(buffer, "uri");
+        const uint8_t* data;
+        size_t size;
+
+        if (uri.empty()) {
+            // NOTE: only the first buffer of a .glb can be without a URI, it is the BIN chunk
+            if (!bin || buffer != json.first(buffers)) return error("a buffer has no uri");
+            data = bin;
+            size = bin_size;
+        } else if (uri.starts_with("data:")) {
+            size_t comma = uri.find(',');
+            if (comma == std::string_view::npos || uri.substr(0, comma).find(";base64") == std::string_view::npos) {
+                return error("a data URI isn't base64");
+            }
+
+            model->decoded.emplace_back();
+            if (!decode_base64(uri.substr(comma + 1), model->decoded.back())) return error("a data URI isn't base64");
+
+            data = model->decoded.back().data();
+            size = model->decoded.back().size();
+        } else {
+            // NOTE: percent-encoded URIs aren't decoded, exporters rarely write any
+            MappedFile& file = model->external.emplace_back();
+            if (!file.open((dir + std::string(uri)).c_str())) return false;
+
+            data = file.data;
+            size = file.size;
+        }
+
+        if (size < cast(size_t) length) return error("a buffer is shorter than its byteLength");
+
+        model->buffer_data.push_back(data);
+        model->buffer_size.push_back(length);
+    }
+
+    return true;
+}
+
+bool GltfLoader::load_views() {
+    const JsonValue* views = json.get(root, "bufferViews");
+
+    for (const JsonValue* view = json.first(views); view; view = json.next(views, view)) {
+        const int32_t buffer = index(json.get(view, "buffer"), "buffers");
+        const int64_t offset = json.get_int(view, "byteOffset", 0);
+        const int64_t length = json.get_int(view, "byteLength", -1);
+        const int64_t stride = json.get_int(view, "byteStride", 0);
+
+        if (buffer < 0 || offset < 0 || length < 0 || stride < 0) return error("a buffer view is invalid");
+        if (cast(size_t) (offset + length) > model->buffer_size[buffer]) return error("a buffer view is out of its buffer");
+
+        model->views.push_back(GltfView{cast(uint32_t) buffer, cast(size_t) offset, cast(size_t) length,
+                                        cast(size_t) stride, false});
+    }
+
+    return true;
+}
+
+bool GltfLoader::load_accessors() {
+    const JsonValue* accessors = json.get(root, "accessors");
+
+    for (const JsonValue* accessor = json.first(accessors); accessor; accessor = json.next(accessors, accessor)) {
+        if (json.get(accessor, "sparse")) return error("sparse accessors aren't supported");
+
+        const int32_t view = index(json.get(accessor, "bufferView"), "bufferViews");
+        if (view < 0) return error("an accessor has no buffer view");
+
+        GltfAccessor a = {};
+        a.view = view;
+        a.component_type = json.get_int(accessor, "componentType", 0);
+        a.components = type_components(json.get_string(accessor, "type"));
+
+        const JsonValue* normalized = json.get(accessor, "normalized");
+        a.normalized = normalized && normalized->type == JSON_TRUE;
+
+        const int64_t offset = json.get_int(accessor, "byteOffset", 0);
+        const int64_t count = json.get_int(accessor, "count", -1);
+
+        const size_t size = component_size(a.component_type);
+        if (size == 0 || a.components == 0 || offset < 0 || count < 0) return error("an accessor is invalid");
+
+        a.offset = offset;
+        a.count = count;
+
+        // NOTE: GL wants every attribute offset aligned to its component
+        if (a.offset % size != 0) return error("an accessor is misaligned");
+
+        // the last element has to end inside the view
+        const GltfView& v = model->views[view];
+        const size_t element = size * a.components;
+        const size_t stride = v.stride ? v.stride : element;
+        if (a.count > 0 && (a.count - 1) * stride + element + a.offset > v.length) {
+            return error("an accessor is out of its buffer view");
+        }
+
+        model->accessors.push_back(a);
+        accessor_values.push_back(accessor);
+    }
+
+    return true;
+}
+
+bool GltfLoader::load_materials() {
+    const JsonValue* materials = json.get(root, "materials");
+
+    for (const JsonValue* material = json.first(materials); material; material = json.next(materials, material)) {
+        const JsonValue* pbr = json.get(material, "pbrMetallicRoughness");
+        const JsonValue* factor = json.get(pbr, "baseColorFactor");
+
+        Vec3 color = GLTF_DEFAULT_COLOR;
+        if (factor && factor->type == JSON_ARRAY && factor->count >= 3) {
+            const JsonValue* c = json.first(factor);
+            color.x = c->number;
+            c = json.next(factor, c);
+            color.y = c->number;
+            c = json.next(factor, c);
+            color.z = c->number;
+        }
+
+        model->material_colors.push_back(color);
+    }
+
+    return true;
+}
+
+static bool position_bounds(const Json& json, const JsonValue* accessor, Aabb* out) {
+    const JsonValue* min = json.get(accessor, "min");
+    const JsonValue* max = json.get(accessor, "max");
+    if (!min || !max || min->type != JSON_ARRAY || max->type != JSON_ARRAY || min->count < 3 || max->count < 3) {
+        return false;
+    }
+
+    float lo[3], hi[3];
+    const JsonValue* a = json.first(min);
+    const JsonValue* b = json.first(max);
+    for (int i = 0; i < 3; i++, a = json.next(min, a), b = json.next(max, b)) {
+        lo[i] = a->number;
+        hi[i] = b->number;
+    }
+
+    *out = Aabb{Vec3{lo[0], lo[1], lo[2]}, Vec3{hi[0], hi[1], hi[2]}};
+    return true;
+}
+
+bool GltfLoader::load_meshes() {
+    const JsonValue* meshes = json.get(root, "meshes");
+
+    size_t skipped = 0;
+
+    for (const JsonValue* mesh = json.first(meshes); mesh; mesh = json.next(meshes, mesh)) {
+        mesh_first.push_back(model->primitives.size());
+
+        const JsonValue* primitives = json.get(mesh, "primitives");
+        for (const JsonValue* p = json.first(primitives); p; p = json.next(primitives, p)) {
+            const JsonValue* attributes = json.get(p, "attributes");
+
+            GltfPrimitive primitive = {};
+            primitive.position = index(json.get(attributes, "POSITION"), "accessors");
+            primitive.color = index(json.get(attributes, "COLOR_0"), "accessors");
+            primitive.indices = index(json.get(p, "indices"), "accessors");
+            primitive.material = index(json.get(p, "material"), "materials");
+
+            // NOTE: points, lines and strips have nothing to go through the triangle pipeline with
+            if (json.get_int(p, "mode", GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES || primitive.position < 0) {
+                skipped++;
+                continue;
+            }
+
+            const GltfAccessor& position = model->accessors[primitive.position];
+            if (position.components != 3) return error("a POSITION accessor isn't a VEC3");
+
+            if (primitive.color >= 0) {
+                const GltfAccessor& color = model->accessors[primitive.color];
+                if (color.components < 3 || color.components > 4 || color.count < position.count) {
+                    return error("a COLOR_0 accessor is invalid");
+                }
+            }
+
+            if (primitive.indices >= 0) {
+                const GltfAccessor& indices = model->accessors[primitive.indices];
+                if (indices.components != 1 || (indices.component_type != GL_UNSIGNED_BYTE &&
+                                                 indices.component_type != GL_UNSIGNED_SHORT &&
+                                                 indices.component_type != GL_UNSIGNED_INT)) {
+                    return error("an index accessor is invalid");
+                }
+                // NOTE: the element buffer is read as tightly packed indices
+                if (model->views[indices.view].stride != 0) return error("an index buffer view has a stride");
+            }
+
+            if (!position_bounds(json, accessor_values[primitive.position], &primitive.bounds)) {
+                return error("a POSITION accessor has no min/max");
+            }
+
+            model->views[position.view].used = true;
+            if (primitive.color >= 0) model->views[model->accessors[primitive.color].view].used = true;
+            if (primitive.indices >= 0) model->views[model->accessors[primitive.indices].view].used = true;
+
+            model->primitives.push_back(primitive);
+        }
+
+        mesh_count.push_back(model->primitives.size() - mesh_first.back());
+    }
+
+    if (skipped) fprintf(stderr, "%s: skipped %zu primitives that aren't triangle lists\n", path, skipped);
+
+    return true;
+}
+
+static Mat4 node_transform(const Json& json, const JsonValue* node) {
+    Mat4 local;
+
+    const JsonValue* matrix = json.get(node, "matrix");
+    if (matrix && matrix->type == JSON_ARRAY && matrix->count == 16) {
+        // NOTE: column-major, same as Mat4
+        const JsonValue* e = json.first(matrix);
+        for (int i = 0; i < 16; i++, e = json.next(matrix, e)) local.elems[i] = e->number;
+        return local;
+    }
+
+    float t[3] = {0, 0, 0};
+    float r[4] = {0, 0, 0, 1};
+    float s[3] = {1, 1, 1};
+
+    auto read = [&](const char* key, float* out, uint32_t count) {
+        const JsonValue* array = json.get(node, key);
+        if (!array || array->type != JSON_ARRAY || array->count != count) return;
+
+        const JsonValue* e = json.first(array);
+        for (uint32_t i = 0; i < count; i++, e = json.next(array, e)) out[i] = e->number;
+    };
+
+    read("translation", t, 3);
+    read("rotation", r, 4);
+    read("scale", s, 3);
+
+    // T * R * S
+    local = Quat{r[0], r[1], r[2], r[3]}.normalized().to_mat4();
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 3; row++) local.elems[col * 4 + row] *= s[col];
+    }
+    local.elems[12] = t[0];
+    local.elems[13] = t[1];
+    local.elems[14] = t[2];
+
+    return local;
+}
+
+bool GltfLoader::add_node(int64_t node, const Mat4& parent, int depth) {
+    if (depth > GLTF_MAX_NODE_DEPTH) return error("the node hierarchy is too deep or has a cycle");
+
+    if (node < 0 || cast(size_t) node >= nodes.size()) return error("a node index is invalid");
+    const JsonValue* n = nodes[node];
+
+    const Mat4 world = parent * node_transform(json, n);
+
+    const JsonValue* mesh = json.get(n, "mesh");
+    if (mesh) {
+        if (!mesh->is_number() || mesh->integer < 0 || cast(size_t) mesh->integer >= mesh_first.size()) {
+            return error("a mesh index is invalid");
+        }
+
+        const uint32_t first = mesh_first[mesh->integer];
+        for (uint32_t p = first; p < first + mesh_count[mesh->integer]; p++) {
+            model->instances.push_back(GltfInstance{p, world, transform_aabb(world, model->primitives[p].bounds)});
+        }
+    }
+
+    const JsonValue* children = json.get(n, "children");
+    for (const JsonValue* child = json.first(children); child; child = json.next(children, child)) {
+        if (!child->is_number()) return error("a node child is invalid");
+        if (!add_node(child->integer, world, depth + 1)) return false;
+    }
+
+    return true;
+}
+
+bool GltfLoader::load_nodes() {
+    const JsonValue* node_array = json.get(root, "nodes");
+    for (const JsonValue* node = json.first(node_array); node; node = json.next(node_array, node)) nodes.push_back(node);
+
+    const JsonValue* scenes = json.get(root, "scenes");
+    const JsonValue* scene = json.first(scenes);
+
+    const int32_t scene_index = index(json.get(root, "scene"), "scenes");
+    for (int32_t i = 0; i < scene_index; i++) scene = json.next(scenes, scene);
+
+    const JsonValue* roots = json.get(scene, "nodes");
+    if (roots) {
+        for (const JsonValue* node = json.first(roots); node; node = json.next(roots, node)) {
+            if (!node->is_number() || !add_node(node->integer, Mat4(), 0)) return false;
+        }
+        return true;
+    }
+
+    // NOTE: without a scene every node nobody has as a child is a root
+    std::vector<bool> is_child(nodes.size(), false);
+    for (const JsonValue* node : nodes) {
+        const JsonValue* children = json.get(node, "children");
+        for (const JsonValue* child = json.first(children); child; child = json.next(children, child)) {
+            if (child->is_number() && child->integer >= 0 && cast(size_t) child->integer < nodes.size()) {
+                is_child[child->integer] = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (!is_child[i] && !add_node(i, Mat4(), 0)) return false;
+    }
+
+    return true;
+}
+
+bool GltfModel::load(const char* path) {
+    if (!file.open(path)) return false;
+
+    GltfLoader loader;
+    loader.model = this;
+    loader.path = path;
+
+    std::string dir(path);
+    size_t slash = dir.rfind('/');
+    dir.resize(slash == std::string::npos ? 0 : slash + 1);
+    loader.dir = dir;
+
+    const char* text = cast(const char*) file.data;
+    size_t text_size = file.size;
+
+    uint32_t magic = 0;
+    if (file.size >= 4) memcpy(&magic, file.data, 4);
+
+    if (magic == GLB_MAGIC) {
+        // 12 byte header, then chunks of (length, type, data), JSON first
+        uint32_t header[3];
+        if (file.size < sizeof(header)) return loader.error("the GLB header is cut off");
+        memcpy(header, file.data, sizeof(header));
+
+        if (header[1] != 2) return loader.error("only glTF 2.0 is supported");
+        const size_t total = header[2] < file.size ? header[2] : file.size;
+
+        text = nullptr;
+        for (size_t at = sizeof(header); at + 8 <= total;) {
+            uint32_t chunk[2];
+            memcpy(chunk, file.data + at, sizeof(chunk));
+            at += sizeof(chunk);
+
+            if (chunk[0] > total - at) return loader.error("a GLB chunk is cut off");
+
+            if (chunk[1] == GLB_CHUNK_JSON && !text) {
+                text = cast(const char*) file.data + at;
+                text_size = chunk[0];
+            } else if (chunk[1] == GLB_CHUNK_BIN && !loader.bin) {
+                loader.bin = file.data + at;
+                loader.bin_size = chunk[0];
+            }
+
+            at += chunk[0];
+        }
+
+        if (!text) return loader.error("the GLB has no JSON chunk");
+    }
+
+    if (!loader.json.parse(text, text_size)) return loader.error("could not parse the JSON");
+    loader.root = loader.json.root();
+    if (loader.root->type != JSON_OBJECT) return loader.error("the JSON isn't an object");
+
+    const JsonValue* asset = loader.json.get(loader.root, "asset");
+    if (!loader.json.get_string(asset, "version").starts_with("2.")) return loader.error("only glTF 2.0 is supported");
+
+    const JsonValue* required = loader.json.get(loader.root, "extensionsRequired");
+    for (const JsonValue* ext = loader.json.first(required); ext; ext = loader.json.next(required, ext)) {
+        fprintf(stderr, "%s: the extension %.*s is required but not supported\n", path, cast(int) ext->string.size(),
+                ext->string.data());
+        return false;
+    }
+
+    return loader.load_buffers() && loader.load_views() && loader.load_accessors() && loader.load_materials() &&
+           loader.load_meshes() && loader.load_nodes();
+}
+
+size_t GltfModel::triangle_count() const {
+    size_t count = 0;
+    for (const GltfInstance& instance : instances) {
+        const GltfPrimitive& primitive = primitives[instance.primitive];
+        count += accessors[primitive.indices >= 0 ? primitive.indices : primitive.position].count / 3;
+    }
+    return count;
+}
+
+void GltfModel::fit_unit_box(Vec3 target) {
+    if (instances.empty()) return;
+
+    Aabb box = Aabb::empty();
+    for (const GltfInstance& instance : instances) {
+        box.grow(instance.bounds.min);
+        box.grow(instance.bounds.max);
+    }
+
+    Vec3 center = box.center();
+    Vec3 size = box.max - box.min;
+
+    float largest = fmaxf(size.x, fmaxf(size.y, size.z));
+    float scale = largest > 0 ? 1.0f / largest : 1.0f;
+
+    Mat4 fit(scale, 0, 0, target.x - center.x * scale,
+             0, scale, 0, target.y - center.y * scale,
+             0, 0, scale, target.z - center.z * scale,
+             0, 0, 0, 1);
+
+    for (GltfInstance& instance : instances) {
+        instance.world = fit * instance.world;
+        instance.bounds = transform_aabb(instance.world, primitives[instance.primitive].bounds);
+    }
+}
+
+void GltfModel::upload(GpuResources& resources) {
+    // NOTE: no VAO bound, or the element array binding below would land in whatever VAO was
+    glBindVertexArray(0);
+
+    // the views go up as they are, the driver reads straight from the mapping
+    std::vector<GLuint> view_buffers(views.size(), 0);
+    std::vector<BufferHandle> view_handles(views.size());
+
+    for (size_t i = 0; i < views.size(); i++) {
+        if (!views[i].used) continue;
+
+        const GltfView& view = views[i];
+        view_handles[i] = resources.create_buffer(GL_ARRAY_BUFFER, view.length, buffer_data[view.buffer] + view.offset,
+                                                  GL_STATIC_DRAW);
+        view_buffers[i] = resources.get(view_handles[i])->buffer;
+    }
+
+    for (GltfPrimitive& primitive : primitives) {
+        const GltfAccessor& position = accessors[primitive.position];
+
+        Mesh mesh = {};
+        mesh.vertex_count = position.count;
+
+        glGenVertexArrays(1, &mesh.vao);
+        glBindVertexArray(mesh.vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, view_buffers[position.view]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, position.component_type, position.normalized, views[position.view].stride,
+                              cast(void*) position.offset);
+
+        glEnableVertexAttribArray(1);
+        if (primitive.color >= 0) {
+            // NOTE: an rgba color goes into the vec3 attribute fine, the alpha is dropped
+            const GltfAccessor& color = accessors[primitive.color];
+
+            glBindBuffer(GL_ARRAY_BUFFER, view_buffers[color.view]);
+            glVertexAttribPointer(1, color.components, color.component_type, color.normalized,
+                                  views[color.view].stride, cast(void*) color.offset);
+        } else {
+            // the material color for every vertex, the buffer belongs to the mesh
+            Vec3 color = primitive.material >= 0 ? material_colors[primitive.material] : GLTF_DEFAULT_COLOR;
+
+            std::vector<float> colors(position.count * 3);
+            for (size_t v = 0; v < position.count; v++) {
+                colors[v * 3 + 0] = color.x;
+                colors[v * 3 + 1] = color.y;
+                colors[v * 3 + 2] = color.z;
+            }
+
+            mesh.vertices = resources.create_buffer(GL_ARRAY_BUFFER, colors.size() * sizeof(float), colors.data(),
+                                                    GL_STATIC_DRAW);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        }
+
+        if (primitive.indices >= 0) {
+            const GltfAccessor& indices = accessors[primitive.indices];
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, view_buffers[indices.view]);
+            mesh.index_count = indices.count;
+            mesh.index_type = indices.component_type;
+            mesh.first_index = indices.offset / component_size(indices.component_type);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        primitive.mesh = resources.add_mesh(mesh);
+    }
+
+    // NOTE: everything is on the GPU now, the mappings only hold on to page cache
+    file.close();
+    external.clear();
+    decoded.clear();
+    buffer_data.clear();
+    buffer_size.clear();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <vector>
+
+#include "math.hh"
+#include "file.hh"
+#include "resources.hh"
+
+// a range of one buffer, uploaded as one GL buffer
+struct GltfView {
+    uint32_t buffer;
+    size_t offset;
+    size_t length;
+    // 0 when the elements are tightly packed
+    size_t stride;
+    bool used;
+};
+
+struct GltfAccessor {
+    uint32_t view;
+    // from the start of the view
+    size_t offset;
+    // GL_FLOAT, GL_UNSIGNED_SHORT, ... glTF uses the GL values
+    GLenum component_type;
+    int components;
+    size_t count;
+    bool normalized;
+};
+
+struct GltfPrimitive {
+    // accessors, -1 if the primitive doesn't have one
+    int32_t position;
+    int32_t color;
+    int32_t indices;
+    int32_t material;
+
+    // of the positions, in the mesh's own space
+    Aabb bounds;
+
+    // null until uploaded
+    MeshHandle mesh;
+};
+
+// one primitive placed in the scene
+struct GltfInstance {
+    uint32_t primitive;
+    Mat4 world;
+    Aabb bounds;
+};
+
+// A glTF 2.0 scene, as .gltf (JSON with external or data URI buffers) or .glb.
+// The files are mapped and every buffer view the geometry uses goes to the
+// GPU as it is, straight from the mapping: the vertex attributes point into
+// the views with their offsets and strides, so interleaved and strided
+// layouts are drawn without being repacked. Only triangle lists with
+// positions, and optionally COLOR_0 and the base color of the material, are
+// used; node transforms are flattened into instances.
+struct GltfModel {
+    // false (with the reason on stderr) if the file can't be read or isn't
+    // glTF we can draw
+    bool load(const char* path);
+
+    // scales and moves the whole scene into the unit box around `center`
+    void fit_unit_box(Vec3 center);
+
+    // creates the buffers and vertex arrays in `resources`, then lets go of the files; GL thread only
+    void upload(GpuResources& resources);
+
+    // of all the instances
+    size_t triangle_count() const;
+
+    MappedFile file;
+    // external .bin files of a .gltf, and the buffers embedded as base64
+    std::deque<MappedFile> external;
+    std::vector<std::vector<uint8_t>> decoded;
+
+    std::vector<const uint8_t*> buffer_data;
+    std::vector<size_t> buffer_size;
+
+    std::vector<GltfView> views;
+    std::vector<GltfAccessor> accessors;
+    std::vector<GltfPrimitive> primitives;
+    // base color factors, rgb
+    std::vector<Vec3> material_colors;
+
+    std::vector<GltfInstance> instances;
+};
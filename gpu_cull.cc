@@ -0,0 +1,674 @@
+#include <cfloat>
+#include <cmath>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "gpu_cull.hh"
+
+constexpr int CULL_GROUP_SIZE = 64;
+constexpr int HIZ_GROUP_SIZE = 8;
+
+// what the instance and the cluster pass share
+static const char* cull_common_src = R"src(#version 430
+
+struct Bounds {
+    vec4 center;
+    vec4 extents;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+
+// as in meshlet.hh
+struct Meshlet {
+    vec4 sphere;
+    vec4 cone;
+    float cone_sin;
+    uint first_index;
+    uint index_count;
+    uint reserved;
+};
+
+// as in cluster.hh
+struct Cluster {
+    Meshlet meshlet;
+    vec4 lod_sphere;
+    vec4 parent_sphere;
+    float error;
+    float parent_error;
+    uint level;
+    uint reserved;
+};
+
+layout(std430, binding = 0) readonly buffer BoundsBuffer { Bounds bounds[]; };
+layout(std430, binding = 1) writeonly buffer CommandBuffer { DrawCommand commands[]; };
+layout(std430, binding = 2) buffer CountBuffer { uint draw_count; };
+layout(std430, binding = 3) readonly buffer InstanceBuffer { mat4 models[]; };
+layout(std430, binding = 4) readonly buffer ClusterBuffer { Cluster clusters[]; };
+// the instances drawn in meshlets, after the group counts for glDispatchComputeIndirect
+layout(std430, binding = 5) buffer ClusterQueue {
+    uint cluster_groups_x;
+    uint cluster_groups_y;
+    uint cluster_groups_z;
+    uint cluster_instances[];
+};
+
+uniform vec4 planes[6];
+uniform mat4 view_projection;
+uniform uint instance_count;
+uniform bool compact;
+uniform uint command_capacity;
+// 0 when LOD 0 is drawn whole
+uniform uint cluster_count;
+// the clusters are a DAG that takes the place of the LODs, of which the levels from `resident_level` up are in
+// the index buffer; otherwise they're the meshlets of LOD 0
+uniform bool continuous;
+uniform uint resident_level;
+
+// first index and index count, and the error of every LOD
+uniform uint lod_count;
+uniform uvec2 lod_ranges[8];
+uniform float lod_errors[8];
+uniform vec3 camera_pos;
+// the pixels an error of 1 covers at a distance of 1, over the pixels allowed
+uniform float lod_pixel_scale;
+
+uniform bool use_hiz;
+uniform int hiz_levels;
+uniform ivec2 hiz_size;
+layout(binding = 0) uniform sampler2D hiz;
+
+bool frustum_visible(vec3 c, vec3 e) {
+    for (int i = 0; i < 6; i++) {
+        float r = dot(abs(planes[i].xyz), e);
+        if (dot(planes[i].xyz, c) + planes[i].w < -r) return false;
+    }
+    return true;
+}
+
+bool sphere_visible(vec3 c, float r) {
+    for (int i = 0; i < 6; i++) {
+        if (dot(planes[i].xyz, c) + planes[i].w < -r) return false;
+    }
+    return true;
+}
+
+bool occlusion_visible(vec3 c, vec3 e) {
+    vec3 lo = vec3(1e30);
+    vec3 hi = vec3(-1e30);
+
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = c + e * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = view_projection * vec4(corner, 1.0);
+
+        // reaches behind the camera, nothing can be in front of it
+        if (clip.w <= 1e-4) return true;
+
+        vec3 ndc = clip.xyz / clip.w;
+        lo = min(lo, ndc);
+        hi = max(hi, ndc);
+    }
+
+    ivec2 p0 = clamp(ivec2((lo.xy * 0.5 + 0.5) * vec2(hiz_size)), ivec2(0), hiz_size - 1);
+    ivec2 p1 = clamp(ivec2((hi.xy * 0.5 + 0.5) * vec2(hiz_size)), ivec2(0), hiz_size - 1);
+
+    // the level where the rect covers at most 2x2 texels, 3x3 where odd sizes were folded
+    int level = 0;
+    while (level + 1 < hiz_levels && any(greaterThan((p1 >> level) - (p0 >> level), ivec2(1)))) level++;
+
+    // NOTE: not textureSize, the meshlets of one group land on different levels and some drivers size them
+    // all by one of them
+    ivec2 last = max(hiz_size >> level, ivec2(1)) - 1;
+    ivec2 t0 = min(p0 >> level, last);
+    ivec2 t1 = min(p1 >> level, last);
+
+    float occluder = 0.0;
+    for (int y = t0.y; y <= t1.y; y++) {
+        for (int x = t0.x; x <= t1.x; x++) {
+            occluder = max(occluder, texelFetch(hiz, ivec2(x, y), level).r);
+        }
+    }
+
+    return lo.z * 0.5 + 0.5 <= occluder;
+}
+
+float max_scale(mat3 m) {
+    return sqrt(max(max(dot(m[0], m[0]), dot(m[1], m[1])), dot(m[2], m[2])));
+}
+)src";
+
+static const char* cull_src = R"src(
+layout(local_size_x = 64) in;
+
+uint select_lod(uint i, vec3 c, vec3 e) {
+    float scale = max_scale(mat3(models[i]));
+    float distance = max(length(c - camera_pos) - length(e), 1e-3);
+
+    float max_error = distance / (lod_pixel_scale * scale);
+
+    uint lod = 0u;
+    while (lod + 1u < lod_count && lod_errors[lod + 1u] <= max_error) lod++;
+    return lod;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= instance_count) return;
+
+    vec3 c = bounds[i].center.xyz;
+    vec3 e = bounds[i].extents.xyz;
+
+    bool visible = frustum_visible(c, e) && (!use_hiz || occlusion_visible(c, e));
+    uint lod = visible && !continuous ? select_lod(i, c, e) : 0u;
+
+    // the cluster pass culls its clusters and draws them instead
+    if (visible && lod == 0u && cluster_count > 0u) {
+        cluster_instances[atomicAdd(cluster_groups_x, 1u)] = i;
+        return;
+    }
+
+    uvec2 range = lod_ranges[lod];
+
+    if (compact) {
+        if (!visible) return;
+
+        uint slot = atomicAdd(draw_count, 1u);
+        commands[slot] = DrawCommand(range.y, 1u, range.x, 0, i);
+    } else {
+        commands[i] = DrawCommand(range.y, visible ? 1u : 0u, range.x, 0, i);
+    }
+}
+)src";
+
+// one group per instance queued by the instance pass, its threads take turns at the clusters
+static const char* cluster_src = R"src(
+layout(local_size_x = 64) in;
+
+// read back to stream in the next level: a cluster on the finest one in memory wanted to be finer
+layout(std430, binding = 6) buffer StreamFeedback { uint stream_finer; };
+
+// an error of the mesh at `sphere` is under the pixels allowed, as in select_lod
+bool error_hidden(vec4 sphere, float error, mat4 model, float scale) {
+    vec3 c = (model * vec4(sphere.xyz, 1.0)).xyz;
+    float distance = max(length(c - camera_pos) - sphere.w * scale, 1e-3);
+    return error <= distance / (lod_pixel_scale * scale);
+}
+
+void main() {
+    uint instance = cluster_instances[gl_WorkGroupID.x];
+    mat4 model = models[instance];
+    float scale = max_scale(mat3(model));
+
+    for (uint k = gl_LocalInvocationID.x; k < cluster_count; k += gl_WorkGroupSize.x) {
+        Cluster cluster = clusters[k];
+        if (cluster.level < resident_level) continue;
+
+        // the cut, see cluster.hh: the group it's simplified into is too coarse here, and it's fine enough itself
+        // or there is nothing finer to draw yet
+        if (error_hidden(cluster.parent_sphere, cluster.parent_error, model, scale)) continue;
+        bool finer = !error_hidden(cluster.lod_sphere, cluster.error, model, scale);
+        if (finer && cluster.level > resident_level) continue;
+
+        Meshlet meshlet = cluster.meshlet;
+
+        vec3 c = (model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+        float r = meshlet.sphere.w * scale;
+        if (!sphere_visible(c, r)) continue;
+
+        // on the far side of the mesh, see meshlet_visible
+        if (meshlet.cone.w > 0.0) {
+            vec3 axis = normalize(mat3(model) * meshlet.cone.xyz);
+            vec3 v = c - camera_pos;
+            float along = dot(v, axis);
+            float across = sqrt(max(dot(v, v) - along * along, 0.0));
+            if (along * meshlet.cone.w - across * meshlet.cone_sin > r) continue;
+        }
+
+        if (use_hiz && !occlusion_visible(c, vec3(r))) continue;
+
+        if (finer) stream_finer = 1u;
+
+        // NOTE: a cut can take more clusters than level 0 has, what doesn't fit waits for the next level
+        uint slot = atomicAdd(draw_count, 1u);
+        if (slot < command_capacity) {
+            commands[slot] = DrawCommand(meshlet.index_count, 1u, meshlet.first_index, 0, instance);
+        }
+    }
+}
+)src";
+
+static const char* hiz_src = R"src(#version 430
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D depth;
+layout(r32f, binding = 0) readonly uniform image2D src;
+layout(r32f, binding = 1) writeonly uniform image2D dst;
+
+// level 0 copies the depth texture, every other level reduces the previous one
+uniform bool copy;
+uniform ivec2 src_size;
+uniform ivec2 dst_size;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, dst_size))) return;
+
+    if (copy) {
+        imageStore(dst, p, vec4(texelFetch(depth, p, 0).r));
+        return;
+    }
+
+    // odd sizes fold the leftover row/column into the last texel
+    ivec2 lo = p * 2;
+    ivec2 hi = lo + 1;
+    if (p.x == dst_size.x - 1) hi.x = src_size.x - 1;
+    if (p.y == dst_size.y - 1) hi.y = src_size.y - 1;
+
+    float d = 0.0;
+    for (int y = lo.y; y <= hi.y; y++) {
+        for (int x = lo.x; x <= hi.x; x++) {
+            d = max(d, imageLoad(src, ivec2(x, y)).r);
+        }
+    }
+
+    imageStore(dst, p, vec4(d));
+}
+)src";
+
+static CullUniforms get_cull_uniforms(GLuint prog) {
+    CullUniforms u;
+    u.planes = glGetUniformLocation(prog, "planes");
+    u.view_projection = glGetUniformLocation(prog, "view_projection");
+    u.instance_count = glGetUniformLocation(prog, "instance_count");
+    u.compact = glGetUniformLocation(prog, "compact");
+    u.command_capacity = glGetUniformLocation(prog, "command_capacity");
+    u.cluster_count = glGetUniformLocation(prog, "cluster_count");
+    u.continuous = glGetUniformLocation(prog, "continuous");
+    u.resident_level = glGetUniformLocation(prog, "resident_level");
+    u.lod_count = glGetUniformLocation(prog, "lod_count");
+    u.lod_ranges = glGetUniformLocation(prog, "lod_ranges");
+    u.lod_errors = glGetUniformLocation(prog, "lod_errors");
+    u.camera_pos = glGetUniformLocation(prog, "camera_pos");
+    u.lod_pixel_scale = glGetUniformLocation(prog, "lod_pixel_scale");
+    u.use_hiz = glGetUniformLocation(prog, "use_hiz");
+    u.hiz_levels = glGetUniformLocation(prog, "hiz_levels");
+    u.hiz_size = glGetUniformLocation(prog, "hiz_size");
+
+    return u;
+}
+
+bool GpuCuller::init() {
+    if (gl_version() < 43) return false;
+
+    cull_prog = create_compute_program((std::string(cull_common_src) + cull_src).c_str());
+    cluster_prog = create_compute_program((std::string(cull_common_src) + cluster_src).c_str());
+    hiz_prog = create_compute_program(hiz_src);
+
+    cull_uniforms = get_cull_uniforms(cull_prog);
+    cluster_uniforms = get_cull_uniforms(cluster_prog);
+    hiz_copy_loc = glGetUniformLocation(hiz_prog, "copy");
+    hiz_src_size_loc = glGetUniformLocation(hiz_prog, "src_size");
+    hiz_dst_size_loc = glGetUniformLocation(hiz_prog, "dst_size");
+
+    glGenBuffers(1, &bounds_buffer);
+    glGenBuffers(1, &command_buffer);
+    glGenBuffers(1, &count_buffer);
+    glGenBuffers(1, &cluster_buffer);
+    glGenBuffers(1, &cluster_queue_buffer);
+    glGenBuffers(1, &feedback_buffer);
+    glGenBuffers(1, &readback_buffer);
+
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, count_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, readback_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_STREAM_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    compact = glMultiDrawElementsIndirectCount != nullptr;
+
+    return true;
+}
+
+void GpuCuller::destroy() {
+    if (feedback_fence) glDeleteSync(feedback_fence);
+    feedback_fence = nullptr;
+
+    GLuint buffers[] = {bounds_buffer, command_buffer, count_buffer, cluster_buffer, cluster_queue_buffer,
+                        feedback_buffer, readback_buffer};
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    bounds_buffer = command_buffer = count_buffer = cluster_buffer = cluster_queue_buffer = 0;
+    feedback_buffer = readback_buffer = 0;
+
+    if (hiz_texture) glDeleteTextures(1, &hiz_texture);
+    hiz_texture = 0;
+    hiz_width = hiz_height = 0;
+    hiz_valid = false;
+
+    glDeleteProgram(cull_prog);
+    glDeleteProgram(cluster_prog);
+    glDeleteProgram(hiz_prog);
+    cull_prog = cluster_prog = hiz_prog = 0;
+
+    instance_count = 0;
+    command_capacity = 0;
+    bounds_staging.clear();
+}
+
+void GpuCuller::resize_commands() {
+    // NOTE: every meshlet of every instance is the worst case, a slot less and a draw could go missing; a DAG's
+    // cut hardly ever takes more clusters than its level 0 has
+    size_t capacity = instance_count + (compact ? instance_count * finest_cluster_count : 0);
+    if (capacity == command_capacity) return;
+
+    command_capacity = capacity;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::upload(const Aabb* bounds, size_t count, size_t begin, size_t end) {
+    const bool resized = count != instance_count;
+    if (resized) {
+        // the group counts, then an instance each
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_queue_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (3 + count) * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+        // std430 vec4 pairs, the w components are padding
+        bounds_staging.assign(count * 8, 0.f);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bounds_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bounds_staging.size() * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+
+        // NOTE: the new buffer has nothing in it yet, whatever range moved
+        begin = 0;
+        end = count;
+    }
+
+    instance_count = count;
+    if (end > count) end = count;
+
+    for (size_t i = begin; i < end; i++) {
+        Vec3 c = bounds[i].center();
+        Vec3 e = bounds[i].extents();
+
+        float* d = bounds_staging.data() + i * 8;
+        d[0] = c.x; d[1] = c.y; d[2] = c.z;
+        d[4] = e.x; d[5] = e.y; d[6] = e.z;
+    }
+
+    if (begin < end) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bounds_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, begin * 8 * sizeof(float), (end - begin) * 8 * sizeof(float),
+                        bounds_staging.data() + begin * 8);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (resized) resize_commands();
+}
+
+void GpuCuller::set_lods(const MeshLod* mesh_lods, uint32_t count) {
+    lod_count = count < MESH_MAX_LODS ? count : MESH_MAX_LODS;
+    for (uint32_t i = 0; i < lod_count; i++) lods[i] = mesh_lods[i];
+}
+
+void GpuCuller::set_meshlets(const Meshlet* meshlets, size_t count) {
+    // level 0 of a DAG that stops there, always fine enough with nothing above it
+    std::vector<Cluster> clusters(count);
+    for (size_t i = 0; i < count; i++) {
+        clusters[i] = Cluster{};
+        clusters[i].meshlet = meshlets[i];
+        clusters[i].parent_error = FLT_MAX;
+    }
+
+    set_clusters(clusters.data(), count, nullptr, 0);
+}
+
+void GpuCuller::set_clusters(const Cluster* clusters, size_t count, const uint32_t* indices, GLuint index_buffer) {
+    cluster_count = count;
+    continuous = indices && count;
+
+    if (count) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(Cluster), clusters, GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // the index range of every level, they follow each other
+    level_count = 0;
+    finest_cluster_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Meshlet& meshlet = clusters[i].meshlet;
+        const uint32_t level = clusters[i].level;
+        if (level == 0) finest_cluster_count++;
+
+        if (level >= level_count) {
+            level_count = level + 1;
+            level_first_index[level] = meshlet.first_index;
+            level_end_index[level] = meshlet.first_index;
+        }
+        level_first_index[level] = std::min(level_first_index[level], meshlet.first_index);
+        level_end_index[level] = std::max(level_end_index[level], meshlet.first_index + meshlet.index_count);
+    }
+
+    // a readback still on its way is about the last mesh
+    if (feedback_fence) {
+        glDeleteSync(feedback_fence);
+        feedback_fence = nullptr;
+    }
+
+    stream_indices = indices;
+    stream_index_buffer = index_buffer;
+    resident_level = 0;
+    if (continuous) {
+        resident_level = level_count - 1;
+        upload_level(resident_level);
+    }
+
+    resize_commands();
+}
+
+void GpuCuller::upload_level(uint32_t level) {
+    const uint32_t first = level_first_index[level];
+
+    // NOTE: not GL_ELEMENT_ARRAY_BUFFER, that's the bound vertex array's
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream_index_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(uint32_t),
+                    (level_end_index[level] - first) * sizeof(uint32_t), stream_indices + first);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuCuller::stream_levels() {
+    // NOTE: only once the GPU is through with the frame the feedback came from, the frame never waits for it
+    if (!feedback_fence || glClientWaitSync(feedback_fence, 0, 0) == GL_TIMEOUT_EXPIRED) return;
+
+    glDeleteSync(feedback_fence);
+    feedback_fence = nullptr;
+
+    GLuint finer = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, readback_buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(finer), &finer);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    // a level at a time, each one about doubles the indices in memory
+    if (finer && resident_level > 0) upload_level(--resident_level);
+}
+
+// the uniforms both passes read
+void GpuCuller::set_uniforms(GLuint prog, const CullUniforms& u, const Mat4& view_projection, const float* planes,
+                             Vec3 camera_pos, float pixel_scale) {
+    GLuint lod_ranges[MESH_MAX_LODS * 2];
+    float lod_errors[MESH_MAX_LODS];
+    for (uint32_t i = 0; i < lod_count; i++) {
+        lod_ranges[i * 2 + 0] = lods[i].first_index;
+        lod_ranges[i * 2 + 1] = lods[i].index_count;
+        lod_errors[i] = lods[i].error;
+    }
+
+    glUseProgram(prog);
+
+    glUniform4fv(u.planes, Frustum::PLANE_COUNT, planes);
+    glUniformMatrix4fv(u.view_projection, 1, GL_FALSE, view_projection.elems);
+    glUniform1ui(u.instance_count, instance_count);
+    glUniform1i(u.compact, compact);
+    glUniform1ui(u.command_capacity, command_capacity);
+    // NOTE: without a draw count on the GPU the commands are one per instance, there is no room for clusters
+    glUniform1ui(u.cluster_count, compact ? cluster_count : 0);
+    glUniform1i(u.continuous, compact && continuous);
+    glUniform1ui(u.resident_level, resident_level);
+
+    glUniform1ui(u.lod_count, lod_count);
+    glUniform2uiv(u.lod_ranges, lod_count, lod_ranges);
+    glUniform1fv(u.lod_errors, lod_count, lod_errors);
+    glUniform3f(u.camera_pos, camera_pos.x, camera_pos.y, camera_pos.z);
+    glUniform1f(u.lod_pixel_scale, pixel_scale / LOD_PIXEL_ERROR);
+    glUniform1i(u.use_hiz, hiz_valid);
+
+    if (hiz_valid) {
+        glUniform1i(u.hiz_levels, hiz_levels);
+        glUniform2i(u.hiz_size, hiz_width, hiz_height);
+    }
+}
+
+void GpuCuller::cull(const Mat4& view_projection, const Frustum& frustum, Vec3 camera_pos, float pixel_scale,
+                     GLuint instance_buffer) {
+    if (instance_count == 0) return;
+
+    if (continuous) stream_levels();
+
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, count_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+
+    // no instance queued yet, and a dispatch of 0 x 1 x 1 groups
+    GLuint groups[3] = {0, 1, 1};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_queue_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(groups), groups);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    float planes[Frustum::PLANE_COUNT * 4];
+    for (int i = 0; i < Frustum::PLANE_COUNT; i++) {
+        const Plane& p = frustum.planes[i];
+        planes[i * 4 + 0] = p.normal.x;
+        planes[i * 4 + 1] = p.normal.y;
+        planes[i * 4 + 2] = p.normal.z;
+        planes[i * 4 + 3] = p.d;
+    }
+
+    if (hiz_valid) glBindTexture(GL_TEXTURE_2D, hiz_texture);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bounds_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, command_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, count_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, instance_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cluster_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, cluster_queue_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, feedback_buffer);
+
+    set_uniforms(cull_prog, cull_uniforms, view_projection, planes, camera_pos, pixel_scale);
+    glDispatchCompute((instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    if (compact && cluster_count) {
+        // NOTE: the queue is read as the group counts too, GL_COMMAND_BARRIER_BIT covers that
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        set_uniforms(cluster_prog, cluster_uniforms, view_projection, planes, camera_pos, pixel_scale);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, cluster_queue_buffer);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // what this frame's cut asked for, unless an earlier frame's is still on its way
+    if (compact && continuous && !feedback_fence) {
+        glBindBuffer(GL_COPY_READ_BUFFER, feedback_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback_buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        feedback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GpuCuller::draw(GLenum mode) {
+    if (instance_count == 0) return;
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+    if (compact) {
+        glBindBuffer(GL_PARAMETER_BUFFER, count_buffer);
+        glMultiDrawElementsIndirectCount(mode, GL_UNSIGNED_INT, nullptr, 0, command_capacity, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    } else {
+        glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr, instance_count, 0);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCuller::build_hiz(GLuint depth_texture, int width, int height) {
+    if (width != hiz_width || height != hiz_height) {
+        // immutable storage, so a resize needs a new texture
+        if (hiz_texture) glDeleteTextures(1, &hiz_texture);
+
+        hiz_width = width;
+        hiz_height = height;
+        hiz_levels = 1 + (int)floorf(log2f((float)(width > height ? width : height)));
+
+        glGenTextures(1, &hiz_texture);
+        glBindTexture(GL_TEXTURE_2D, hiz_texture);
+        glTexStorage2D(GL_TEXTURE_2D, hiz_levels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    glUseProgram(hiz_prog);
+
+    glUniform1i(hiz_copy_loc, 1);
+    glUniform2i(hiz_src_size_loc, width, height);
+    glUniform2i(hiz_dst_size_loc, width, height);
+    glBindTexture(GL_TEXTURE_2D, depth_texture);
+    glBindImageTexture(1, hiz_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glUniform1i(hiz_copy_loc, 0);
+
+    int w = width, h = height;
+    for (int level = 1; level < hiz_levels; level++) {
+        int next_w = w > 1 ? w / 2 : 1;
+        int next_h = h > 1 ? h / 2 : 1;
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        glUniform2i(hiz_src_size_loc, w, h);
+        glUniform2i(hiz_dst_size_loc, next_w, next_h);
+        glBindImageTexture(0, hiz_texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, hiz_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((next_w + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (next_h + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        w = next_w;
+        h = next_h;
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    hiz_valid = true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+
+#include <vector>
+
+#include "gl.hh"
+#include "math.hh"
+#include "cull.hh"
+#include "lod.hh"
+#include "meshlet.hh"
+#include "cluster.hh"
+
+// the uniforms both cull passes read, looked up once per program
+struct CullUniforms {
+    GLint planes;
+    GLint view_projection;
+    GLint instance_count;
+    GLint compact;
+    GLint command_capacity;
+    GLint cluster_count;
+    GLint continuous;
+    GLint resident_level;
+    GLint lod_count;
+    GLint lod_ranges;
+    GLint lod_errors;
+    GLint camera_pos;
+    GLint lod_pixel_scale;
+    GLint use_hiz;
+    GLint hiz_levels;
+    GLint hiz_size;
+};
+
+// layout mandated by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Culls the instances in a compute shader against the frustum and the depth
+// of the previous frame, and writes the surviving draws for
+// glMultiDrawElementsIndirect(Count). Every instance draws the same indexed
+// mesh with `base_instance` set to its index, so per-instance vertex
+// attributes with a divisor of 1 pick up its data. Each one draws the level
+// of detail of the mesh its distance calls for (see lod.hh), out of the same
+// index buffer. Where that is LOD 0 of a mesh with meshlets, a second pass
+// culls them one by one and draws each one that is left. A mesh with a
+// cluster DAG (see cluster.hh) has no LODs here, the second pass picks the
+// clusters every instance draws instead, and only the levels of the DAG the
+// cuts ask for are streamed into the index buffer, the coarsest first.
+struct GpuCuller {
+    // false if the context can't run it (needs 4.3), use the CPU path then
+    bool init();
+    // deletes the programs, buffers and textures, call with the context current
+    void destroy();
+
+    // only [begin, end) of the bounds changed since the last call, unless `count` did; the buffers are only
+    // reallocated then
+    void upload(const Aabb* bounds, size_t count, size_t begin, size_t end);
+
+    // the ranges of the mesh's index buffer to draw, finest first
+    void set_lods(const MeshLod* mesh_lods, uint32_t count);
+
+    // the meshlets of LOD 0, none to always draw it whole
+    void set_meshlets(const Meshlet* meshlets, size_t count);
+
+    // the DAG in place of the LODs and meshlets, needs `compact`; `indices` are all of the mesh's, they have to
+    // stay alive, and `index_buffer` has room for them but only gets the levels the cut needs
+    void set_clusters(const Cluster* clusters, size_t count, const uint32_t* indices, GLuint index_buffer);
+
+    // `instance_buffer` holds the model matrix of every instance, their scale counts for the LOD; with a DAG it
+    // first streams in the next level if an earlier cut asked for it
+    void cull(const Mat4& view_projection, const Frustum& frustum, Vec3 camera_pos, float pixel_scale,
+              GLuint instance_buffer);
+
+    // issues the draws written by the last `cull`, the mesh VAO must be bound
+    void draw(GLenum mode);
+
+    // builds the max depth pyramid used by the next `cull` from a depth texture
+    void build_hiz(GLuint depth_texture, int width, int height);
+
+    void resize_commands();
+    void upload_level(uint32_t level);
+    void stream_levels();
+    void set_uniforms(GLuint prog, const CullUniforms& uniforms, const Mat4& view_projection, const float* planes,
+                      Vec3 camera_pos, float pixel_scale);
+
+    GLuint cull_prog = 0;
+    GLuint cluster_prog = 0;
+    GLuint hiz_prog = 0;
+
+    CullUniforms cull_uniforms = {};
+    CullUniforms cluster_uniforms = {};
+    GLint hiz_copy_loc = -1;
+    GLint hiz_src_size_loc = -1;
+    GLint hiz_dst_size_loc = -1;
+
+    GLuint bounds_buffer = 0;
+    std::vector<float> bounds_staging;
+    GLuint command_buffer = 0;
+    GLuint count_buffer = 0;
+    GLuint cluster_buffer = 0;
+    GLuint cluster_queue_buffer = 0;
+    GLuint feedback_buffer = 0;
+    GLuint readback_buffer = 0;
+    GLsync feedback_fence = nullptr;
+
+    GLuint hiz_texture = 0;
+    int hiz_width = 0;
+    int hiz_height = 0;
+    int hiz_levels = 0;
+    bool hiz_valid = false;
+
+    size_t instance_count = 0;
+    size_t command_capacity = 0;
+
+    MeshLod lods[MESH_MAX_LODS] = {};
+    uint32_t lod_count = 0;
+
+    size_t cluster_count = 0;
+    size_t finest_cluster_count = 0;
+
+    // a DAG's levels, from `resident_level` up they are in `stream_index_buffer`
+    bool continuous = false;
+    uint32_t level_count = 0;
+    uint32_t level_first_index[CLUSTER_MAX_LEVELS] = {};
+    uint32_t level_end_index[CLUSTER_MAX_LEVELS] = {};
+    uint32_t resident_level = 0;
+    const uint32_t* stream_indices = nullptr;
+    GLuint stream_index_buffer = 0;
+
+    // without glMultiDrawElementsIndirectCount every instance keeps its command
+    // slot and the culled ones get an instance count of 0
+    bool compact = false;
+};
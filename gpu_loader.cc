@@ -0,0 +1,107 @@
+#include "common.hh"
+#include "gpu_loader.hh"
+
+static void upload_batch(GpuUploadBatch* batch) {
+    for (GpuUpload& upload : batch->uploads) {
+        if (upload.kind == GPU_UPLOAD_BUFFER) {
+            // NOTE: GL_COPY_WRITE_BUFFER isn't vertex array state like GL_ELEMENT_ARRAY_BUFFER, and a buffer can
+            // be bound to any target later
+            glGenBuffers(1, &upload.object);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, upload.object);
+            glBufferData(GL_COPY_WRITE_BUFFER, upload.size, upload.data, GL_STATIC_DRAW);
+        } else {
+            glGenTextures(1, &upload.object);
+            glBindTexture(GL_TEXTURE_2D, upload.object);
+            glTexImage2D(GL_TEXTURE_2D, 0, upload.internal_format, upload.width, upload.height, 0, upload.format,
+                         upload.type, upload.data);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool GpuLoader::start(GLFWwindow* main_window) {
+    // NOTE: the context hints are still the ones the main window was made with, the contexts match
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(1, 1, "loader", nullptr, main_window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (!window) return false;
+
+    running = true;
+    thread = std::thread([this] { run(); });
+    return true;
+}
+
+void GpuLoader::stop() {
+    if (!window) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    thread.join();
+
+    glfwDestroyWindow(window);
+    window = nullptr;
+}
+
+void GpuLoader::submit(GpuUploadBatch* batch) {
+    batch->state.store(GPU_BATCH_QUEUED, std::memory_order_relaxed);
+
+    if (!window) {
+        upload_batch(batch);
+        batch->state.store(GPU_BATCH_READY, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(batch);
+    }
+    wake.notify_one();
+}
+
+bool GpuLoader::ready(GpuUploadBatch* batch) {
+    int state = batch->state.load(std::memory_order_acquire);
+    if (state == GPU_BATCH_READY) return true;
+    if (state == GPU_BATCH_QUEUED) return false;
+
+    if (glClientWaitSync(batch->fence, 0, 0) == GL_TIMEOUT_EXPIRED) return false;
+
+    // NOTE: GL_WAIT_FAILED ends up here too, there is no better time to use the objects than now
+    glDeleteSync(batch->fence);
+    batch->fence = nullptr;
+    batch->state.store(GPU_BATCH_READY, std::memory_order_relaxed);
+    return true;
+}
+
+void GpuLoader::run() {
+    glfwMakeContextCurrent(window);
+
+    for (;;) {
+        GpuUploadBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !queue.empty() || !running; });
+            if (!running) break;
+
+            batch = queue.front();
+            queue.pop_front();
+        }
+
+        upload_batch(batch);
+
+        // NOTE: flushed, or the fence may never get to the GPU and the render thread waits for it forever
+        batch->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        batch->state.store(GPU_BATCH_FENCED, std::memory_order_release);
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
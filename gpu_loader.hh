@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gl.hh"
+
+// Uploads buffers and textures on a thread of its own, through a hidden
+// window whose context shares objects with the main one, so the frame that
+// finishes a big load doesn't stall on copying it. A batch is ready for the
+// render thread once the GPU passed a fence the loader put after it. Vertex
+// arrays aren't shared between contexts, the render thread sets those up
+// over the uploaded buffers afterwards.
+
+enum GpuUploadKind {
+    GPU_UPLOAD_BUFFER,
+    GPU_UPLOAD_TEXTURE,
+};
+
+struct GpuUpload {
+    GpuUploadKind kind;
+    // has to stay alive until the batch is ready; null makes a buffer of `size` to fill later
+    const void* data;
+
+    // buffers
+    size_t size = 0;
+
+    // 2D textures, as for glTexImage2D
+    int width = 0;
+    int height = 0;
+    GLenum internal_format = 0;
+    GLenum format = 0;
+    GLenum type = 0;
+
+    // the buffer or texture, set by the loader
+    GLuint object = 0;
+};
+
+enum GpuBatchState {
+    GPU_BATCH_QUEUED,
+    // uploaded, the GPU may not be through yet
+    GPU_BATCH_FENCED,
+    GPU_BATCH_READY,
+};
+
+// Uploads that become ready together, behind one fence.
+struct GpuUploadBatch {
+    std::vector<GpuUpload> uploads;
+
+    std::atomic<int> state{GPU_BATCH_QUEUED};
+    GLsync fence = nullptr;
+};
+
+struct GpuLoader {
+    // main thread, with the main window's context current. False if no
+    // shared context can be had; submit() then uploads right away instead.
+    bool start(GLFWwindow* main_window);
+    // main thread; batches not uploaded yet are dropped
+    void stop();
+
+    // render thread; the batch has to stay alive until it's ready
+    void submit(GpuUploadBatch* batch);
+
+    // render thread; true once the uploads are done on the GPU, never waits
+    bool ready(GpuUploadBatch* batch);
+
+    void run();
+
+    GLFWwindow* window = nullptr;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<GpuUploadBatch*> queue;
+    bool running = false;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "common.hh"
+
+// Content hashes for asset caches, not for anything security related. 32
+// bytes at a time in four independent multiply-xorshift lanes, a few GB/s on
+// one core. The result only depends on the bytes, so it can be stored in files.
+
+constexpr uint64_t HASH_SEED = 0x9E3779B97F4A7C15;
+
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCD;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53;
+    h ^= h >> 33;
+    return h;
+}
+
+// NOTE: little-endian only, the words are read as they are in memory
+static inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = HASH_SEED) {
+    const uint8_t* p = cast(const uint8_t*) data;
+    uint64_t h = seed ^ (size * 0x87C37B91114253D5);
+
+    // four independent lanes keep the multiplies from waiting on each other
+    uint64_t lanes[4] = {h, h + 1, h + 2, h + 3};
+    while (size >= 32) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t word;
+            memcpy(&word, p + i * 8, 8);
+            lanes[i] = (lanes[i] ^ word) * 0x9FB21C651E98DF25;
+            lanes[i] ^= lanes[i] >> 29;
+        }
+        p += 32;
+        size -= 32;
+    }
+    for (int i = 0; i < 4; i++) h = hash_mix(h ^ lanes[i]);
+
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = hash_mix(h ^ word);
+        p += 8;
+        size -= 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, size);
+    return hash_mix(h ^ tail ^ (cast(uint64_t) size << 56));
+}
@@ -0,0 +1,334 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common.hh"
+#include "io.hh"
+
+static struct {
+    std::mutex mutex;
+    std::condition_variable wake;
+    // not handed to the kernel or a pread thread yet
+    std::deque<IoRead*> pending;
+    std::vector<std::thread> threads;
+    bool running = false;
+    bool uring = false;
+
+    int ring_fd = -1;
+    // written by io_submit, polled through the ring so a thread asleep in io_uring_enter picks up new reads
+    int event_fd = -1;
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    // inside the rings, shared with the kernel
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+} io;
+
+// NOTE: the counter is held until `done` is queued, which holds it in turn, so it never touches zero in between
+static void finish(IoRead* read) {
+    JobCounter* counter = read->counter;
+
+    if (read->done) jobs_run(read->done, read, counter);
+    if (counter) counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+// the rest of a short or interrupted read goes to the front, it is older than anything pending
+static void requeue(IoRead* read) {
+    std::lock_guard<std::mutex> lock(io.mutex);
+    io.pending.push_front(read);
+}
+
+static bool setup_uring() {
+    io_uring_params params = {};
+    int fd = cast(int) syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+    if (fd < 0) return false;
+
+    // NOTE: IORING_OP_READ came in the same kernel as this flag, there is no simpler way to tell it's there
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return false;
+    }
+
+    io.event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (io.event_fd < 0) {
+        close(fd);
+        return false;
+    }
+
+    io.ring_fd = fd;
+    io.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // both rings are one mapping where the kernel allows it
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && io.cq_ring_size > io.sq_ring_size) io.sq_ring_size = io.cq_ring_size;
+
+    io.sq_ring = mmap(nullptr, io.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQ_RING);
+    io.cq_ring = single ? io.sq_ring
+                        : mmap(nullptr, io.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING);
+    io.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    io.sqes = cast(io_uring_sqe*) mmap(nullptr, io.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                       IORING_OFF_SQES);
+
+    if (io.sq_ring == MAP_FAILED || io.cq_ring == MAP_FAILED || io.sqes == MAP_FAILED) {
+        if (io.sq_ring != MAP_FAILED) munmap(io.sq_ring, io.sq_ring_size);
+        if (!single && io.cq_ring != MAP_FAILED) munmap(io.cq_ring, io.cq_ring_size);
+        if (io.sqes != MAP_FAILED) munmap(io.sqes, io.sqes_size);
+        close(fd);
+        close(io.event_fd);
+        io.ring_fd = -1;
+        io.event_fd = -1;
+        return false;
+    }
+
+    uint8_t* sq = cast(uint8_t*) io.sq_ring;
+    io.sq_tail = cast(unsigned*) (sq + params.sq_off.tail);
+    io.sq_mask = cast(unsigned*) (sq + params.sq_off.ring_mask);
+    io.sq_array = cast(unsigned*) (sq + params.sq_off.array);
+
+    uint8_t* cq = cast(uint8_t*) io.cq_ring;
+    io.cq_head = cast(unsigned*) (cq + params.cq_off.head);
+    io.cq_tail = cast(unsigned*) (cq + params.cq_off.tail);
+    io.cq_mask = cast(unsigned*) (cq + params.cq_off.ring_mask);
+    io.cqes = cast(io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void release_uring() {
+    if (io.ring_fd < 0) return;
+
+    munmap(io.sqes, io.sqes_size);
+    if (io.cq_ring != io.sq_ring) munmap(io.cq_ring, io.cq_ring_size);
+    munmap(io.sq_ring, io.sq_ring_size);
+    close(io.ring_fd);
+    close(io.event_fd);
+    io.ring_fd = -1;
+    io.event_fd = -1;
+}
+
+// the next submission queue entry, cleared; only the I/O thread writes the queue
+static io_uring_sqe* next_sqe() {
+    const unsigned index = *io.sq_tail & *io.sq_mask;
+
+    io_uring_sqe* sqe = &io.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    io.sq_array[index] = index;
+
+    return sqe;
+}
+
+static void commit_sqe() {
+    std::atomic_ref<unsigned>(*io.sq_tail).store(*io.sq_tail + 1, std::memory_order_release);
+}
+
+// the unread rest of `read` into the submission queue
+static void push_read(IoRead* read) {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = read->fd;
+    sqe->off = read->offset + read->result;
+    sqe->addr = cast(uint64_t) (read->dst + read->result);
+    sqe->len = read->size - cast(uint32_t) read->result;
+    sqe->user_data = cast(uint64_t) read;
+    commit_sqe();
+}
+
+// a one-shot poll on the eventfd, it completes with a user_data of 0 (no read has that) once io_submit wrote it
+static void push_wake_poll() {
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = io.event_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = 0;
+    commit_sqe();
+}
+
+static void uring_main() {
+    jobs_attach_thread();
+
+    // in the submission queue but not taken by the kernel yet, and taken but not complete; both count the wake
+    // poll too while it's armed
+    unsigned queued = 0;
+    unsigned in_flight = 0;
+    bool poll_armed = false;
+
+    for (;;) {
+        // NOTE: the eventfd is only reset once the poll completed, so a read queued any time after the pending ones
+        // were last taken makes this poll complete, and a thread asleep in the kernel comes back for it
+        if (!poll_armed) {
+            push_wake_poll();
+            queued++;
+            poll_armed = true;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(io.mutex);
+            // nothing but the poll, no read to wait on in the kernel
+            if (in_flight + queued == 1) {
+                io.wake.wait(lock, [] { return !io.pending.empty() || !io.running; });
+                if (io.pending.empty()) break;
+            }
+
+            while (!io.pending.empty() && queued + in_flight < IO_QUEUE_DEPTH) {
+                push_read(io.pending.front());
+                io.pending.pop_front();
+                queued++;
+            }
+        }
+
+        // submits the batch and sleeps until at least one read finished or io_submit queued more
+        long submitted = syscall(__NR_io_uring_enter, io.ring_fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(errno));
+            die("the I/O thread can't go on");
+        }
+
+        queued -= cast(unsigned) submitted;
+        in_flight += cast(unsigned) submitted;
+
+        unsigned head = *io.cq_head;
+        const unsigned tail = std::atomic_ref<unsigned>(*io.cq_tail).load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const io_uring_cqe* cqe = &io.cqes[head & *io.cq_mask];
+            IoRead* read = cast(IoRead*) cqe->user_data;
+            const int res = cqe->res;
+            in_flight--;
+
+            if (!read) {
+                uint64_t value;
+                discard ::read(io.event_fd, &value, sizeof(value));
+                poll_armed = false;
+            } else if (res == -EINTR || res == -EAGAIN) {
+                requeue(read);
+            } else if (res < 0) {
+                read->result = res;
+                finish(read);
+            } else {
+                read->result += res;
+                // short reads happen, 0 is the end of the file
+                if (res > 0 && read->result < read->size) {
+                    requeue(read);
+                } else {
+                    finish(read);
+                }
+            }
+        }
+        std::atomic_ref<unsigned>(*io.cq_head).store(head, std::memory_order_release);
+    }
+}
+
+static void pread_main() {
+    jobs_attach_thread();
+
+    for (;;) {
+        IoRead* read;
+        {
+            std::unique_lock<std::mutex> lock(io.mutex);
+            io.wake.wait(lock, [] { return !io.pending.empty() || !io.running; });
+            if (io.pending.empty()) break;
+
+            read = io.pending.front();
+            io.pending.pop_front();
+        }
+
+        while (read->result < read->size) {
+            ssize_t n = pread(read->fd, read->dst + read->result, read->size - read->result,
+                              read->offset + read->result);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                read->result = -errno;
+                break;
+            }
+            if (n == 0) break;
+
+            read->result += n;
+        }
+
+        finish(read);
+    }
+}
+
+void io_init(bool use_uring) {
+    if (io.running) die("I/O initialized twice");
+
+    io.running = true;
+    io.uring = use_uring && setup_uring();
+
+    if (io.uring) {
+        io.threads.emplace_back(uring_main);
+    } else {
+        for (unsigned i = 0; i < IO_FALLBACK_THREADS; i++) io.threads.emplace_back(pread_main);
+    }
+}
+
+void io_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(io.mutex);
+        io.running = false;
+    }
+    io.wake.notify_all();
+
+    for (auto& t : io.threads) t.join();
+    io.threads.clear();
+
+    release_uring();
+}
+
+bool io_uses_uring() {
+    return io.uring;
+}
+
+void io_submit(IoRead* reads, size_t count, JobCounter* counter) {
+    if (count == 0) return;
+
+    if (counter) counter->value.fetch_add(cast(int32_t) count, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(io.mutex);
+        for (size_t i = 0; i < count; i++) {
+            reads[i].result = 0;
+            reads[i].counter = counter;
+            io.pending.push_back(&reads[i]);
+        }
+    }
+
+    if (count == 1) {
+        io.wake.notify_one();
+    } else {
+        io.wake.notify_all();
+    }
+
+    // the I/O thread may be asleep in the kernel instead, waiting on reads in flight
+    if (io.uring) {
+        const uint64_t one = 1;
+        discard write(io.event_fd, &one, sizeof(one));
+    }
+}
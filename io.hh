@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "jobs.hh"
+
+// Asynchronous file reads. Batches go to the kernel through io_uring, with up
+// to IO_QUEUE_DEPTH reads in flight so an NVMe drive has enough to work on;
+// where io_uring isn't there (old kernels, containers that filter it out) a
+// few threads doing pread take over. Either way a finished read is handed to
+// the job system, its `done` runs as a job, so whatever comes next
+// (decompression, building GPU data) starts without anybody waiting on the disk.
+
+constexpr unsigned IO_QUEUE_DEPTH = 128;
+// pread threads without io_uring, each one is a read in flight
+constexpr unsigned IO_FALLBACK_THREADS = 4;
+
+struct IoRead {
+    int fd;
+    uint64_t offset;
+    uint32_t size;
+    uint8_t* dst;
+
+    // queued as `done(read, 0, 0)` once the read finished, may be null
+    JobFn done;
+    // for `done`, the read itself is what it gets
+    void* data;
+
+    // once done: the bytes read, fewer than `size` at the end of the file, or -errno
+    int64_t result;
+
+    // set by io_submit
+    JobCounter* counter;
+};
+
+// Starts the I/O thread(s), after jobs_init. Falls back to pread threads if
+// io_uring can't be set up or `use_uring` is false.
+void io_init(bool use_uring = true);
+// waits for the reads in flight, their `done` jobs may still be queued
+void io_shutdown();
+
+bool io_uses_uring();
+
+// Queues `count` reads, they finish in any order. `counter` (may be null) goes
+// up by one per read now and only comes down once the read and its `done`
+// job finished, so it reaches zero when all of that ran. The reads have to
+// stay alive until then. Callable from any thread, `done` jobs may queue more reads.
+void io_submit(IoRead* reads, size_t count, JobCounter* counter);
@@ -0,0 +1,285 @@
+#include <thread>
+#include <vector>
+
+#include "common.hh"
+#include "jobs.hh"
+
+// per queue, a thread may never have more jobs in flight than this
+constexpr uint32_t JOB_QUEUE_SIZE = 4096;
+// besides the one that called jobs_init: the simulation, the I/O threads, loaders
+constexpr unsigned MAX_ATTACHED_THREADS = 8;
+// spins before an idle worker goes to sleep
+constexpr int IDLE_SPINS = 64;
+
+static_assert((JOB_QUEUE_SIZE & (JOB_QUEUE_SIZE - 1)) == 0, "the queue size must be a power of two");
+
+struct Job {
+    JobFn fn;
+    void* data;
+    size_t begin, end;
+    // range jobs split themselves while they are bigger than this, 0 for plain jobs
+    size_t grain;
+    JobCounter* counter;
+    const JobCounter* dependency;
+};
+
+// Chase-Lev work-stealing deque (the C11 version from Lê et al. 2013). The
+// owner pushes and takes at the bottom, thieves steal from the top. Jobs are
+// stored in the ring itself, so a slot is only written again once the job in
+// it was taken or stolen.
+struct alignas(64) JobQueue {
+    bool push(const Job& job) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)JOB_QUEUE_SIZE) return false;
+
+        slots[b & (JOB_QUEUE_SIZE - 1)] = job;
+        bottom.store(b + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool take(Job* out) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *out = slots[b & (JOB_QUEUE_SIZE - 1)];
+        if (t == b) {
+            // the last one, race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    bool steal(Job* out) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return false;
+
+        // NOTE: copied before the CAS, once top moves past it the owner may push over the slot. The owner can't
+        // have done so yet if the CAS succeeds, if it fails the copy is thrown away
+        *out = slots[t & (JOB_QUEUE_SIZE - 1)];
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    Job slots[JOB_QUEUE_SIZE];
+};
+
+static struct {
+    std::vector<std::thread> threads;
+    JobQueue* queues = nullptr;
+    unsigned queue_count = 0;
+    unsigned worker_count = 0;
+    std::atomic<unsigned> attached{0};
+
+    std::atomic<bool> running{false};
+    // bumped on every push, sleeping workers wait for it to change
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<int> sleeping{0};
+} js;
+
+static thread_local int queue_index = -1;
+static thread_local uint32_t steal_seed = 0;
+
+static inline uint32_t next_random() {
+    // xorshift, only used to pick steal victims
+    steal_seed ^= steal_seed << 13;
+    steal_seed ^= steal_seed >> 17;
+    steal_seed ^= steal_seed << 5;
+    return steal_seed;
+}
+
+static void execute(Job job);
+
+static void submit(const Job& job) {
+    if (queue_index < 0) die("jobs pushed from a thread that is not attached to the job system");
+
+    // NOTE: a full queue means the thread has a huge backlog, doing the job inline is the best we can do
+    if (!js.queues[queue_index].push(job)) {
+        execute(job);
+        return;
+    }
+
+    // NOTE: seq_cst on both sides, otherwise a worker about to sleep and this
+    // push can miss each other and the job sits there until the next push
+    js.epoch.fetch_add(1, std::memory_order_seq_cst);
+    if (js.sleeping.load(std::memory_order_seq_cst) > 0) js.epoch.notify_one();
+}
+
+static bool find_job(Job* out) {
+    if (js.queues[queue_index].take(out)) return true;
+
+    unsigned start = next_random() % js.queue_count;
+    for (unsigned i = 0; i < js.queue_count; i++) {
+        unsigned victim = (start + i) % js.queue_count;
+        if ((int)victim == queue_index) continue;
+
+        if (js.queues[victim].steal(out)) return true;
+    }
+
+    return false;
+}
+
+static void execute(Job job) {
+    // run whatever else is around until the job is ready, re-queueing it
+    // instead could spin on it forever when its dependency is below it in the
+    // same queue
+    if (job.dependency) jobs_wait(job.dependency);
+
+    if (job.grain != 0) {
+        // lazy binary splitting, hand off the upper half for thieves and keep going with the lower one
+        while (job.end - job.begin > job.grain) {
+            size_t mid = job.begin + (job.end - job.begin) / 2;
+
+            Job half = job;
+            half.begin = mid;
+            half.dependency = nullptr;
+            if (half.counter) half.counter->value.fetch_add(1, std::memory_order_relaxed);
+            submit(half);
+
+            job.end = mid;
+        }
+    }
+
+    job.fn(job.data, job.begin, job.end);
+
+    if (job.counter) job.counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+static void worker_main(unsigned index) {
+    queue_index = index;
+    steal_seed = 0x9e3779b9u * (index + 1);
+
+    int idle = 0;
+    while (js.running.load(std::memory_order_acquire)) {
+        uint32_t epoch = js.epoch.load(std::memory_order_seq_cst);
+
+        Job job;
+        if (find_job(&job)) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        js.sleeping.fetch_add(1, std::memory_order_seq_cst);
+        js.epoch.wait(epoch, std::memory_order_seq_cst);
+        js.sleeping.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+void jobs_init(unsigned worker_count) {
+    if (js.running.load()) die("job system initialized twice");
+
+    if (worker_count == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        worker_count = cores > 1 ? cores - 1 : 1;
+    }
+
+    js.worker_count = worker_count;
+    js.queue_count = worker_count + 1 + MAX_ATTACHED_THREADS;
+    js.queues = new JobQueue[js.queue_count];
+    js.attached = 1;
+    js.running = true;
+
+    // queue 0 belongs to the calling thread, attached threads come right after it
+    queue_index = 0;
+    steal_seed = 0x9e3779b9u;
+
+    for (unsigned i = 0; i < worker_count; i++) {
+        js.threads.emplace_back(worker_main, 1 + MAX_ATTACHED_THREADS + i);
+    }
+}
+
+void jobs_shutdown() {
+    js.running = false;
+    js.epoch.fetch_add(1, std::memory_order_release);
+    js.epoch.notify_all();
+
+    for (auto& t : js.threads) t.join();
+    js.threads.clear();
+
+    delete[] js.queues;
+    js.queues = nullptr;
+    queue_index = -1;
+}
+
+unsigned jobs_worker_count() {
+    return js.worker_count;
+}
+
+int jobs_thread_index() {
+    return queue_index;
+}
+
+unsigned jobs_thread_count() {
+    return js.queue_count;
+}
+
+void jobs_attach_thread() {
+    if (queue_index >= 0) return;
+
+    unsigned index = js.attached.fetch_add(1);
+    if (index > MAX_ATTACHED_THREADS) die("too many threads attached to the job system");
+
+    queue_index = index;
+    steal_seed = 0x85ebca6bu * (index + 1);
+}
+
+void jobs_run(JobFn fn, void* data, JobCounter* counter, const JobCounter* dependency) {
+    if (counter) counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    submit(Job{fn, data, 0, 0, 0, counter, dependency});
+}
+
+void jobs_wait(const JobCounter* counter) {
+    while (!counter->done()) {
+        Job job;
+        if (find_job(&job)) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void parallel_for_impl(size_t count, size_t min_grain, JobFn fn, void* data, JobCounter* counter) {
+    if (count == 0) return;
+
+    // about 4 pieces per thread balances uneven work without drowning in jobs
+    size_t grain = count / ((js.worker_count + 1) * 4);
+    if (grain < min_grain) grain = min_grain;
+    if (grain < 1) grain = 1;
+
+    // not worth a job, or nobody to share it with
+    if (count <= grain || js.queues == nullptr) {
+        fn(data, 0, count);
+        return;
+    }
+
+    JobCounter local;
+    JobCounter* c = counter ? counter : &local;
+
+    c->value.fetch_add(1, std::memory_order_relaxed);
+    submit(Job{fn, data, 0, count, grain, c, nullptr});
+
+    if (!counter) jobs_wait(&local);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+
+// Counts the outstanding jobs of a batch, it's zero once all of them ran.
+struct JobCounter {
+    inline bool done() const {
+        return value.load(std::memory_order_acquire) == 0;
+    }
+
+    std::atomic<int32_t> value{0};
+};
+
+using JobFn = void (*)(void* data, size_t begin, size_t end);
+
+// Starts `worker_count` threads (0 means one per core besides the calling
+// thread). The calling thread becomes a worker too, it runs jobs while it
+// waits on a counter.
+void jobs_init(unsigned worker_count = 0);
+void jobs_shutdown();
+
+unsigned jobs_worker_count();
+
+// Every thread that can run jobs has a stable index below jobs_thread_count(),
+// for per-thread data that is written without locking. -1 on a thread that
+// isn't attached.
+int jobs_thread_index();
+unsigned jobs_thread_count();
+
+// Lets a thread other than the one that called jobs_init push and wait on
+// jobs. Every thread has to do it once before its first jobs_run.
+void jobs_attach_thread();
+
+// Queues `fn(data, 0, 0)`. `counter` (may be null) is incremented now and
+// decremented when the job finished. If `dependency` is given, the job does
+// not start before it reached zero.
+void jobs_run(JobFn fn, void* data, JobCounter* counter, const JobCounter* dependency = nullptr);
+
+// Runs other jobs until `counter` reaches zero.
+void jobs_wait(const JobCounter* counter);
+
+void parallel_for_impl(size_t count, size_t min_grain, JobFn fn, void* data, JobCounter* counter);
+
+// Calls `f(begin, end)` over disjoint subranges of [0, count). Ranges are
+// split in halves on demand, down to a grain derived from the worker count but
+// never below `min_grain`, so idle workers steal the biggest pieces first.
+// Without a counter it blocks until everything ran, with one `f` has to stay
+// alive until the counter reached zero.
+template <class F>
+void parallel_for(size_t count, size_t min_grain, const F& f, JobCounter* counter = nullptr) {
+    auto thunk = [](void* data, size_t begin, size_t end) {
+        (*(const F*)data)(begin, end);
+    };
+
+    parallel_for_impl(count, min_grain, thunk, (void*)&f, counter);
+}
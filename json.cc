@@ -0,0 +1,199 @@
+#include <cstdio>
+
+#include "common.hh"
+#include "json.hh"
+#include "parse.hh"
+
+// deeper documents are rejected instead of running out of stack
+constexpr int JSON_MAX_DEPTH = 64;
+
+struct JsonParser {
+    const char* text;
+    const char* at;
+    const char* end;
+    std::vector<JsonValue>* values;
+    const char* error = nullptr;
+
+    inline void skip_whitespace() {
+        while (at < end && (*at == ' ' || *at == '\t' || *at == '\r' || *at == '\n')) at++;
+    }
+
+    inline bool fail(const char* message) {
+        if (!error) error = message;
+        return false;
+    }
+
+    bool parse_string(std::string_view* out) {
+        // NOTE: the opening quote was checked by the caller
+        const char* start = ++at;
+
+        while (at < end && *at != '"') {
+            if (*at == '\\') at++;
+            at++;
+        }
+        if (at >= end) return fail("unterminated string");
+
+        *out = std::string_view(start, at - start);
+        at++;
+        return true;
+    }
+
+    bool parse_number(JsonValue& value) {
+        const char* start = at;
+
+        int64_t integer;
+        if (!parse_int(&at, end, &integer)) return fail("invalid number");
+
+        value.integer = integer;
+        value.number = cast(double) integer;
+
+        if (at < end && (*at == '.' || *at == 'e' || *at == 'E')) {
+            at = start;
+
+            float number;
+            if (!parse_float(&at, end, &number)) return fail("invalid number");
+
+            value.number = number;
+            value.integer = cast(int64_t) number;
+        }
+
+        return true;
+    }
+
+    bool parse_literal(const char* literal, size_t length) {
+        if (cast(size_t) (end - at) < length || std::string_view(at, length) != std::string_view(literal, length)) {
+            return fail("invalid literal");
+        }
+        at += length;
+        return true;
+    }
+
+    bool parse_value(std::string_view key, int depth) {
+        if (depth > JSON_MAX_DEPTH) return fail("nested too deep");
+
+        skip_whitespace();
+        if (at >= end) return fail("unexpected end of the text");
+
+        size_t index = values->size();
+        values->push_back(JsonValue{});
+        values->back().key = key;
+
+        // NOTE: `values` grows while parsing the children, no references across recursion
+        switch (*at) {
+            case '{':
+            case '[': {
+                bool object = *at == '{';
+                const char closing = object ? '}' : ']';
+                (*values)[index].type = object ? JSON_OBJECT : JSON_ARRAY;
+                at++;
+
+                uint32_t count = 0;
+                skip_whitespace();
+                if (at < end && *at == closing) {
+                    at++;
+                } else {
+                    for (;;) {
+                        std::string_view member;
+                        if (object) {
+                            skip_whitespace();
+                            if (at >= end || *at != '"') return fail("expected a member name");
+                            if (!parse_string(&member)) return false;
+
+                            skip_whitespace();
+                            if (at >= end || *at != ':') return fail("expected ':'");
+                            at++;
+                        }
+
+                        if (!parse_value(member, depth + 1)) return false;
+                        count++;
+
+                        skip_whitespace();
+                        if (at < end && *at == ',') {
+                            at++;
+                        } else if (at < end && *at == closing) {
+                            at++;
+                            break;
+                        } else {
+                            return fail(object ? "expected ',' or '}'" : "expected ',' or ']'");
+                        }
+                    }
+                }
+
+                (*values)[index].count = count;
+            } break;
+            case '"': {
+                std::string_view string;
+                if (!parse_string(&string)) return false;
+                (*values)[index].type = JSON_STRING;
+                (*values)[index].string = string;
+            } break;
+            case 't':
+                if (!parse_literal("true", 4)) return false;
+                (*values)[index].type = JSON_TRUE;
+                break;
+            case 'f':
+                if (!parse_literal("false", 5)) return false;
+                (*values)[index].type = JSON_FALSE;
+                break;
+            case 'n':
+                if (!parse_literal("null", 4)) return false;
+                (*values)[index].type = JSON_NULL;
+                break;
+            default: {
+                JsonValue number = {};
+                if (!parse_number(number)) return false;
+                (*values)[index].type = JSON_NUMBER;
+                (*values)[index].number = number.number;
+                (*values)[index].integer = number.integer;
+            } break;
+        }
+
+        (*values)[index].next = values->size();
+        return true;
+    }
+};
+
+bool Json::parse(const char* text, size_t size) {
+    values.clear();
+
+    JsonParser parser = {text, text, text + size, &values};
+    bool ok = parser.parse_value(std::string_view(), 0);
+
+    if (ok) {
+        parser.skip_whitespace();
+        if (parser.at != parser.end) ok = parser.fail("trailing characters after the document");
+    }
+
+    if (!ok) {
+        size_t line = 1;
+        for (const char* c = text; c < parser.at && c < parser.end; c++) line += *c == '\n';
+        fprintf(stderr, "JSON error on line %zu: %s\n", line, parser.error);
+        values.clear();
+    }
+
+    return ok;
+}
+
+const JsonValue* Json::get(const JsonValue* object, std::string_view key) const {
+    if (!object || object->type != JSON_OBJECT) return nullptr;
+
+    for (const JsonValue* member = first(object); member; member = next(object, member)) {
+        if (member->key == key) return member;
+    }
+    return nullptr;
+}
+
+int64_t Json::get_int(const JsonValue* object, std::string_view key, int64_t fallback) const {
+    const JsonValue* value = get(object, key);
+    return value && value->is_number() ? value->integer : fallback;
+}
+
+double Json::get_number(const JsonValue* object, std::string_view key, double fallback) const {
+    const JsonValue* value = get(object, key);
+    return value && value->is_number() ? value->number : fallback;
+}
+
+std::string_view Json::get_string(const JsonValue* object, std::string_view key) const {
+    const JsonValue* value = get(object, key);
+    return value && value->type == JSON_STRING ? value->string : std::string_view();
+}
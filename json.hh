@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string_view>
+#include <vector>
+
+enum JsonType : uint8_t {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+// One value of a parsed document. The values are stored flat in document
+// order, so the first child of an array or object directly follows it and
+// `next` skips over a whole subtree.
+struct JsonValue {
+    inline bool is_number() const {
+        return type == JSON_NUMBER;
+    }
+
+    JsonType type;
+    // elements of an array, members of an object
+    uint32_t count;
+    // index of the value after this one and all its children
+    uint32_t next;
+
+    // the member name when the value is in an object
+    std::string_view key;
+    // strings point into the text and are not unescaped, glTF doesn't need it
+    std::string_view string;
+    double number;
+    // `number` truncated, exact for integers up to 2^63
+    int64_t integer;
+};
+
+// A DOM parser for the JSON in asset files; strings point into the text,
+// which has to outlive the document.
+struct Json {
+    // false (with the reason on stderr) if the text isn't valid JSON
+    bool parse(const char* text, size_t size);
+
+    inline const JsonValue* root() const {
+        return values.empty() ? nullptr : &values[0];
+    }
+
+    // the member `key` of `object`, null if it isn't there or `object` isn't an object
+    const JsonValue* get(const JsonValue* object, std::string_view key) const;
+
+    // the children of an array or object in order, null after the last one
+    inline const JsonValue* first(const JsonValue* parent) const {
+        return parent && parent->count ? parent + 1 : nullptr;
+    }
+
+    inline const JsonValue* next(const JsonValue* parent, const JsonValue* child) const {
+        return child->next < parent->next ? &values[child->next] : nullptr;
+    }
+
+    // shorthands for optional members, `fallback` if missing or of another type
+    int64_t get_int(const JsonValue* object, std::string_view key, int64_t fallback) const;
+    double get_number(const JsonValue* object, std::string_view key, double fallback) const;
+    std::string_view get_string(const JsonValue* object, std::string_view key) const;
+
+    std::vector<JsonValue> values;
+};
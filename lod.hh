@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "math.hh"
+
+// Levels of detail of a mesh share its vertices, each one is a range of the
+// index buffer, finest first. The cooker measures how far each one strays
+// from the full mesh, and the renderer picks per object the coarsest one whose
+// error projects to less than LOD_PIXEL_ERROR pixels.
+
+constexpr uint32_t MESH_MAX_LODS = 8;
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+struct MeshLod {
+    uint32_t first_index;
+    uint32_t index_count;
+    // the most the surface moved from the full mesh, in the mesh's units
+    float error;
+};
+
+// the pixels an error of 1 covers at a distance of 1; the y scale of the
+// projection is the cotangent of half the vertical field of view
+constexpr float lod_pixel_scale(const Mat4& projection, int viewport_height) {
+    return projection.elems[5] * viewport_height * 0.5f;
+}
+
+// how much bigger `world` makes the mesh, at most
+inline float max_scale(const Mat4& world) {
+    float largest = 0;
+    for (int col = 0; col < 3; col++) {
+        const float* c = world.elems + col * 4;
+        float length_squared = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+        if (length_squared > largest) largest = length_squared;
+    }
+    return sqrtf(largest);
+}
+
+// `distance` is to the nearest point of the object's bounds, not its center
+inline uint32_t select_lod(const MeshLod* lods, uint32_t count, float pixel_scale, float scale, float distance) {
+    if (distance < 1e-3f) distance = 1e-3f;
+
+    const float max_error = LOD_PIXEL_ERROR * distance / (pixel_scale * scale);
+
+    uint32_t lod = 0;
+    while (lod + 1 < count && lods[lod + 1].error <= max_error) lod++;
+    return lod;
+}
@@ -0,0 +1,179 @@
+#include <cstring>
+
+#include <vector>
+
+#include "common.hh"
+#include "lz.hh"
+
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr size_t LZ_MAX_OFFSET = 65535;
+
+// NOTE: format rules, the last 5 bytes are always literals and the last
+// match starts at least 12 bytes before the end
+constexpr size_t LZ_LAST_LITERALS = 5;
+constexpr size_t LZ_MATCH_LIMIT = 12;
+
+constexpr int LZ_HASH_BITS = 14;
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// a length of 15 or more goes on in extra bytes of 255 until one is smaller
+static inline uint8_t* write_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = cast(uint8_t) length;
+    return op;
+}
+
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity) {
+    // NOTE: positions + 1, so 0 means empty; the table is per call, blocks compress on several threads
+    thread_local std::vector<uint32_t> table;
+    table.assign(1 << LZ_HASH_BITS, 0);
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + size;
+    const uint8_t* match_limit = size > LZ_MATCH_LIMIT ? end - LZ_MATCH_LIMIT : src;
+    const uint8_t* match_end = size > LZ_LAST_LITERALS ? end - LZ_LAST_LITERALS : src;
+
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + capacity;
+
+    while (ip < match_limit) {
+        uint32_t sequence = read32(ip);
+        uint32_t h = lz_hash(sequence);
+        uint32_t candidate = table[h];
+        table[h] = cast(uint32_t) (ip - src) + 1;
+
+        const uint8_t* ref = candidate ? src + candidate - 1 : nullptr;
+        if (!ref || cast(size_t) (ip - ref) > LZ_MAX_OFFSET || read32(ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        // the match goes on as far as it can, and starts earlier if the bytes before agree too
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+
+        const uint8_t* mp = ip + LZ_MIN_MATCH;
+        const uint8_t* mr = ref + LZ_MIN_MATCH;
+        while (mp < match_end && *mp == *mr) {
+            mp++;
+            mr++;
+        }
+
+        const size_t literals = ip - anchor;
+        const size_t match = mp - ip - LZ_MIN_MATCH;
+
+        // token, lengths, literals and the offset
+        if (op + 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1 > op_end) return 0;
+
+        uint8_t* token = op++;
+        *token = cast(uint8_t) ((literals < 15 ? literals : 15) << 4 | (match < 15 ? match : 15));
+        if (literals >= 15) op = write_length(op, literals - 15);
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        const uint16_t offset = cast(uint16_t) (ip - ref);
+        memcpy(op, &offset, 2);
+        op += 2;
+
+        if (match >= 15) op = write_length(op, match - 15);
+
+        ip = mp;
+        anchor = ip;
+
+        // NOTE: the position just before the next search gets into the table too, it is often where the next match starts
+        if (ip < match_limit) table[lz_hash(read32(ip - 2))] = cast(uint32_t) (ip - 2 - src) + 1;
+    }
+
+    // the rest are literals
+    const size_t literals = end - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > op_end) return 0;
+
+    *op++ = cast(uint8_t) ((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) op = write_length(op, literals - 15);
+    if (literals) memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - dst;
+}
+
+bool lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + size;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_size;
+
+    for (;;) {
+        if (ip >= ip_end) return false;
+        const uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return false;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+
+        if (literals > cast(size_t) (ip_end - ip) || literals > cast(size_t) (op_end - op)) return false;
+        if (literals <= 16 && ip_end - ip >= 16 && op_end - op >= 16) {
+            // NOTE: most runs are short, a fixed-size copy past their end is faster than an exact one
+            memcpy(op, ip, 16);
+        } else if (literals) {
+            memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+
+        // NOTE: the last sequence has no match, it ends exactly at the end of the input
+        if (ip == ip_end) return op == op_end;
+
+        if (ip_end - ip < 2) return false;
+        uint16_t offset;
+        memcpy(&offset, ip, 2);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) return false;
+
+        size_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return false;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+
+        if (match > cast(size_t) (op_end - op)) return false;
+
+        const uint8_t* ref = op - offset;
+        if (offset >= 8 && cast(size_t) (op_end - op) >= match + 8) {
+            // 8 bytes at a time, possibly a few past the match; every chunk reads what's already written
+            for (size_t i = 0; i < match; i += 8) memcpy(op + i, ref + i, 8);
+            op += match;
+        } else if (offset >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            // NOTE: overlapping, the match repeats what it just wrote
+            for (size_t i = 0; i < match; i++) *op++ = ref[i];
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A fast LZ77 codec in the LZ4 block format: byte-aligned sequences of
+// literals and (offset, length) matches, no entropy coding. Compression is a
+// greedy single-probe hash search, decompression is little more than
+// fixed-size copies and runs at about 1 GB/s per core. Blocks are
+// independent, big data is split into blocks by the caller so they can be
+// decoded in parallel. Compatible with LZ4 blocks.
+
+// the most `lz_compress` can write for `size` bytes of input
+inline size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+// returns the compressed size, 0 if it didn't fit into `capacity`
+size_t lz_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+// `dst_size` has to be the exact decompressed size; false if the input is
+// damaged, nothing is ever read or written out of bounds
+bool lz_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size);
@@ -3,30 +3,44 @@
 #include <cstdlib>
 #include <cmath>
 
-#include <source_location>
+#include <string>
+#include <vector>
 
 #include <GLFW/glfw3.h>
 
-#define cast(t) (t)
-#define discard (void)
-
-[[noreturn]]
-void die(const char* msg, std::source_location loc = std::source_location::current()) {
-    fprintf(stderr, "%s:%d:%d: FATAL ERROR: %s\n", loc.file_name(), loc.line(), loc.column(), msg);
-    exit(1);
-}
-
-constexpr int WIN_WIDTH = 800;
-constexpr int WIN_HEIGHT = 600;
+#include "common.hh"
+#include "gl.hh"
+#include "math.hh"
+#include "cull.hh"
+#include "gpu_cull.hh"
+#include "jobs.hh"
+#include "sim.hh"
+#include "render_queue.hh"
+#include "arena.hh"
+#include "alloc_debug.hh"
+#include "resources.hh"
+#include "shapes.hh"
+#include "obj.hh"
+#include "gltf.hh"
+#include "mesh_cache.hh"
+#include "lod.hh"
+#include "meshlet.hh"
+#include "cluster.hh"
+#include "pack.hh"
+#include "io.hh"
+#include "gpu_loader.hh"
 
 static const char* vert_src = R"src(#version 330
 layout(location = 0) in vec4 pos;
 layout(location = 1) in vec3 in_color;
 
-uniform float time;
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    float time;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 out vec3 color;
 
@@ -36,6 +50,27 @@ void main() {
 }
 )src";
 
+// same as `vert_src`, but the model transform comes from a per-instance
+// attribute so the GPU culler can draw everything with indirect draws
+static const char* instanced_vert_src = R"src(#version 330
+layout(location = 0) in vec4 pos;
+layout(location = 1) in vec3 in_color;
+layout(location = 2) in mat4 instance_model;
+
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    float time;
+};
+
+out vec3 color;
+
+void main() {
+    gl_Position = projection * view * instance_model * pos;
+    color = in_color;
+}
+)src";
+
 static const char* frag_src = R"src(#version 330
 in vec3 color;
 
@@ -49,283 +84,25 @@ void main()
 }
 )src";
 
-#define ENUM_GL_PROCS \
-    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
-    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
-    X(PFNGLBUFFERDATAPROC, glBufferData) \
-    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
-    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
-    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
-    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
-    X(PFNGLCREATESHADERPROC, glCreateShader) \
-    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
-    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
-    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
-    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
-    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
-    X(PFNGLATTACHSHADERPROC, glAttachShader) \
-    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
-    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
-    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
-    X(PFNGLDETACHSHADERPROC, glDetachShader) \
-    X(PFNGLDELETESHADERPROC, glDeleteShader) \
-    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
-    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
-    X(PFNGLUNIFORM1FPROC, glUniform1f) \
-    X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv)
-
-#define X(t, name) static t name;
-ENUM_GL_PROCS
-#undef X
-
-void load_gl_procs() {
-#define X(t, name) name = cast(t) glfwGetProcAddress(#name);
-ENUM_GL_PROCS
-#undef X
-}
-
-GLuint create_shader(GLenum type, const char* src) {
-    auto shader = glCreateShader(type);
-    glShaderSource(shader, 1, &src, nullptr);
-
-    glCompileShader(shader);
-
-    GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-
-    if (status == GL_FALSE) {
-        char info_log[256];
-        glGetShaderInfoLog(shader, sizeof(info_log), nullptr, info_log);
-
-        fprintf(stderr, "Could not compile the shader: %s\n", info_log);
-        exit(1);
-    }
-
-    return shader;
-}
-
-GLuint create_program(GLuint vert, GLuint frag) {
-    auto prog = glCreateProgram();
-
-    glAttachShader(prog, vert);
-    glAttachShader(prog, frag);
-
-    glLinkProgram(prog);
-
-    GLint status;
-    glGetProgramiv(prog, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-        char info_log[256];
-        glGetProgramInfoLog(prog, sizeof(info_log), nullptr, info_log);
-
-        fprintf(stderr, "Could not link the program: %s\n", info_log);
-        exit(1);
-    }
-
-    glDetachShader(prog, vert);
-    glDetachShader(prog, frag);
-
-    return prog;
-}
-
-const float aspect_ratio = (float)WIN_WIDTH / (float)WIN_HEIGHT;
-
-static inline float deg_to_rad(float angle) {
-    return angle * M_PI * 2.0f / 360.0f;
-}
-
-struct Vec3 {
-    inline Vec3 copy() const {
-        return Vec3{x, y, z};
-    }
-
-    inline void norm() {
-        float len = length();
-        x /= len;
-        y /= len;
-        z /= len;
-    }
-
-    inline void cross(Vec3 other) {
-        float xx = x;
-        float yy = y;
-
-        x = yy * other.z - z  * other.y;
-        y = z  * other.x - xx * other.z;
-        z = xx * other.y - yy * other.x;
-    }
-
-    inline float length() const {
-        return sqrtf(x * x + y * y + z * z);
-    }
-
-    inline void neg() {
-        x = -x;
-        y = -y;
-        z = -z;
-    }
+// every object in the scene, baked at compile time; the corners of the base
+// touch the unit box the culling uses for bounds
+static constexpr auto scene_shape = make_pyramid<4>(0.70710678f, 1.0f);
 
-    inline float sum() const {
-        return x + y + z;
-    }
-
-    inline Vec3 operator -(const Vec3& other) {
-        return Vec3{x - other.x, y - other.y, z - other.z};
-    }
-
-    inline Vec3 operator *(const Vec3& other) {
-        return Vec3{x * other.x, y * other.y, z * other.z};
-    }
+// a glTF scene given on the command line is drawn once, above the first row of objects
+constexpr Vec3 GLTF_SCENE_CENTER = {0.0f, 1.5f, -5.0f};
 
-    inline Vec3 operator *(float scalar) {
-        return Vec3{x * scalar, y * scalar, z * scalar};
-    }
-
-    inline Vec3 operator +(const Vec3& other) {
-        return Vec3{x + other.x, y + other.y, z + other.z};
-    }
+// the occluders are rasterized on the CPU every frame, bigger meshes cost more than they save
+constexpr size_t MAX_OCCLUDER_INDICES = 3 * 1024;
 
-    inline Vec3& operator +=(const Vec3& other) {
-        x += other.x;
-        y += other.y;
-        z += other.z;
-
-        return *this;
-    }
-
-    inline Vec3& operator -=(const Vec3& other) {
-        x -= other.x;
-        y -= other.y;
-        z -= other.z;
-
-        return *this;
-    }
-
-    float x, y, z;
+// the std140 layout of the `Camera` block, shared by all the programs
+struct CameraBlock {
+    Mat4 view;
+    Mat4 projection;
+    float time;
+    float pad[3];
 };
 
-inline Vec3 operator *(float scalar, Vec3 vec) {
-    return Vec3{vec.x * scalar, vec.y * scalar, vec.z * scalar};
-}
-
-struct Mat4 {
-    Mat4() : elems{1, 0, 0, 0,
-                   0, 1, 0, 0,
-                   0, 0, 1, 0,
-                   0, 0, 0, 1}
-    {}
-
-    Mat4(float m11, float m12, float m13, float m14,
-         float m21, float m22, float m23, float m24,
-         float m31, float m32, float m33, float m34,
-         float m41, float m42, float m43, float m44
-         ) : elems{m11, m21, m31, m41,
-                   m12, m22, m32, m42,
-                   m13, m23, m33, m43,
-                   m14, m24, m34, m44}
-    {}
-
-    static Mat4 look_at(Vec3 camera_pos, Vec3 camera_target, Vec3 up) {
-        // NOTE: the order is reversed, and the vector points towards the camera
-        Vec3 camera_dir = (camera_pos - camera_target);
-        camera_dir.norm();
-
-        Vec3 camera_right = up;
-        camera_right.cross(camera_dir);
-        camera_right.norm();
-
-        Vec3 camera_up = camera_dir;
-        camera_up.cross(camera_right);
-
-        camera_pos.neg();
-
-        Vec3 right_perm = camera_pos * camera_right;
-        Vec3 up_perm = camera_pos * camera_up;
-        Vec3 dir_perm = camera_pos * camera_dir;
-
-        float right_perm_sum = right_perm.sum();
-        float up_perm_sum = up_perm.sum();
-        float dir_perm_sum = dir_perm.sum();
-
-        return Mat4{camera_right.x, camera_right.y, camera_right.z, right_perm_sum,
-                    camera_up.x,    camera_up.y,    camera_up.z,    up_perm_sum,
-                    camera_dir.x,   camera_dir.y,   camera_dir.z,   dir_perm_sum,
-                    0,              0,              0,              1};
-    }
-
-    static Mat4 projection(float fov_x, float z_near, float z_far) {
-        Mat4 mat{};
-
-        const float fov_x_rad = deg_to_rad(fov_x);
-        const float angle = fov_x_rad / 2;
-        float tangent = tanf(angle);
-
-        float right = z_near * tangent;
-        float top = right / aspect_ratio;
-
-        mat.elems[0] = z_near / right;
-        mat.elems[5] = z_near / top;
-        // mat.elems[0] = 1 / tangent;
-        // mat.elems[5] = 1 / tangent;
-        mat.elems[10] = (z_far + z_near) / (z_near - z_far);
-        mat.elems[11] = -1;
-        mat.elems[14] = (2 * z_far * z_near) / (z_near - z_far);
-
-        return mat;
-    }
-
-    Mat4& translate(float x, float y = 0.0f, float z = 0.0f) {
-        elems[12] += x;
-        elems[13] += y;
-        elems[14] += z;
-
-        return *this;
-    }
-
-    Mat4& rotate_x(float angle) {
-        angle = deg_to_rad(angle);
-
-        float c = cosf(angle);
-        elems[5] *= c;
-        elems[10] *= c;
-
-        float s = sinf(angle);
-        elems[6] = s;
-        elems[9] = -s;
-
-        return *this;
-    }
-
-    Mat4& rotate_y(float angle) {
-        angle = deg_to_rad(angle);
-
-        float c = cosf(angle);
-        elems[0] *= c;
-        elems[10] *= c;
-
-        float s = sinf(angle);
-        elems[2] = -s;
-        elems[8] = s;
-
-        return *this;
-    }
-
-    Mat4& rotate_z(float angle) {
-        angle = deg_to_rad(angle);
-
-        float c = cosf(angle);
-        elems[0] *= c;
-        elems[5] *= c;
-
-        float s = sinf(angle);
-        elems[1] = s;
-        elems[4] = -s;
-
-        return *this;
-    }
-
-    float elems[16];
-};
+constexpr GLuint CAMERA_BLOCK_BINDING = 0;
 
 extern "C" void window_size_callback(GLFWwindow* win, int width, int height) {
     discard win;
@@ -333,94 +110,85 @@ extern "C" void window_size_callback(GLFWwindow* win, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-Vec3 camera_pos = {0.f, 0.f, 3.f};
-Vec3 camera_front = {0.f, 0.f, -1.f};
-Vec3 camera_up = {0.f, 1.f, 0.f};
-
-float camera_yaw = -90.f;
-float camera_pitch = 0.f;
+// only touched on the main thread, the simulation gets a copy every frame
+InputState input;
 
-constexpr float CAMERA_PITCH_MAX =  89.0f;
-constexpr float CAMERA_PITCH_MIN = -89.0f;
-
-float delta_time = 0.f;
-
-float last_x = WIN_WIDTH  / 2.f;
-float last_y = WIN_HEIGHT / 2.f;
+double last_x = WIN_WIDTH / 2.0;
+double last_y = WIN_HEIGHT / 2.0;
 
 extern "C" void mouse_callback(GLFWwindow* window, double x, double y) {
     discard window;
 
-    float x_off = x - last_x;
-    float y_off = last_y - y;
+    // NOTE: just summed up, the camera turns once per frame however many events came in
+    input.mouse_dx += x - last_x;
+    input.mouse_dy += y - last_y;
 
     last_x = x;
     last_y = y;
+}
 
-    const float camera_sensitivity = 0.1f;
-
-    x_off *= camera_sensitivity;
-    y_off *= camera_sensitivity;
-
-    camera_yaw   += x_off;
-    camera_pitch += y_off;
-
-    if      (camera_pitch > CAMERA_PITCH_MAX) camera_pitch = CAMERA_PITCH_MAX;
-    else if (camera_pitch < CAMERA_PITCH_MIN) camera_pitch = CAMERA_PITCH_MIN;
-
-    float camera_pitch_rad = deg_to_rad(camera_pitch);
-    float camera_yaw_rad   = deg_to_rad(camera_yaw);
-
-    float camera_pitch_cos = cosf(camera_pitch_rad);
-    float camera_pitch_sin = sinf(camera_pitch_rad);
-    float camera_yaw_cos   = cosf(camera_yaw_rad);
-    float camera_yaw_sin   = sinf(camera_yaw_rad);
+static bool ends_with(const char* s, const char* suffix) {
+    size_t length = strlen(s);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(s + length - suffix_length, suffix) == 0;
+}
 
-    Vec3 camera_direction = {
-        camera_yaw_cos * camera_pitch_cos,
-        camera_pitch_sin,
-        camera_yaw_sin * camera_pitch_cos,
-    };
+// the primitives of `model` that are in view, with the sort keys of `program`
+static void push_gltf(RenderQueue& queue, const GltfModel& model, const GpuResources& resources,
+                      ProgramHandle program_handle, const FrameSnapshot& frame, float z_far) {
+    const Program* program = resources.get(program_handle);
+
+    for (const GltfInstance& instance : model.instances) {
+        if (!frame.frustum.test_aabb(instance.bounds.center(), instance.bounds.extents())) continue;
+
+        const GltfPrimitive& primitive = model.primitives[instance.primitive];
+        const Mesh* mesh = resources.get(primitive.mesh);
+        float depth = (instance.bounds.center() - frame.camera_pos).length() / z_far;
+
+        DrawPacket packet;
+        packet.key = make_sort_key(RENDER_PASS_SCENE, false, depth, program_handle.index(), primitive.material + 1,
+                                   primitive.mesh.index());
+        packet.model = &instance.world;
+        packet.program = program->program;
+        packet.vao = mesh->vao;
+        packet.model_loc = program->model_loc;
+        packet.first = mesh->index_type ? mesh->first_index : 0;
+        packet.count = mesh->index_type ? mesh->index_count : mesh->vertex_count;
+        packet.index_type = mesh->index_type;
+
+        queue.push(packet);
+    }
+}
 
-    camera_front = camera_direction;
-    camera_front.norm();
+// the model matrix per instance, from the bound GL_ARRAY_BUFFER into the bound VAO
+static void set_instance_attributes() {
+    // a mat4 attribute takes up four consecutive locations, one per column
+    for (int col = 0; col < 4; col++) {
+        glEnableVertexAttribArray(2 + col);
+        glVertexAttribPointer(2 + col, 4, GL_FLOAT, GL_FALSE, sizeof(Mat4), cast(void*) (col * 4 * sizeof(float)));
+        glVertexAttribDivisor(2 + col, 1);
+    }
 }
 
 void process_input(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE)) glfwSetWindowShouldClose(window, true);
 
-    const float camera_speed = 5.f * delta_time;
-
-    if (glfwGetKey(window, GLFW_KEY_W)) {
-        camera_pos += camera_front * camera_speed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_S)) {
-        camera_pos -= camera_front * camera_speed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_A)) {
-        Vec3 right = camera_front;
-        right.cross(camera_up);
-        right.norm();
-
-        camera_pos -= right * camera_speed;
-    }
-    if (glfwGetKey(window, GLFW_KEY_D)) {
-        Vec3 right = camera_front;
-        right.cross(camera_up);
-        right.norm();
-
-        camera_pos += right * camera_speed;
-    }
+    input.forward = glfwGetKey(window, GLFW_KEY_W);
+    input.back = glfwGetKey(window, GLFW_KEY_S);
+    input.left = glfwGetKey(window, GLFW_KEY_A);
+    input.right = glfwGetKey(window, GLFW_KEY_D);
+    input.pick = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    input.spin = glfwGetKey(window, GLFW_KEY_R);
 }
 
-
-int main() {
+int main(int argc, char** argv) {
     if (!glfwInit()) {
         die("could not initialize GLFW");
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // 4.5 for the GPU culling, everything else works on 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // GLFWmonitor* monitor = glfwGetPrimaryMonitor();
@@ -428,6 +196,13 @@ int main() {
 
     auto* window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "HELLO", monitor, nullptr);
 
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+
+        window = glfwCreateWindow(WIN_WIDTH, WIN_HEIGHT, "HELLO", monitor, nullptr);
+    }
+
     if (!window) {
         die("could not create glfw window");
     }
@@ -442,6 +217,9 @@ int main() {
 
     load_gl_procs();
 
+    jobs_init();
+    io_init();
+
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
     glDepthFunc(GL_LEQUAL);
@@ -453,210 +231,415 @@ int main() {
     // glCullFace(GL_BACK);
     // glFrontFace(GL_CW);
 
-    float piramid_vertices[] = {
-        // front face
-        -0.5, -0.5, 0.5,
-        0, 0.5, 0,
-        0.5, -0.5, 0.5,
-
-        // left face
-        -0.5, -0.5, 0.5,
-        0, 0.5, 0,
-        0, -0.5, -0.5,
-
-        // right face
-        0.5, -0.5, 0.5,
-        0, 0.5, 0,
-        0, -0.5, -0.5,
-
-        // colors
-        1, 0, 0,
-        1, 0, 0,
-        1, 0, 0,
-
-        0, 1, 0,
-        0, 1, 0,
-        0, 1, 0,
-
-        0, 0, 1,
-        0, 0, 1,
-        0, 0, 1,
-    };
-
-    float prism_vertices[] = {
-        0.25f,  0.25f, -1.25f,
-	0.25f, -0.25f, -1.25f,
-	-0.25f,  0.25f, -1.25f,
-
-	0.25f, -0.25f, -1.25f,
-	-0.25f, -0.25f, -1.25f,
-	-0.25f,  0.25f, -1.25f,
-
-	0.25f,  0.25f, -2.75f,
-	-0.25f,  0.25f, -2.75f,
-	0.25f, -0.25f, -2.75f,
-
-	0.25f, -0.25f, -2.75f,
-	-0.25f,  0.25f, -2.75f,
-	-0.25f, -0.25f, -2.75f,
-
-	-0.25f,  0.25f, -1.25f,
-	-0.25f, -0.25f, -1.25f,
-	-0.25f, -0.25f, -2.75f,
-
-	-0.25f,  0.25f, -1.25f,
-	-0.25f, -0.25f, -2.75f,
-	-0.25f,  0.25f, -2.75f,
-
-	0.25f,  0.25f, -1.25f,
-	0.25f, -0.25f, -2.75f,
-	0.25f, -0.25f, -1.25f,
-
-	0.25f,  0.25f, -1.25f,
-	0.25f,  0.25f, -2.75f,
-	0.25f, -0.25f, -2.75f,
-
-	0.25f,  0.25f, -2.75f,
-	0.25f,  0.25f, -1.25f,
-	-0.25f,  0.25f, -1.25f,
-
-	0.25f,  0.25f, -2.75f,
-	-0.25f,  0.25f, -1.25f,
-	-0.25f,  0.25f, -2.75f,
-
-	0.25f, -0.25f, -2.75f,
-	-0.25f, -0.25f, -1.25f,
-	0.25f, -0.25f, -1.25f,
-
-	0.25f, -0.25f, -2.75f,
-	-0.25f, -0.25f, -2.75f,
-	-0.25f, -0.25f, -1.25f,
-
-
-	0.0f, 0.0f, 1.0f,
-	0.0f, 0.0f, 1.0f,
-	0.0f, 0.0f, 1.0f,
-
-	0.0f, 0.0f, 1.0f,
-	0.0f, 0.0f, 1.0f,
-	0.0f, 0.0f, 1.0f,
-
-	0.8f, 0.8f, 0.8f,
-	0.8f, 0.8f, 0.8f,
-	0.8f, 0.8f, 0.8f,
-
-	0.8f, 0.8f, 0.8f,
-	0.8f, 0.8f, 0.8f,
-	0.8f, 0.8f, 0.8f,
-
-	0.0f, 1.0f, 0.0f,
-	0.0f, 1.0f, 0.0f,
-	0.0f, 1.0f, 0.0f,
-
-	0.0f, 1.0f, 0.0f,
-	0.0f, 1.0f, 0.0f,
-	0.0f, 1.0f, 0.0f,
-
-	0.5f, 0.5f, 0.0f,
-	0.5f, 0.5f, 0.0f,
-	0.5f, 0.5f, 0.0f,
-
-	0.5f, 0.5f, 0.0f,
-	0.5f, 0.5f, 0.0f,
-	0.5f, 0.5f, 0.0f,
+    constexpr float fov_x = 45.0;
+    constexpr float z_far = 10.0;
+    constexpr float z_near = 2.0;
+
+    constexpr Mat4 projection = Mat4::projection(fov_x, z_near, z_far);
+
+    // with compute shaders the culling moves to the GPU entirely
+    GpuCuller gpu_culler;
+    bool gpu_culling = gpu_culler.init();
+    // a cooked mesh's cluster DAG needs the GPU to pick and count the draws, its indices stream in as they're needed
+    const bool gpu_clusters = gpu_culling && gpu_culler.compact;
+
+    // an OBJ given on the command line replaces the pyramid, scaled to the same size;
+    // a glTF scene is drawn next to the objects instead
+    const float* scene_positions = scene_shape.positions;
+    const float* scene_colors = scene_shape.colors;
+    // instead of `scene_colors` for cooked meshes
+    const uint8_t* scene_colors_rgba8 = nullptr;
+    const uint32_t* scene_indices = scene_shape.indices;
+    size_t scene_vertex_count = scene_shape.VERTEX_COUNT;
+    size_t scene_index_count = scene_shape.INDEX_COUNT;
+    // the levels of detail of a cooked mesh follow its own indices, everything else only has the one
+    MeshLod scene_lods[MESH_MAX_LODS] = {{0, cast(uint32_t) scene_index_count, 0.0f}};
+    uint32_t scene_lod_count = 1;
+    // and those of the cluster DAG after them
+    size_t scene_lod_index_count = scene_index_count;
+    // of LOD 0, only cooked meshes big enough have them
+    const Meshlet* scene_meshlets = nullptr;
+    size_t scene_meshlet_count = 0;
+    const Cluster* scene_clusters = nullptr;
+    size_t scene_cluster_count = 0;
+
+    MeshData model;
+    MeshCache cache;
+    GltfModel gltf;
+    PackFile pack;
+    // a mesh out of a pack streams in while the pyramid stands in for it, the render loop never waits for the disk
+    const PackEntry* pack_mesh = nullptr;
+    std::vector<uint8_t> pack_entry;
+    PackLoad pack_load;
+    GpuUploadBatch pack_upload;
+    bool pack_uploading = false;
+    double pack_load_start = 0;
+    if (argc > 1 && ends_with(argv[1], ".pack")) {
+        // the mesh named on the command line, or the first one in the pack
+        if (pack.open(argv[1])) {
+            if (argc > 2) {
+                pack_mesh = pack.find(argv[2]);
+            } else {
+                for (size_t i = 0; i < pack.entry_count() && !pack_mesh; i++) {
+                    if (pack.name(pack.entries[i]).ends_with(".mesh")) pack_mesh = &pack.entries[i];
+                }
+            }
+
+            if (!pack_mesh) fprintf(stderr, "%s has no mesh %s\n", argv[1], argc > 2 ? argv[2] : "in it");
+        }
+
+        if (!pack_mesh) {
+            io_shutdown();
+            jobs_shutdown();
+            glfwTerminate();
+            return 1;
+        }
+
+        pack_load_start = glfwGetTime();
+        pack_entry.resize(pack_mesh->size);
+        pack.read_async(*pack_mesh, pack_entry.data(), &pack_load);
+    } else if (argc > 1 && (ends_with(argv[1], ".gltf") || ends_with(argv[1], ".glb"))) {
+        double load_start = glfwGetTime();
+        if (!gltf.load(argv[1])) {
+            io_shutdown();
+            jobs_shutdown();
+            glfwTerminate();
+            return 1;
+        }
+        gltf.fit_unit_box(GLTF_SCENE_CENTER);
+
+        printf("loaded %s: %zu primitives, %zu instances, %zu triangles in %f s\n", argv[1], gltf.primitives.size(),
+               gltf.instances.size(), gltf.triangle_count(), glfwGetTime() - load_start);
+    } else if (argc > 1) {
+        double load_start = glfwGetTime();
+
+        // the mesh glpg-cook made from the OBJ is used as it is when the OBJ didn't change since
+        std::string cache_path = std::string(argv[1]) + ".mesh";
+
+        if (cache.open(cache_path.c_str(), argv[1])) {
+            printf("loaded %s: %zu vertices, %zu triangles in %f s\n", cache_path.c_str(), cache.vertex_count(),
+                   cache.index_count() / 3, glfwGetTime() - load_start);
+
+            scene_positions = cache.positions();
+            scene_colors_rgba8 = cache.colors();
+            scene_indices = cache.indices();
+            scene_vertex_count = cache.vertex_count();
+            scene_index_count = cache.index_count();
+
+            scene_lod_count = cache.lod_count();
+            memcpy(scene_lods, cache.lods(), scene_lod_count * sizeof(MeshLod));
+            scene_lod_index_count = cache.lod_index_count() + cache.cluster_index_count();
+
+            scene_meshlets = cache.meshlets();
+            scene_meshlet_count = cache.meshlet_count();
+            scene_clusters = cache.clusters();
+            scene_cluster_count = cache.cluster_count();
+        } else {
+            // NOTE: not die(), exiting with the workers still running aborts
+            if (!load_obj(argv[1], &model)) {
+                io_shutdown();
+                jobs_shutdown();
+                glfwTerminate();
+                return 1;
+            }
+            model.fit_unit_box();
+
+            printf("loaded %s: %zu vertices, %zu triangles in %f s (glpg-cook %s makes it load faster)\n", argv[1],
+                   model.vertex_count(), model.index_count() / 3, glfwGetTime() - load_start, argv[1]);
+
+            scene_positions = model.positions.data();
+            scene_colors = model.colors.data();
+            scene_indices = model.indices.data();
+            scene_vertex_count = model.vertex_count();
+            scene_index_count = model.index_count();
+            scene_lods[0].index_count = model.index_count();
+            scene_lod_index_count = model.index_count();
+        }
+    }
 
-	1.0f, 0.0f, 0.0f,
-	1.0f, 0.0f, 0.0f,
-	1.0f, 0.0f, 0.0f,
+    // buffers of streamed meshes are uploaded on a thread of its own
+    GpuLoader loader;
+    if (!loader.start(window)) fprintf(stderr, "No shared context for a loader thread, uploading on the main thread\n");
 
-	1.0f, 0.0f, 0.0f,
-	1.0f, 0.0f, 0.0f,
-	1.0f, 0.0f, 0.0f,
+    GpuResources resources;
 
-	0.0f, 1.0f, 1.0f,
-	0.0f, 1.0f, 1.0f,
-	0.0f, 1.0f, 1.0f,
+    // NOTE: the indices of a DAG are streamed in later, the buffer starts out empty
+    MeshHandle scene_mesh = scene_colors_rgba8
+        ? resources.create_mesh(scene_positions, scene_colors_rgba8, scene_vertex_count,
+                                gpu_clusters && scene_cluster_count ? nullptr : scene_indices, scene_lod_index_count)
+        : resources.create_mesh(scene_positions, scene_colors, scene_vertex_count, scene_indices, scene_lod_index_count);
+    ProgramHandle scene_program = resources.create_program(vert_src, frag_src);
 
-	0.0f, 1.0f, 1.0f,
-	0.0f, 1.0f, 1.0f,
-	0.0f, 1.0f, 1.0f,
-    };
+    gltf.upload(resources);
 
-#define vertices piramid_vertices
+    const Program* prog = resources.get(scene_program);
+    glUniformBlockBinding(prog->program, glGetUniformBlockIndex(prog->program, "Camera"), CAMERA_BLOCK_BINDING);
 
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
+    BufferHandle camera_buffer = resources.create_buffer(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    glBindVertexArray(vao);
+    Simulation simulation;
+    // NOTE: the occluders can't change once the simulation runs, a streamed mesh goes without CPU occlusion culling;
+    // they're LOD 0, a coarser one can stick out of the mesh and hide what is in front of it
+    if (!pack_mesh && scene_index_count <= MAX_OCCLUDER_INDICES) {
+        simulation.init(projection, z_far, scene_positions, scene_vertex_count, scene_indices, scene_index_count,
+                        !gpu_culling);
+    } else {
+        simulation.init(projection, z_far, nullptr, 0, nullptr, 0, !gpu_culling);
+    }
 
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
+    const size_t object_count = simulation.object_count();
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    ProgramHandle instanced_program;
+    BufferHandle instance_buffer;
+    RenderTarget scene_target;
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if (gpu_culling) {
+        glBindVertexArray(resources.get(scene_mesh)->vao);
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, cast(void*) (sizeof(vertices) / 2));
+        // filled from the first frame
+        instance_buffer = resources.create_buffer(GL_ARRAY_BUFFER, object_count * sizeof(Mat4), nullptr, GL_DYNAMIC_DRAW);
 
-    auto vert = create_shader(GL_VERTEX_SHADER, vert_src);
-    auto frag = create_shader(GL_FRAGMENT_SHADER, frag_src);
-    auto prog = create_program(vert, frag);
+        set_instance_attributes();
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
+        instanced_program = resources.create_program(instanced_vert_src, frag_src);
 
-    glUseProgram(prog);
+        GLuint instanced_prog = resources.get(instanced_program)->program;
+        glUniformBlockBinding(instanced_prog, glGetUniformBlockIndex(instanced_prog, "Camera"), CAMERA_BLOCK_BINDING);
 
-    const float fov_x = 45.0;
-    const float z_far = 10.0;
-    const float z_near = 2.0;
+        gpu_culler.set_lods(scene_lods, scene_lod_count);
+        if (gpu_clusters && scene_cluster_count) {
+            const Mesh* mesh = resources.get(scene_mesh);
+            gpu_culler.set_clusters(scene_clusters, scene_cluster_count, scene_indices,
+                                    resources.get(mesh->indices)->buffer);
+        } else {
+            gpu_culler.set_meshlets(scene_meshlets, scene_meshlet_count);
+        }
+    }
 
-    Mat4 projection_mat = Mat4::projection(fov_x, z_near, z_far);
+    uint64_t uploaded_version = 0;
 
-    auto model_loc = glGetUniformLocation(prog, "model");
-    auto view_loc = glGetUniformLocation(prog, "view");
-    auto projection_loc = glGetUniformLocation(prog, "projection");
+    RenderQueue render_queue;
+    CommandList frame_commands;
 
-    glUniformMatrix4fv(projection_loc, 1, GL_FALSE, projection_mat.elems);
+    // sort results and command lists of the frame being drawn
+    FrameArena render_arena;
+    render_arena.init(FRAME_ARENA_SIZE);
 
-    auto time_loc = glGetUniformLocation(prog, "time");
+    simulation.start();
 
-    double last_frame_time = 0;
+    alloc_debug_begin();
 
     while (!glfwWindowShouldClose(window)) {
+        const FrameSnapshot& frame = simulation.acquire_frame();
+
+        Arena& arena = render_arena.next();
+
+        // read and decompressed, off to the loader thread
+        if (pack_mesh && !pack_uploading && pack_load.done()) {
+            std::string name(pack.name(*pack_mesh));
+
+            if (!pack_load.ok()) {
+                fprintf(stderr, "Could not read %s from %s\n", name.c_str(), argv[1]);
+                pack_mesh = nullptr;
+            } else if (cache.load(pack_entry.data(), pack_entry.size(), name.c_str())) {
+                // NOTE: the colors follow the positions in a cache, the vertices are one buffer
+                const size_t vertex_bytes = cache.vertex_count() * (3 * sizeof(float) + 4);
+                const size_t index_bytes = (cache.lod_index_count() + cache.cluster_index_count()) * sizeof(uint32_t);
+                const bool streams = gpu_clusters && cache.cluster_count();
+
+                pack_upload.uploads = {GpuUpload{GPU_UPLOAD_BUFFER, cache.positions(), vertex_bytes},
+                                       GpuUpload{GPU_UPLOAD_BUFFER, streams ? nullptr : cache.indices(), index_bytes}};
+                loader.submit(&pack_upload);
+                pack_uploading = true;
+            } else {
+                // NOTE: the pyramid stays if it didn't work out
+                pack_mesh = nullptr;
+            }
+        }
+
+        // on the GPU, only the vertex array is left to make here
+        if (pack_uploading && loader.ready(&pack_upload)) {
+            printf("streamed %s from %s (%s, %s): %zu vertices, %zu triangles in %f s\n",
+                   std::string(pack.name(*pack_mesh)).c_str(), argv[1], io_uses_uring() ? "io_uring" : "pread",
+                   loader.window ? "loader thread" : "uploaded here", cache.vertex_count(), cache.index_count() / 3,
+                   glfwGetTime() - pack_load_start);
+
+            const GpuUpload& vertex_upload = pack_upload.uploads[0];
+            const GpuUpload& index_upload = pack_upload.uploads[1];
+            BufferHandle vertices = resources.add_buffer(Buffer{vertex_upload.object, GL_ARRAY_BUFFER, vertex_upload.size});
+            BufferHandle indices =
+                resources.add_buffer(Buffer{index_upload.object, GL_ELEMENT_ARRAY_BUFFER, index_upload.size});
+
+            // NOTE: the placeholder is done with, nothing drawn from here on refers to it
+            resources.destroy(scene_mesh);
+            scene_mesh = resources.create_mesh(vertices, indices, cache.vertex_count(),
+                                               cache.lod_index_count() + cache.cluster_index_count());
+
+            scene_lod_count = cache.lod_count();
+            memcpy(scene_lods, cache.lods(), scene_lod_count * sizeof(MeshLod));
+            scene_meshlets = cache.meshlets();
+            scene_meshlet_count = cache.meshlet_count();
+            scene_clusters = cache.clusters();
+            scene_cluster_count = cache.cluster_count();
+
+            if (gpu_culling) {
+                glBindVertexArray(resources.get(scene_mesh)->vao);
+                glBindBuffer(GL_ARRAY_BUFFER, resources.get(instance_buffer)->buffer);
+                set_instance_attributes();
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+                gpu_culler.upload(frame.object_bounds.data(), object_count, 0, object_count);
+                gpu_culler.set_lods(scene_lods, scene_lod_count);
+                if (gpu_clusters && scene_cluster_count) {
+                    gpu_culler.set_clusters(scene_clusters, scene_cluster_count, cache.indices(), index_upload.object);
+                } else {
+                    gpu_culler.set_meshlets(scene_meshlets, scene_meshlet_count);
+                }
+            }
+
+            pack_uploading = false;
+            pack_mesh = nullptr;
+        }
+
+        const Mesh* mesh = resources.get(scene_mesh);
+
         glClearColor(0.8f, 0.f, 0.5f, 1.0f);
         glClearDepth(1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        double time = glfwGetTime();
-        delta_time = time - last_frame_time;
-        last_frame_time = time;
+        CameraBlock camera = {frame.view, frame.projection, frame.time, {}};
+
+        frame_commands.reset(arena);
+        frame_commands.update_uniform_block(resources.get(camera_buffer)->buffer, CAMERA_BLOCK_BINDING, &camera, sizeof(camera));
+        frame_commands.execute();
+
+        if (gpu_culling && frame.transform_version != uploaded_version) {
+            // a skipped version means the range of the last one is not enough
+            size_t begin = 0, end = object_count;
+            if (frame.transform_version == uploaded_version + 1) {
+                begin = frame.changed_begin;
+                end = frame.changed_end;
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, resources.get(instance_buffer)->buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(Mat4), (end - begin) * sizeof(Mat4), frame.object_world.data() + begin);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            gpu_culler.upload(frame.object_bounds.data(), object_count, begin, end);
+
+            uploaded_version = frame.transform_version;
+        }
+
+        int fb_width, fb_height;
+        glfwGetFramebufferSize(window, &fb_width, &fb_height);
+
+        const float pixel_scale = lod_pixel_scale(frame.projection, fb_height);
+
+        if (gpu_culling) {
+            scene_target.resize(fb_width, fb_height);
+            scene_target.bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            // NOTE: occlusion uses last frame's depth, so things can pop in for a frame on fast camera moves
+            gpu_culler.cull(frame.view_projection, frame.frustum, frame.camera_pos, pixel_scale,
+                            resources.get(instance_buffer)->buffer);
+
+            glUseProgram(resources.get(instanced_program)->program);
+
+            glBindVertexArray(mesh->vao);
+            gpu_culler.draw(GL_TRIANGLES);
+
+            if (!gltf.instances.empty()) {
+                render_queue.begin();
+                push_gltf(render_queue, gltf, resources, scene_program, frame, z_far);
+                render_queue.sort(arena);
+                render_queue.submit(arena);
+            }
+
+            scene_target.blit_to_screen();
+            gpu_culler.build_hiz(scene_target.depth, scene_target.width, scene_target.height);
+        } else {
+            const Program* program = resources.get(scene_program);
+
+            render_queue.begin();
+
+            parallel_for(frame.visible_count, 256, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    uint32_t object = frame.visible[i];
+                    const Aabb& bounds = frame.object_bounds[object];
+                    float distance = (bounds.center() - frame.camera_pos).length();
+                    float depth = distance / z_far;
+
+                    const Mat4& world = frame.object_world[object];
+                    const float scale = max_scale(world);
+                    const uint32_t lod = select_lod(scene_lods, scene_lod_count, pixel_scale, scale,
+                                                    distance - bounds.extents().length());
+
+                    DrawPacket packet;
+                    packet.key = make_sort_key(RENDER_PASS_SCENE, false, depth, scene_program.index(), 0, scene_mesh.index());
+                    packet.model = &world;
+                    packet.program = program->program;
+                    packet.vao = mesh->vao;
+                    packet.model_loc = program->model_loc;
+                    packet.first = scene_lods[lod].first_index;
+                    packet.count = scene_lods[lod].index_count;
+                    packet.index_type = mesh->index_type;
+
+                    if (lod != 0 || scene_meshlet_count == 0) {
+                        render_queue.push(packet);
+                        continue;
+                    }
+
+                    // LOD 0 in meshlets; the ones left that follow each other in the indices are one draw
+                    packet.count = 0;
+                    for (size_t m = 0; m < scene_meshlet_count; m++) {
+                        const Meshlet& meshlet = scene_meshlets[m];
+                        if (!meshlet_visible(meshlet, world, scale, frame.frustum, frame.camera_pos)) continue;
+
+                        if (packet.count && cast(uint32_t) (packet.first + packet.count) == meshlet.first_index) {
+                            packet.count += meshlet.index_count;
+                        } else {
+                            if (packet.count) render_queue.push(packet);
+                            packet.first = meshlet.first_index;
+                            packet.count = meshlet.index_count;
+                        }
+                    }
+                    if (packet.count) render_queue.push(packet);
+                }
+            });
+
+            push_gltf(render_queue, gltf, resources, scene_program, frame, z_far);
+
+            render_queue.sort(arena);
+            render_queue.submit(arena);
+        }
 
-        process_input(window);
-
-        printf("%f\n", delta_time);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
 
-        glUniform1f(time_loc, time);
+        process_input(window);
+        simulation.set_input(input);
 
-        Mat4 model_mat{};
+        input.mouse_dx = 0;
+        input.mouse_dy = 0;
 
-        // model_mat.rotate_y(30.0f * time);
-        model_mat.translate(0, 0, -5.0f);
+        alloc_debug_frame();
+    }
 
-        glUniformMatrix4fv(model_loc, 1, GL_FALSE, model_mat.elems);
+    alloc_debug_end();
 
-        Mat4 view_mat = Mat4::look_at(camera_pos, camera_pos + camera_front, camera_up);
+    simulation.stop();
 
-        glUniformMatrix4fv(view_loc, 1, GL_FALSE, view_mat.elems);
+    // still streaming, the reads write into `pack_entry`
+    if (pack_mesh) pack_load.wait();
 
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+    io_shutdown();
+    jobs_shutdown();
+    loader.stop();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-    }
+    if (gpu_culling) gpu_culler.destroy();
+    resources.destroy_all();
 
     glfwTerminate();
 
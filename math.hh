@@ -0,0 +1,504 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include <bit>
+#include <type_traits>
+
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "common.hh"
+
+static constexpr float deg_to_rad(float angle) {
+    return angle * M_PI * 2.0f / 360.0f;
+}
+
+// sqrtf, but also usable in constant expressions, where it falls back to
+// Newton's method in double
+static constexpr float const_sqrtf(float x) {
+    if (!std::is_constant_evaluated()) return sqrtf(x);
+    if (!(x > 0)) return x == 0 ? x : NAN;
+
+    double r = x > 1 ? x : 1.0;
+    for (int i = 0; i < 64; i++) r = 0.5 * (r + x / r);
+    return cast(float) r;
+}
+
+// Cephes-style sine and cosine: the angle is reduced to [-pi/4, pi/4] with a
+// three part pi/4, then a minimax polynomial for each. Against a double
+// reference the error is at most 1.6 ulp for |angle| <= 8192, and at most 8e-8
+// absolute around the zeros where ulps don't mean much. Past 8192 the
+// reduction starts losing bits. The batch versions
+// in fast_trig.hh do the same on 4 or 8 lanes and give the same results.
+constexpr float SINCOS_FOUR_OVER_PI = 1.27323954473516f;
+constexpr float SINCOS_PI4_A = 0.78515625f;
+constexpr float SINCOS_PI4_B = 2.4187564849853515625e-4f;
+constexpr float SINCOS_PI4_C = 3.77489497744594108e-8f;
+
+constexpr float SINCOS_SIN_0 = -1.9515295891e-4f;
+constexpr float SINCOS_SIN_1 = 8.3321608736e-3f;
+constexpr float SINCOS_SIN_2 = -1.6666654611e-1f;
+constexpr float SINCOS_COS_0 = 2.443315711809948e-5f;
+constexpr float SINCOS_COS_1 = -1.388731625493765e-3f;
+constexpr float SINCOS_COS_2 = 4.166664568298827e-2f;
+
+static constexpr void fast_sincos(float angle, float* out_sin, float* out_cos) {
+    uint32_t sin_sign = std::bit_cast<uint32_t>(angle) & 0x80000000u;
+    float x = std::bit_cast<float>(std::bit_cast<uint32_t>(angle) & 0x7fffffffu);
+
+    // the octant, rounded up to even so x lands in [-pi/4, pi/4]
+    uint32_t j = (cast(uint32_t)(x * SINCOS_FOUR_OVER_PI) + 1) & ~1u;
+    float y = cast(float) j;
+
+    x = ((x - y * SINCOS_PI4_A) - y * SINCOS_PI4_B) - y * SINCOS_PI4_C;
+
+    sin_sign ^= (j & 4) << 29;
+    uint32_t cos_sign = (~(j - 2) & 4) << 29;
+
+    float z = x * x;
+    float c = ((SINCOS_COS_0 * z + SINCOS_COS_1) * z + SINCOS_COS_2) * z * z - 0.5f * z + 1.0f;
+    float s = ((SINCOS_SIN_0 * z + SINCOS_SIN_1) * z + SINCOS_SIN_2) * z * x + x;
+
+    // odd octant pairs swap the polynomials
+    if (j & 2) {
+        float t = s;
+        s = c;
+        c = t;
+    }
+
+    *out_sin = std::bit_cast<float>(std::bit_cast<uint32_t>(s) ^ sin_sign);
+    *out_cos = std::bit_cast<float>(std::bit_cast<uint32_t>(c) ^ cos_sign);
+}
+
+struct Vec3 {
+    constexpr Vec3 copy() const {
+        return Vec3{x, y, z};
+    }
+
+    constexpr void norm() {
+        float len = length();
+        x /= len;
+        y /= len;
+        z /= len;
+    }
+
+    constexpr void cross(Vec3 other) {
+        float xx = x;
+        float yy = y;
+
+        x = yy * other.z - z  * other.y;
+        y = z  * other.x - xx * other.z;
+        z = xx * other.y - yy * other.x;
+    }
+
+    constexpr float length() const {
+        return const_sqrtf(x * x + y * y + z * z);
+    }
+
+    constexpr void neg() {
+        x = -x;
+        y = -y;
+        z = -z;
+    }
+
+    constexpr float sum() const {
+        return x + y + z;
+    }
+
+    constexpr Vec3 operator -(const Vec3& other) const {
+        return Vec3{x - other.x, y - other.y, z - other.z};
+    }
+
+    constexpr Vec3 operator *(const Vec3& other) const {
+        return Vec3{x * other.x, y * other.y, z * other.z};
+    }
+
+    constexpr Vec3 operator *(float scalar) const {
+        return Vec3{x * scalar, y * scalar, z * scalar};
+    }
+
+    constexpr Vec3 operator +(const Vec3& other) const {
+        return Vec3{x + other.x, y + other.y, z + other.z};
+    }
+
+    constexpr Vec3& operator +=(const Vec3& other) {
+        x += other.x;
+        y += other.y;
+        z += other.z;
+
+        return *this;
+    }
+
+    constexpr Vec3& operator -=(const Vec3& other) {
+        x -= other.x;
+        y -= other.y;
+        z -= other.z;
+
+        return *this;
+    }
+
+    float x, y, z;
+};
+
+constexpr Vec3 operator *(float scalar, Vec3 vec) {
+    return Vec3{vec.x * scalar, vec.y * scalar, vec.z * scalar};
+}
+
+constexpr Vec3 vec3_min(Vec3 a, Vec3 b) {
+    if (std::is_constant_evaluated()) {
+        return Vec3{a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z};
+    }
+    return Vec3{fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z)};
+}
+
+constexpr Vec3 vec3_max(Vec3 a, Vec3 b) {
+    if (std::is_constant_evaluated()) {
+        return Vec3{a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z};
+    }
+    return Vec3{fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z)};
+}
+
+struct Aabb {
+    static constexpr Aabb empty() {
+        return Aabb{Vec3{INFINITY, INFINITY, INFINITY}, Vec3{-INFINITY, -INFINITY, -INFINITY}};
+    }
+
+    static constexpr Aabb from_center(Vec3 center, Vec3 extents) {
+        return Aabb{center - extents, center + extents};
+    }
+
+    constexpr void grow(Vec3 p) {
+        min = vec3_min(min, p);
+        max = vec3_max(max, p);
+    }
+
+    constexpr void grow(const Aabb& other) {
+        min = vec3_min(min, other.min);
+        max = vec3_max(max, other.max);
+    }
+
+    constexpr Vec3 center() const {
+        return 0.5f * (min + max);
+    }
+
+    constexpr Vec3 extents() const {
+        return 0.5f * (max - min);
+    }
+
+    constexpr float surface_area() const {
+        Vec3 d = max - min;
+        if (d.x < 0 || d.y < 0 || d.z < 0) return 0;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    Vec3 min, max;
+};
+
+struct Mat4 {
+    constexpr Mat4() : elems{1, 0, 0, 0,
+                   0, 1, 0, 0,
+                   0, 0, 1, 0,
+                   0, 0, 0, 1}
+    {}
+
+    constexpr Mat4(float m11, float m12, float m13, float m14,
+         float m21, float m22, float m23, float m24,
+         float m31, float m32, float m33, float m34,
+         float m41, float m42, float m43, float m44
+         ) : elems{m11, m21, m31, m41,
+                   m12, m22, m32, m42,
+                   m13, m23, m33, m43,
+                   m14, m24, m34, m44}
+    {}
+
+    static constexpr Mat4 look_at(Vec3 camera_pos, Vec3 camera_target, Vec3 up) {
+        // NOTE: the order is reversed, and the vector points towards the camera
+        Vec3 camera_dir = (camera_pos - camera_target);
+        camera_dir.norm();
+
+        Vec3 camera_right = up;
+        camera_right.cross(camera_dir);
+        camera_right.norm();
+
+        Vec3 camera_up = camera_dir;
+        camera_up.cross(camera_right);
+
+        camera_pos.neg();
+
+        Vec3 right_perm = camera_pos * camera_right;
+        Vec3 up_perm = camera_pos * camera_up;
+        Vec3 dir_perm = camera_pos * camera_dir;
+
+        float right_perm_sum = right_perm.sum();
+        float up_perm_sum = up_perm.sum();
+        float dir_perm_sum = dir_perm.sum();
+
+        return Mat4{camera_right.x, camera_right.y, camera_right.z, right_perm_sum,
+                    camera_up.x,    camera_up.y,    camera_up.z,    up_perm_sum,
+                    camera_dir.x,   camera_dir.y,   camera_dir.z,   dir_perm_sum,
+                    0,              0,              0,              1};
+    }
+
+    static constexpr Mat4 projection(float fov_x, float z_near, float z_far) {
+        Mat4 mat{};
+
+        const float fov_x_rad = deg_to_rad(fov_x);
+        const float angle = fov_x_rad / 2;
+
+        float sin_angle, cos_angle;
+        fast_sincos(angle, &sin_angle, &cos_angle);
+        float tangent = sin_angle / cos_angle;
+
+        float right = z_near * tangent;
+        float top = right / aspect_ratio;
+
+        mat.elems[0] = z_near / right;
+        mat.elems[5] = z_near / top;
+        // mat.elems[0] = 1 / tangent;
+        // mat.elems[5] = 1 / tangent;
+        mat.elems[10] = (z_far + z_near) / (z_near - z_far);
+        mat.elems[11] = -1;
+        mat.elems[14] = (2 * z_far * z_near) / (z_near - z_far);
+
+        return mat;
+    }
+
+    constexpr Mat4& translate(float x, float y = 0.0f, float z = 0.0f) {
+        elems[12] += x;
+        elems[13] += y;
+        elems[14] += z;
+
+        return *this;
+    }
+
+    // these compose, `m.rotate_x(a)` rotates before whatever `m` did; degrees
+    constexpr Mat4& rotate_x(float angle);
+    constexpr Mat4& rotate_y(float angle);
+    constexpr Mat4& rotate_z(float angle);
+
+    // NOTE: elems are column-major, so `a * b` applies `b` first, same as in GLSL
+    constexpr Mat4 operator *(const Mat4& other) const {
+        Mat4 res;
+
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                float sum = 0;
+                for (int k = 0; k < 4; k++) {
+                    sum += elems[k * 4 + row] * other.elems[col * 4 + k];
+                }
+                res.elems[col * 4 + row] = sum;
+            }
+        }
+
+        return res;
+    }
+
+    float elems[16];
+};
+
+// Unit quaternion for rotations, (x, y, z) is the vector part. Composes like
+// Mat4: `a * b` rotates by `b` first.
+struct alignas(16) Quat {
+    static constexpr Quat identity() {
+        return Quat{0, 0, 0, 1};
+    }
+
+    // `axis` has to be normalized, radians
+    static constexpr Quat from_axis_angle(Vec3 axis, float angle) {
+        float s, c;
+        fast_sincos(angle * 0.5f, &s, &c);
+        return Quat{axis.x * s, axis.y * s, axis.z * s, c};
+    }
+
+    // the rotation part of `m`, which must not be scaled (Shepperd's method)
+    static Quat from_mat4(const Mat4& m);
+
+    // NOTE: the SIMD paths are skipped in constant expressions, intrinsics aren't constexpr
+    constexpr Quat operator *(const Quat& b) const {
+#if defined(__SSE__)
+        if (!std::is_constant_evaluated()) {
+            __m128 qa = _mm_load_ps(&x);
+            __m128 qb = _mm_load_ps(&b.x);
+
+            // one broadcast component of `a` times a permutation of `b` each, the
+            // signs are flipped with xor
+            const __m128 sign1 = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f);
+            const __m128 sign2 = _mm_setr_ps(0.0f, 0.0f, -0.0f, -0.0f);
+            const __m128 sign3 = _mm_setr_ps(-0.0f, 0.0f, 0.0f, -0.0f);
+
+            __m128 r = _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(3, 3, 3, 3)), qb);
+
+            __m128 t1 = _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(0, 1, 2, 3)));
+            __m128 t2 = _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(1, 0, 3, 2)));
+            __m128 t3 = _mm_mul_ps(_mm_shuffle_ps(qa, qa, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            r = _mm_add_ps(r, _mm_xor_ps(t1, sign1));
+            r = _mm_add_ps(r, _mm_xor_ps(t2, sign2));
+            r = _mm_add_ps(r, _mm_xor_ps(t3, sign3));
+
+            Quat res;
+            _mm_store_ps(&res.x, r);
+            return res;
+        }
+#endif
+        return Quat{
+            w * b.x + x * b.w + y * b.z - z * b.y,
+            w * b.y - x * b.z + y * b.w + z * b.x,
+            w * b.z + x * b.y - y * b.x + z * b.w,
+            w * b.w - x * b.x - y * b.y - z * b.z,
+        };
+    }
+
+    constexpr float dot(const Quat& b) const {
+        return x * b.x + y * b.y + z * b.z + w * b.w;
+    }
+
+    // the inverse, for unit quaternions
+    constexpr Quat conjugate() const {
+        return Quat{-x, -y, -z, w};
+    }
+
+    constexpr Quat normalized() const {
+#if defined(__SSE__)
+        if (!std::is_constant_evaluated()) {
+            __m128 q = _mm_load_ps(&x);
+            __m128 sq = _mm_mul_ps(q, q);
+            // horizontal sum, ends up in every lane
+            sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+            sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            Quat res;
+            _mm_store_ps(&res.x, _mm_div_ps(q, _mm_sqrt_ps(sq)));
+            return res;
+        }
+#endif
+        float inv = 1.0f / const_sqrtf(dot(*this));
+        return Quat{x * inv, y * inv, z * inv, w * inv};
+    }
+
+    constexpr Vec3 rotate(Vec3 v) const {
+        // v + 2w (q x v) + 2 q x (q x v)
+        Vec3 q = {x, y, z};
+
+        Vec3 t = q;
+        t.cross(v);
+        t = t * 2.0f;
+
+        Vec3 u = q;
+        u.cross(t);
+
+        return v + t * w + u;
+    }
+
+    constexpr Mat4 to_mat4() const;
+
+    float x, y, z, w;
+};
+
+// normalized linear interpolation, cheap and good enough for small angles,
+// takes the short way around
+inline Quat nlerp(const Quat& a, const Quat& b, float t) {
+    float sign = a.dot(b) < 0 ? -1.0f : 1.0f;
+    float s = 1.0f - t;
+    float u = t * sign;
+
+#if defined(__SSE__)
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_load_ps(&a.x), _mm_set1_ps(s)), _mm_mul_ps(_mm_load_ps(&b.x), _mm_set1_ps(u)));
+
+    Quat res;
+    _mm_store_ps(&res.x, r);
+    return res.normalized();
+#else
+    return Quat{a.x * s + b.x * u, a.y * s + b.y * u, a.z * s + b.z * u, a.w * s + b.w * u}.normalized();
+#endif
+}
+
+// constant angular velocity interpolation, takes the short way around
+inline Quat slerp(const Quat& a, const Quat& b, float t) {
+    float cos_theta = a.dot(b);
+    Quat to = b;
+
+    if (cos_theta < 0) {
+        cos_theta = -cos_theta;
+        to = Quat{-b.x, -b.y, -b.z, -b.w};
+    }
+
+    // NOTE: nearly parallel, sin(theta) would blow up the weights
+    if (cos_theta > 0.9995f) return nlerp(a, to, t);
+
+    float theta = acosf(cos_theta);
+    float inv_sin = 1.0f / sinf(theta);
+    float s = sinf((1.0f - t) * theta) * inv_sin;
+    float u = sinf(t * theta) * inv_sin;
+
+    return Quat{a.x * s + to.x * u, a.y * s + to.y * u, a.z * s + to.z * u, a.w * s + to.w * u};
+}
+
+constexpr Mat4 Quat::to_mat4() const {
+    return Mat4{1 - 2 * (y * y + z * z), 2 * (x * y - z * w),     2 * (x * z + y * w),     0,
+                2 * (x * y + z * w),     1 - 2 * (x * x + z * z), 2 * (y * z - x * w),     0,
+                2 * (x * z - y * w),     2 * (y * z + x * w),     1 - 2 * (x * x + y * y), 0,
+                0,                       0,                       0,                       1};
+}
+
+inline Quat Quat::from_mat4(const Mat4& m) {
+    // m(row, col)
+    auto at = [&](int row, int col) { return m.elems[col * 4 + row]; };
+
+    float trace = at(0, 0) + at(1, 1) + at(2, 2);
+    Quat q;
+
+    // NOTE: divides by the biggest of the four candidates, the others lose precision near 180 degrees
+    if (trace > 0) {
+        float s = sqrtf(trace + 1.0f) * 2;
+        q = Quat{(at(2, 1) - at(1, 2)) / s, (at(0, 2) - at(2, 0)) / s, (at(1, 0) - at(0, 1)) / s, 0.25f * s};
+    } else if (at(0, 0) > at(1, 1) && at(0, 0) > at(2, 2)) {
+        float s = sqrtf(1.0f + at(0, 0) - at(1, 1) - at(2, 2)) * 2;
+        q = Quat{0.25f * s, (at(0, 1) + at(1, 0)) / s, (at(0, 2) + at(2, 0)) / s, (at(2, 1) - at(1, 2)) / s};
+    } else if (at(1, 1) > at(2, 2)) {
+        float s = sqrtf(1.0f + at(1, 1) - at(0, 0) - at(2, 2)) * 2;
+        q = Quat{(at(0, 1) + at(1, 0)) / s, 0.25f * s, (at(1, 2) + at(2, 1)) / s, (at(0, 2) - at(2, 0)) / s};
+    } else {
+        float s = sqrtf(1.0f + at(2, 2) - at(0, 0) - at(1, 1)) * 2;
+        q = Quat{(at(0, 2) + at(2, 0)) / s, (at(1, 2) + at(2, 1)) / s, 0.25f * s, (at(1, 0) - at(0, 1)) / s};
+    }
+
+    return q.normalized();
+}
+
+constexpr Mat4& Mat4::rotate_x(float angle) {
+    *this = *this * Quat::from_axis_angle(Vec3{1, 0, 0}, deg_to_rad(angle)).to_mat4();
+    return *this;
+}
+
+constexpr Mat4& Mat4::rotate_y(float angle) {
+    *this = *this * Quat::from_axis_angle(Vec3{0, 1, 0}, deg_to_rad(angle)).to_mat4();
+    return *this;
+}
+
+constexpr Mat4& Mat4::rotate_z(float angle) {
+    *this = *this * Quat::from_axis_angle(Vec3{0, 0, 1}, deg_to_rad(angle)).to_mat4();
+    return *this;
+}
+
+// bounds of `box` after transforming it by `m`, which may rotate and scale (Arvo)
+inline Aabb transform_aabb(const Mat4& m, const Aabb& box) {
+    float lo[3] = {m.elems[12], m.elems[13], m.elems[14]};
+    float hi[3] = {m.elems[12], m.elems[13], m.elems[14]};
+    const float bmin[3] = {box.min.x, box.min.y, box.min.z};
+    const float bmax[3] = {box.max.x, box.max.y, box.max.z};
+
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            float a = m.elems[col * 4 + row] * bmin[col];
+            float b = m.elems[col * 4 + row] * bmax[col];
+            lo[row] += fminf(a, b);
+            hi[row] += fmaxf(a, b);
+        }
+    }
+
+    return Aabb{Vec3{lo[0], lo[1], lo[2]}, Vec3{hi[0], hi[1], hi[2]}};
+}
@@ -0,0 +1,67 @@
+#include "mesh.hh"
+
+Aabb MeshData::bounds() const {
+    Aabb box = Aabb::empty();
+    for (size_t i = 0; i < vertex_count(); i++) {
+        box.grow(Vec3{positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2]});
+    }
+    return box;
+}
+
+void MeshData::fit_unit_box() {
+    if (vertex_count() == 0) return;
+
+    Aabb box = bounds();
+    Vec3 center = box.center();
+    Vec3 size = box.max - box.min;
+
+    float largest = fmaxf(size.x, fmaxf(size.y, size.z));
+    float scale = largest > 0 ? 1.0f / largest : 1.0f;
+
+    for (size_t i = 0; i < vertex_count(); i++) {
+        positions[i * 3 + 0] = (positions[i * 3 + 0] - center.x) * scale;
+        positions[i * 3 + 1] = (positions[i * 3 + 1] - center.y) * scale;
+        positions[i * 3 + 2] = (positions[i * 3 + 2] - center.z) * scale;
+    }
+}
+
+void MeshBuilder::init(std::vector<float>&& positions) {
+    mesh.positions = std::move(positions);
+    mesh.colors.assign(mesh.positions.size(), 0.0f);
+    mesh.indices.clear();
+
+    position_color.assign(mesh.vertex_count(), NO_COLOR);
+    extra_vertices.clear();
+}
+
+uint32_t MeshBuilder::vertex(uint32_t position, uint32_t color_id, Vec3 color) {
+    uint32_t& own = position_color[position];
+
+    if (own == color_id) return position;
+
+    if (own == NO_COLOR) {
+        own = color_id;
+        mesh.colors[position * 3 + 0] = color.x;
+        mesh.colors[position * 3 + 1] = color.y;
+        mesh.colors[position * 3 + 2] = color.z;
+        return position;
+    }
+
+    uint64_t key = (cast(uint64_t) position << 32) | color_id;
+    auto [it, inserted] = extra_vertices.try_emplace(key, mesh.vertex_count());
+    if (inserted) {
+        // NOTE: copied out first, the pushes may move the positions
+        const float x = mesh.positions[position * 3 + 0];
+        const float y = mesh.positions[position * 3 + 1];
+        const float z = mesh.positions[position * 3 + 2];
+
+        mesh.positions.push_back(x);
+        mesh.positions.push_back(y);
+        mesh.positions.push_back(z);
+        mesh.colors.push_back(color.x);
+        mesh.colors.push_back(color.y);
+        mesh.colors.push_back(color.z);
+    }
+
+    return it->second;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unordered_map>
+#include <vector>
+
+#include "math.hh"
+
+// The runtime counterpart of ShapeMesh (shapes.hh), for meshes loaded from
+// files: xyz positions, rgb colors and a triangle list of indices.
+struct MeshData {
+    inline size_t vertex_count() const {
+        return positions.size() / 3;
+    }
+
+    inline size_t index_count() const {
+        return indices.size();
+    }
+
+    Aabb bounds() const;
+
+    // scales and moves the mesh into the box from -0.5 to 0.5, keeping its proportions
+    void fit_unit_box();
+
+    std::vector<float> positions;
+    std::vector<float> colors;
+    std::vector<uint32_t> indices;
+};
+
+// Makes an indexed mesh out of corners that each name a position and a color.
+// Every distinct (position, color) pair becomes one vertex; most positions
+// are only ever used with one color, so those keep their own index and the
+// lookup is an array access. Only the others go through a hash map.
+struct MeshBuilder {
+    // takes over `positions`; every position starts out as an unused vertex
+    void init(std::vector<float>&& positions);
+
+    // `color_id` tells colors apart, the same id has to come with the same `color`
+    uint32_t vertex(uint32_t position, uint32_t color_id, Vec3 color);
+
+    inline void triangle(uint32_t a, uint32_t b, uint32_t c) {
+        mesh.indices.push_back(a);
+        mesh.indices.push_back(b);
+        mesh.indices.push_back(c);
+    }
+
+    static constexpr uint32_t NO_COLOR = UINT32_MAX;
+
+    MeshData mesh;
+    // the color id of the vertex at the position's own index
+    std::vector<uint32_t> position_color;
+    // (position << 32 | color id) -> vertex, for the positions used with more than one color
+    std::unordered_map<uint64_t, uint32_t> extra_vertices;
+};
@@ -0,0 +1,241 @@
+#include <cstdio>
+#include <cstring>
+
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.hh"
+#include "mesh_cache.hh"
+#include "hash.hh"
+#include "mesh_simplify.hh"
+
+static inline size_t align_up(size_t size) {
+    return (size + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static inline uint8_t quantize_unorm8(float value) {
+    if (!(value > 0.0f)) return 0;
+    if (value >= 1.0f) return 255;
+    return cast(uint8_t) (value * 255.0f + 0.5f);
+}
+
+bool stamp_source(const char* path, SourceStamp* out, bool with_hash) {
+    struct stat st;
+    if (stat(path, &st) < 0) return false;
+
+    out->size = st.st_size;
+    out->mtime_ns = cast(int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    out->hash = 0;
+
+    if (with_hash) {
+        MappedFile file;
+        if (!file.open(path)) return false;
+        out->hash = hash_bytes(file.data, file.size);
+    }
+
+    return true;
+}
+
+// the array `ptr` points at has to lie inside the file, and be aligned
+template <typename T>
+static bool check_array(const MeshCacheHeader* header, const RelPtr<T>& ptr, uint64_t count) {
+    const uint8_t* begin = cast(const uint8_t*) header;
+    const uint8_t* end = begin + header->file_size;
+    const uint8_t* at = cast(const uint8_t*) ptr.get();
+
+    if (!at) return count == 0;
+    if (at < begin + sizeof(MeshCacheHeader) || at > end) return false;
+    if (cast(uintptr_t) at % alignof(T) != 0) return false;
+    return count <= cast(uint64_t) (end - at) / sizeof(T);
+}
+
+bool MeshCache::load(const uint8_t* data, size_t size, const char* name) {
+    header = nullptr;
+
+    const MeshCacheHeader* h = cast(const MeshCacheHeader*) data;
+    if (size < sizeof(MeshCacheHeader) || cast(uintptr_t) data % MESH_CACHE_ALIGNMENT != 0 ||
+        h->magic != MESH_CACHE_MAGIC) {
+        fprintf(stderr, "%s is not a mesh cache\n", name);
+        return false;
+    }
+
+    // an older cooker, the file is stale as a whole
+    if (h->version != MESH_CACHE_VERSION) return false;
+
+    if (h->file_size != size || !check_array(h, h->positions, h->vertex_count * 3) ||
+        !check_array(h, h->colors, h->vertex_count * 4) ||
+        !check_array(h, h->indices, h->lod_index_count + h->cluster_index_count) ||
+        (h->vertex_count && h->colors.get() != cast(const uint8_t*) (h->positions.get() + h->vertex_count * 3))) {
+        fprintf(stderr, "%s is damaged\n", name);
+        return false;
+    }
+
+    // NOTE: one pass over the indices, without it a damaged one has the CPU occluders read past the positions
+    const uint32_t* indices = h->indices.get();
+    const uint64_t total_index_count = h->lod_index_count + h->cluster_index_count;
+    uint32_t max_index = 0;
+    for (uint64_t i = 0; i < total_index_count; i++) {
+        if (indices[i] > max_index) max_index = indices[i];
+    }
+    if (total_index_count && max_index >= h->vertex_count) {
+        fprintf(stderr, "%s is damaged, an index is past the vertices\n", name);
+        return false;
+    }
+
+    // LOD 0 is the whole mesh, and none of them reaches past the indices
+    bool lods_ok = h->lod_count >= 1 && h->lod_count <= MESH_MAX_LODS && h->lods[0].first_index == 0 &&
+                   h->lods[0].index_count == h->index_count;
+    for (uint32_t i = 0; lods_ok && i < h->lod_count; i++) {
+        lods_ok = cast(uint64_t) h->lods[i].first_index + h->lods[i].index_count <= h->lod_index_count;
+    }
+
+    // and the meshlets only cover LOD 0
+    lods_ok = lods_ok && check_array(h, h->meshlets, h->meshlet_count);
+    for (uint64_t i = 0; lods_ok && i < h->meshlet_count; i++) {
+        const Meshlet& meshlet = h->meshlets.get()[i];
+        lods_ok = cast(uint64_t) meshlet.first_index + meshlet.index_count <= h->index_count;
+    }
+
+    // the clusters go level by level, only level 0 uses the indices of LOD 0
+    lods_ok = lods_ok && check_array(h, h->clusters, h->cluster_count);
+    for (uint64_t i = 0; lods_ok && i < h->cluster_count; i++) {
+        const Cluster& cluster = h->clusters.get()[i];
+        uint64_t end = cast(uint64_t) cluster.meshlet.first_index + cluster.meshlet.index_count;
+        lods_ok = cluster.level < CLUSTER_MAX_LEVELS && (i == 0 || h->clusters.get()[i - 1].level <= cluster.level) &&
+                  (cluster.level == 0 ? end <= h->index_count
+                                      : cluster.meshlet.first_index >= h->lod_index_count &&
+                                            end <= h->lod_index_count + h->cluster_index_count);
+    }
+    if (!lods_ok) {
+        fprintf(stderr, "%s is damaged\n", name);
+        return false;
+    }
+
+    header = h;
+
+#if defined(GLPG_VERIFY_CACHE)
+    if (!verify()) {
+        fprintf(stderr, "%s is damaged, its data doesn't match its hash\n", name);
+        header = nullptr;
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool MeshCache::open(const char* path, const char* source_path) {
+    file.close();
+    header = nullptr;
+
+    // NOTE: a missing cache is the normal first run, not worth a message
+    if (access(path, R_OK) != 0) return false;
+    if (!file.open(path)) return false;
+
+    if (!load(file.data, file.size, path)) {
+        file.close();
+        return false;
+    }
+
+    SourceStamp source;
+    if (!stamp_source(source_path, &source, false)) {
+        header = nullptr;
+        file.close();
+        return false;
+    }
+
+    // NOTE: a touched but unchanged source costs one hash, not a rebuild
+    if (source.size != header->source.size || source.mtime_ns != header->source.mtime_ns) {
+        if (!stamp_source(source_path, &source, true) || source.hash != header->source.hash) {
+            header = nullptr;
+            file.close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MeshCache::verify() const {
+    const uint8_t* data = cast(const uint8_t*) header;
+    return header && hash_bytes(data + sizeof(MeshCacheHeader), header->file_size - sizeof(MeshCacheHeader)) ==
+                         header->data_hash;
+}
+
+bool write_mesh_cache(const char* path, const SourceStamp& source, const MeshData& mesh, const MeshLods* lods,
+                      const Meshlet* meshlets, size_t meshlet_count, const ClusterDag* dag) {
+    const std::vector<uint32_t>& lod_indices = lods ? lods->indices : mesh.indices;
+    const size_t cluster_count = dag ? dag->clusters.size() : 0;
+    const size_t cluster_index_count = dag ? dag->indices.size() : 0;
+    const size_t index_count = lod_indices.size() + cluster_index_count;
+
+    const size_t vertex_count = mesh.vertex_count();
+    const size_t position_bytes = vertex_count * 3 * sizeof(float);
+    const size_t color_bytes = vertex_count * 4;
+
+    const size_t positions_at = align_up(sizeof(MeshCacheHeader));
+    const size_t colors_at = positions_at + position_bytes;
+    const size_t indices_at = align_up(colors_at + color_bytes);
+    const size_t meshlets_at = align_up(indices_at + index_count * sizeof(uint32_t));
+    const size_t clusters_at = align_up(meshlets_at + meshlet_count * sizeof(Meshlet));
+    const size_t size = clusters_at + cluster_count * sizeof(Cluster);
+
+    std::vector<uint8_t> data(size, 0);
+
+    memcpy(data.data() + positions_at, mesh.positions.data(), position_bytes);
+
+    uint8_t* colors = data.data() + colors_at;
+    for (size_t i = 0; i < vertex_count; i++) {
+        for (int c = 0; c < 3; c++) colors[i * 4 + c] = quantize_unorm8(mesh.colors[i * 3 + c]);
+        colors[i * 4 + 3] = 255;
+    }
+    memcpy(data.data() + indices_at, lod_indices.data(), lod_indices.size() * sizeof(uint32_t));
+    if (cluster_index_count) {
+        memcpy(data.data() + indices_at + lod_indices.size() * sizeof(uint32_t), dag->indices.data(),
+               cluster_index_count * sizeof(uint32_t));
+    }
+    if (meshlet_count) memcpy(data.data() + meshlets_at, meshlets, meshlet_count * sizeof(Meshlet));
+    if (cluster_count) memcpy(data.data() + clusters_at, dag->clusters.data(), cluster_count * sizeof(Cluster));
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.file_size = size;
+    header.source = source;
+    header.data_hash = hash_bytes(data.data() + sizeof(MeshCacheHeader), size - sizeof(MeshCacheHeader));
+    header.vertex_count = mesh.vertex_count();
+    header.index_count = mesh.index_count();
+
+    if (lods) {
+        header.lod_count = lods->count;
+        memcpy(header.lods, lods->lods, lods->count * sizeof(MeshLod));
+    } else {
+        header.lod_count = 1;
+        header.lods[0] = MeshLod{0, cast(uint32_t) mesh.index_count(), 0.0f};
+    }
+    header.lod_index_count = lod_indices.size();
+    header.meshlet_count = meshlet_count;
+    header.cluster_count = cluster_count;
+    header.cluster_index_count = cluster_index_count;
+
+    Aabb bounds = mesh.bounds();
+    header.bounds_min[0] = bounds.min.x;
+    header.bounds_min[1] = bounds.min.y;
+    header.bounds_min[2] = bounds.min.z;
+    header.bounds_max[0] = bounds.max.x;
+    header.bounds_max[1] = bounds.max.y;
+    header.bounds_max[2] = bounds.max.z;
+
+    // relative to where the fields end up in the file
+    header.positions.offset = vertex_count ? positions_at - offsetof(MeshCacheHeader, positions) : 0;
+    header.colors.offset = vertex_count ? colors_at - offsetof(MeshCacheHeader, colors) : 0;
+    header.indices.offset = index_count ? indices_at - offsetof(MeshCacheHeader, indices) : 0;
+    header.meshlets.offset = meshlet_count ? meshlets_at - offsetof(MeshCacheHeader, meshlets) : 0;
+    header.clusters.offset = cluster_count ? clusters_at - offsetof(MeshCacheHeader, clusters) : 0;
+
+    memcpy(data.data(), &header, sizeof(header));
+
+    return write_file(path, data.data(), size);
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <bit>
+
+#include "math.hh"
+#include "file.hh"
+#include "mesh.hh"
+#include "lod.hh"
+#include "meshlet.hh"
+#include "cluster.hh"
+
+struct MeshLods;
+struct ClusterDag;
+
+// The binary mesh format the cooker writes and the runtime maps. Everything
+// is little-endian and aligned to MESH_CACHE_ALIGNMENT inside the file, and
+// the arrays are found through offsets relative to the header fields that
+// point at them, so the mapped file is used as it is: no parsing, no copies,
+// the pointers go straight to GL.
+//
+//   MeshCacheHeader | pad | positions (xyz f32) | colors (rgba unorm8) | pad | indices (u32) | pad | meshlets
+//   | pad | clusters
+//
+// The positions and colors are contiguous, the same layout
+// GpuResources::create_mesh builds, so the vertices are one blob too. The
+// positions stay float, the CPU culling and occlusion read them as well; the
+// colors only go to the GPU and are quantized. The indices are those of
+// every level of detail one after the other, the header has their ranges;
+// those of LOD 0 are in meshlet order, the meshlets are ranges of it. Those
+// of the cluster DAG follow, level 0 of it is the meshlets again. Its levels
+// are in order, the finer ones last in the file, which a runtime that only
+// streams in the levels it needs never has to touch.
+
+static_assert(std::endian::native == std::endian::little, "the cache files are little-endian");
+
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4D504C47;  // "GLPM"
+// bump whenever the layout changes, old files are rebuilt then
+constexpr uint32_t MESH_CACHE_VERSION = 5;
+constexpr size_t MESH_CACHE_ALIGNMENT = 16;
+
+// an offset in bytes from the field itself, 0 for null
+template <typename T>
+struct RelPtr {
+    inline const T* get() const {
+        return offset ? cast(const T*) (cast(const uint8_t*) this + offset) : nullptr;
+    }
+
+    int64_t offset;
+};
+
+// what a cache remembers of the file it was cooked from; the size and the
+// modification time are the quick check, the hash decides when they differ
+struct SourceStamp {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+};
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+
+    SourceStamp source;
+    // of everything after the header
+    uint64_t data_hash;
+
+    uint64_t vertex_count;
+    // of LOD 0
+    uint64_t index_count;
+    float bounds_min[3];
+    float bounds_max[3];
+
+    RelPtr<float> positions;
+    RelPtr<uint8_t> colors;
+    RelPtr<uint32_t> indices;
+
+    uint32_t lod_count;
+    uint32_t reserved;
+    // of all the LODs
+    uint64_t lod_index_count;
+    MeshLod lods[MESH_MAX_LODS];
+
+    // of LOD 0, none if it's too small to be worth culling in parts
+    RelPtr<Meshlet> meshlets;
+    uint64_t meshlet_count;
+
+    // the DAG over the meshlets, ordered by level; none without meshlets
+    RelPtr<Cluster> clusters;
+    uint64_t cluster_count;
+    // after the LODs' indices, of the levels above 0
+    uint64_t cluster_index_count;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 264, "the header is part of the file format");
+
+// the size and modification time of `path`, and its hash if `with_hash`; false if it can't be read
+bool stamp_source(const char* path, SourceStamp* out, bool with_hash);
+
+// A mapped cache file, or one already in memory (out of a pack). Only valid
+// as long as the data is, the arrays point into it.
+struct MeshCache {
+    // false if `path` doesn't exist, is broken or from another version, or
+    // `source_path` changed since it was cooked; only the broken ones are
+    // reported on stderr, the rest are ordinary cache misses
+    bool open(const char* path, const char* source_path);
+
+    // the same checks on `size` bytes at `data`, aligned to
+    // MESH_CACHE_ALIGNMENT, except for the source, which a pack doesn't come
+    // with; `name` is for the messages
+    bool load(const uint8_t* data, size_t size, const char* name);
+
+    // hashes the data again and compares it with the header. The cooker does
+    // it before it trusts a cache to be up to date; built with
+    // -DGLPG_VERIFY_CACHE, `load` and `open` do it for every cache too
+    bool verify() const;
+
+    inline size_t vertex_count() const {
+        return header->vertex_count;
+    }
+
+    inline size_t index_count() const {
+        return header->index_count;
+    }
+
+    inline Aabb bounds() const {
+        return Aabb{Vec3{header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]},
+                    Vec3{header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]}};
+    }
+
+    inline const float* positions() const {
+        return header->positions.get();
+    }
+
+    inline const uint8_t* colors() const {
+        return header->colors.get();
+    }
+
+    inline const uint32_t* indices() const {
+        return header->indices.get();
+    }
+
+    inline uint32_t lod_count() const {
+        return header->lod_count;
+    }
+
+    inline const MeshLod* lods() const {
+        return header->lods;
+    }
+
+    inline size_t lod_index_count() const {
+        return header->lod_index_count;
+    }
+
+    inline const Meshlet* meshlets() const {
+        return header->meshlets.get();
+    }
+
+    inline size_t meshlet_count() const {
+        return header->meshlet_count;
+    }
+
+    inline const Cluster* clusters() const {
+        return header->clusters.get();
+    }
+
+    inline size_t cluster_count() const {
+        return header->cluster_count;
+    }
+
+    inline size_t cluster_index_count() const {
+        return header->cluster_index_count;
+    }
+
+    MappedFile file;
+    const MeshCacheHeader* header = nullptr;
+};
+
+// writes `mesh` to `path` stamped with `source`, atomically (a reader never
+// sees half a file); false with the reason on stderr. Without `lods` the mesh
+// is its only LOD, otherwise their indices replace the mesh's. The meshlets
+// have to be ranges of LOD 0, and `dag` built over them after `lods`.
+bool write_mesh_cache(const char* path, const SourceStamp& source, const MeshData& mesh,
+                      const MeshLods* lods = nullptr, const Meshlet* meshlets = nullptr, size_t meshlet_count = 0,
+                      const ClusterDag* dag = nullptr);
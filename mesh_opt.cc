@@ -0,0 +1,431 @@
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+#include "mesh_opt.hh"
+
+// scores from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+constexpr float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+constexpr float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+// the scores only depend on small integers, so they're looked up
+constexpr int FORSYTH_MAX_VALENCE = 32;
+
+struct ForsythTables {
+    ForsythTables() {
+        for (int i = 0; i < VERTEX_CACHE_SIZE; i++) {
+            // NOTE: the vertices of the last triangle get a fixed score, so it isn't picked again right away
+            if (i < 3) {
+                cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+            } else {
+                float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+                cache[i] = powf(1.0f - (i - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+            }
+        }
+
+        valence[0] = 0.0f;
+        for (int i = 1; i < FORSYTH_MAX_VALENCE; i++) {
+            valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf(i, -FORSYTH_VALENCE_BOOST_POWER);
+        }
+    }
+
+    float cache[VERTEX_CACHE_SIZE];
+    float valence[FORSYTH_MAX_VALENCE];
+};
+
+static const ForsythTables forsyth;
+
+static inline float vertex_score(int cache_position, uint32_t remaining) {
+    // no triangles left means the vertex doesn't matter anymore
+    if (remaining == 0) return -1.0f;
+
+    float score = cache_position >= 0 ? forsyth.cache[cache_position] : 0.0f;
+    return score + forsyth.valence[remaining < FORSYTH_MAX_VALENCE ? remaining : FORSYTH_MAX_VALENCE - 1];
+}
+
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+    const size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) return;
+
+    // the triangles of every vertex, CSR style: vertex v has adjacency[offsets[v] .. offsets[v + 1])
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++) offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    // the first `remaining[v]` entries of a vertex's list are its triangles that weren't emitted yet
+    std::vector<uint32_t> remaining(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) remaining[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) score[v] = vertex_score(-1, remaining[v]);
+
+    std::vector<float> triangle_score(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> output(triangle_count * 3);
+
+    // NOTE: one extra slot per corner, the triangle's vertices are pushed in before the cache is trimmed
+    uint32_t cache[VERTEX_CACHE_SIZE + 3];
+    int cache_count = 0;
+
+    // where the scan for the best triangle continues when the cache has nothing left to offer
+    size_t scan = 0;
+
+    int64_t best = -1;
+    for (size_t t = 0; t < triangle_count; t++) {
+        if (best < 0 || triangle_score[t] > triangle_score[best]) best = t;
+    }
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+        if (best < 0) {
+            // NOTE: every triangle around the cache is done, the next best is as good as any
+            while (emitted[scan]) scan++;
+            best = scan;
+        }
+
+        const uint32_t* tri = &indices[best * 3];
+        memcpy(&output[emitted_count * 3], tri, 3 * sizeof(uint32_t));
+        emitted[best] = true;
+
+        // the triangle's vertices go to the front of the cache, the rest move back
+        uint32_t next[VERTEX_CACHE_SIZE + 3];
+        int next_count = 0;
+        for (int c = 0; c < 3; c++) {
+            // NOTE: degenerate triangles name a vertex twice, it only takes one slot
+            if ((c > 0 && tri[c] == tri[0]) || (c > 1 && tri[c] == tri[1])) continue;
+            next[next_count++] = tri[c];
+        }
+        for (int i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) next[next_count++] = v;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = tri[c];
+
+            // move the triangle out of the vertex's live range
+            uint32_t* begin = &adjacency[offsets[v]];
+            uint32_t live = remaining[v];
+            for (uint32_t i = 0; i < live; i++) {
+                if (begin[i] == best) {
+                    begin[i] = begin[live - 1];
+                    begin[live - 1] = best;
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        cache_count = next_count < VERTEX_CACHE_SIZE ? next_count : VERTEX_CACHE_SIZE;
+        memcpy(cache, next, next_count * sizeof(uint32_t));
+
+        // NOTE: only the triangles around the cache change score, so only those are looked at;
+        // the vertices pushed out of it lose their cache score here too
+        for (int i = 0; i < next_count; i++) {
+            uint32_t v = next[i];
+            cache_position[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+
+            float new_score = vertex_score(cache_position[v], remaining[v]);
+            float delta = new_score - score[v];
+            score[v] = new_score;
+
+            for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; a++) triangle_score[adjacency[a]] += delta;
+        }
+
+        best = -1;
+        for (int i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                uint32_t t = adjacency[a];
+                if (best < 0 || triangle_score[t] > triangle_score[best]) best = t;
+            }
+        }
+    }
+
+    memcpy(indices, output.data(), triangle_count * 3 * sizeof(uint32_t));
+}
+
+std::vector<uint32_t> weld_positions(const MeshData& mesh) {
+    std::vector<uint32_t> point(mesh.vertex_count());
+    std::unordered_map<uint64_t, uint32_t> first;
+    first.reserve(mesh.vertex_count());
+
+    for (uint32_t v = 0; v < mesh.vertex_count(); v++) {
+        const float* p = &mesh.positions[v * 3];
+        uint32_t bits[3];
+        memcpy(bits, p, sizeof(bits));
+
+        // NOTE: a hash collision just ends up in a linear search of the next keys
+        uint64_t key = (cast(uint64_t) bits[0] * 0x9E3779B1) ^ (cast(uint64_t) bits[1] << 21) ^
+                       (cast(uint64_t) bits[2] * 0x85EBCA77 << 11);
+        for (;; key++) {
+            auto [at, inserted] = first.try_emplace(key, v);
+            if (inserted || memcmp(&mesh.positions[at->second * 3], p, 3 * sizeof(float)) == 0) {
+                point[v] = at->second;
+                break;
+            }
+        }
+    }
+
+    return point;
+}
+
+std::unordered_map<uint64_t, uint32_t> count_edges(const uint32_t* indices, size_t index_count,
+                                                   const std::vector<uint32_t>& point) {
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(index_count);
+    for (size_t i = 0; i < index_count; i += 3) {
+        for (int e = 0; e < 3; e++) {
+            uint32_t a = point[indices[i + e]];
+            uint32_t b = point[indices[i + (e + 1) % 3]];
+            edges[cast(uint64_t) a << 32 | b]++;
+        }
+    }
+
+    return edges;
+}
+
+static inline Vec3 mesh_position(const MeshData& mesh, uint32_t v) {
+    return Vec3{mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2]};
+}
+
+// twice the area along the normal, for counterclockwise triangles
+static inline Vec3 triangle_normal(const MeshData& mesh, const uint32_t* t) {
+    Vec3 p0 = mesh_position(mesh, t[0]);
+    Vec3 n = mesh_position(mesh, t[1]) - p0;
+    n.cross(mesh_position(mesh, t[2]) - p0);
+    return n;
+}
+
+std::vector<Meshlet> build_meshlets(MeshData& mesh, uint32_t max_vertices) {
+    const size_t triangle_count = mesh.index_count() / 3;
+    const uint32_t* indices = mesh.indices.data();
+
+    std::vector<uint32_t> point = weld_positions(mesh);
+
+    // closed: every edge between two points belongs to one triangle each way
+    bool closed = true;
+    {
+        std::unordered_map<uint64_t, uint32_t> edges = count_edges(indices, triangle_count * 3, point);
+        for (const auto& [key, count] : edges) {
+            auto reverse = edges.find(key << 32 | key >> 32);
+            if (count != 1 || reverse == edges.end() || reverse->second != 1) {
+                closed = false;
+                break;
+            }
+        }
+    }
+
+    // the cones point out of the mesh, whichever way its triangles are wound
+    float outwards = 1.0f;
+    if (closed) {
+        double volume = 0;
+        for (size_t t = 0; t < triangle_count; t++) {
+            Vec3 n = triangle_normal(mesh, indices + t * 3);
+            volume += (n * mesh_position(mesh, indices[t * 3])).sum();
+        }
+        if (volume < 0) outwards = -1.0f;
+    }
+
+    // the triangles around every point, CSR style like optimize_vertex_cache
+    std::vector<uint32_t> offsets(mesh.vertex_count() + 1, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++) offsets[point[indices[i]] + 1]++;
+    for (size_t v = 0; v < mesh.vertex_count(); v++) offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; i++) adjacency[fill[point[indices[i]]]++] = i / 3;
+
+    std::vector<bool> used(triangle_count, false);
+    // the meshlet a vertex or candidate triangle was last added to, plus one
+    std::vector<uint32_t> vertex_meshlet(mesh.vertex_count(), 0);
+    std::vector<uint32_t> candidate_meshlet(triangle_count, 0);
+
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> candidates;
+    size_t next_seed = 0;
+
+    for (;;) {
+        while (next_seed < triangle_count && used[next_seed]) next_seed++;
+        if (next_seed == triangle_count) break;
+
+        const uint32_t id = meshlets.size() + 1;
+        triangles.clear();
+        vertices.clear();
+        candidates.clear();
+        Vec3 centroid_sum = {0, 0, 0};
+
+        // NOTE: grows from the first triangle left, which is near the last meshlet in vertex cache order, with the
+        // neighbour that adds the fewest vertices and is closest to the middle, so meshlets come out round
+        uint32_t next = next_seed;
+        while (next != UINT32_MAX) {
+            used[next] = true;
+            triangles.push_back(next);
+            for (int c = 0; c < 3; c++) {
+                uint32_t v = indices[next * 3 + c];
+                centroid_sum += mesh_position(mesh, v);
+                if (vertex_meshlet[v] != id) {
+                    vertex_meshlet[v] = id;
+                    vertices.push_back(v);
+                }
+
+                for (uint32_t a = offsets[point[v]]; a < offsets[point[v] + 1]; a++) {
+                    uint32_t t = adjacency[a];
+                    if (used[t] || candidate_meshlet[t] == id) continue;
+
+                    candidate_meshlet[t] = id;
+                    candidates.push_back(t);
+                }
+            }
+
+            if (triangles.size() == MESHLET_MAX_TRIANGLES) break;
+
+            const Vec3 centroid = centroid_sum * (1.0f / (triangles.size() * 3));
+
+            next = UINT32_MAX;
+            int best_new = 0;
+            float best_distance = 0;
+            size_t kept = 0;
+            for (uint32_t t : candidates) {
+                if (used[t]) continue;
+                candidates[kept++] = t;
+
+                int new_vertices = 0;
+                Vec3 middle = {0, 0, 0};
+                for (int c = 0; c < 3; c++) {
+                    new_vertices += vertex_meshlet[indices[t * 3 + c]] != id;
+                    middle += mesh_position(mesh, indices[t * 3 + c]);
+                }
+                if (vertices.size() + new_vertices > max_vertices) continue;
+
+                Vec3 d = middle * (1.0f / 3) - centroid;
+                float distance = (d * d).sum();
+                if (next == UINT32_MAX || new_vertices < best_new ||
+                    (new_vertices == best_new && distance < best_distance)) {
+                    next = t;
+                    best_new = new_vertices;
+                    best_distance = distance;
+                }
+            }
+            candidates.resize(kept);
+        }
+
+        Meshlet meshlet = {};
+        meshlet.first_index = output.size();
+        meshlet.index_count = triangles.size() * 3;
+
+        Aabb box = Aabb::empty();
+        for (uint32_t v : vertices) box.grow(mesh_position(mesh, v));
+        Vec3 center = box.center();
+        float radius_squared = 0;
+        for (uint32_t v : vertices) {
+            Vec3 d = mesh_position(mesh, v) - center;
+            radius_squared = fmaxf(radius_squared, (d * d).sum());
+        }
+        meshlet.center[0] = center.x;
+        meshlet.center[1] = center.y;
+        meshlet.center[2] = center.z;
+        meshlet.radius = sqrtf(radius_squared);
+
+        // the mean of the normals, and the widest angle any of them makes with it
+        Vec3 axis = {0, 0, 0};
+        for (uint32_t t : triangles) {
+            Vec3 n = triangle_normal(mesh, indices + t * 3);
+            float length = n.length();
+            if (length > 0) axis += n * (outwards / length);
+        }
+
+        meshlet.cone_cos = -1.0f;
+        if (closed && axis.length() > 0) {
+            axis.norm();
+
+            float cone_cos = 1.0f;
+            for (uint32_t t : triangles) {
+                Vec3 n = triangle_normal(mesh, indices + t * 3);
+                float length = n.length();
+                if (length > 0) cone_cos = fminf(cone_cos, (n * axis).sum() * outwards / length);
+            }
+
+            meshlet.cone_axis[0] = axis.x;
+            meshlet.cone_axis[1] = axis.y;
+            meshlet.cone_axis[2] = axis.z;
+            meshlet.cone_cos = cone_cos;
+            meshlet.cone_sin = sqrtf(fmaxf(1.0f - cone_cos * cone_cos, 0.0f));
+        }
+
+        // NOTE: ordered with the meshlet's vertices numbered from 0, the whole mesh's would cost a pass over every
+        // vertex per meshlet
+        uint32_t local[MESHLET_MAX_TRIANGLES * 3];
+        for (size_t i = 0; i < triangles.size() * 3; i++) {
+            uint32_t v = indices[triangles[i / 3] * 3 + i % 3];
+            local[i] = std::find(vertices.begin(), vertices.end(), v) - vertices.begin();
+        }
+        optimize_vertex_cache(local, meshlet.index_count, vertices.size());
+        for (uint32_t i = 0; i < meshlet.index_count; i++) output.push_back(vertices[local[i]]);
+
+        meshlets.push_back(meshlet);
+    }
+
+    mesh.indices = std::move(output);
+    return meshlets;
+}
+
+void optimize_vertex_fetch(MeshData& mesh) {
+    constexpr uint32_t UNUSED = UINT32_MAX;
+
+    std::vector<uint32_t> remap(mesh.vertex_count(), UNUSED);
+    uint32_t next = 0;
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == UNUSED) remap[index] = next++;
+        index = remap[index];
+    }
+
+    std::vector<float> positions(next * 3);
+    std::vector<float> colors(next * 3);
+    for (size_t v = 0; v < remap.size(); v++) {
+        if (remap[v] == UNUSED) continue;
+
+        memcpy(&positions[remap[v] * 3], &mesh.positions[v * 3], 3 * sizeof(float));
+        memcpy(&colors[remap[v] * 3], &mesh.colors[v * 3], 3 * sizeof(float));
+    }
+
+    mesh.positions = std::move(positions);
+    mesh.colors = std::move(colors);
+}
+
+float average_cache_miss_ratio(const uint32_t* indices, size_t index_count, size_t vertex_count, int cache_size) {
+    if (index_count < 3) return 0.0f;
+
+    // NOTE: a FIFO by timestamps, a vertex is in the cache if it was loaded less than `cache_size` misses ago
+    std::vector<size_t> loaded_at(vertex_count, 0);
+    size_t misses = 0;
+
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (loaded_at[v] == 0 || misses - loaded_at[v] >= cast(size_t) cache_size) {
+            misses++;
+            loaded_at[v] = misses;
+        }
+    }
+
+    return cast(float) misses / (index_count / 3);
+}
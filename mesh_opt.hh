@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.hh"
+#include "meshlet.hh"
+
+// Offline mesh optimizations, run by the cooker so the runtime gets meshes
+// that are already in the best order for the GPU.
+
+// the post-transform cache the orderings are tuned for, in vertices
+constexpr int VERTEX_CACHE_SIZE = 32;
+
+// Reorders the triangles so neighbouring ones share vertices that are still
+// in the post-transform cache (Forsyth's linear-speed algorithm). The
+// triangles stay the same, only their order changes.
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Splits the triangles into meshlets of neighbouring ones and reorders them
+// so every meshlet's are one range of the indices, in vertex cache order.
+// Only closed meshes get cones that can cull, the back of an open one shows.
+// At most `max_vertices` vertices, up to MESHLET_MAX_TRIANGLES * 3, go into
+// one meshlet.
+std::vector<Meshlet> build_meshlets(MeshData& mesh, uint32_t max_vertices = MESHLET_MAX_VERTICES);
+
+// The first vertex at the position of every vertex, so vertices that only
+// differ in color (on both sides of a seam) are one point of the surface.
+std::vector<uint32_t> weld_positions(const MeshData& mesh);
+
+// How often every directed edge between the points `point` maps the vertices
+// to is used, keyed `a << 32 | b`. Where the surface is closed every edge is
+// used once each way.
+std::unordered_map<uint64_t, uint32_t> count_edges(const uint32_t* indices, size_t index_count,
+                                                   const std::vector<uint32_t>& point);
+
+// Renumbers the vertices in the order the triangles first use them, so the
+// vertex fetch walks the buffers forward; unused vertices are dropped.
+void optimize_vertex_fetch(MeshData& mesh);
+
+// average vertex shader runs per triangle with a FIFO cache of `cache_size`,
+// 3 is the worst and about 0.5 the best a regular grid can do
+float average_cache_miss_ratio(const uint32_t* indices, size_t index_count, size_t vertex_count, int cache_size);
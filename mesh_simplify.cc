@@ -0,0 +1,548 @@
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+#include "mesh_simplify.hh"
+#include "mesh_opt.hh"
+
+// what losing a whole color costs, in squared mesh units
+constexpr double SIMPLIFY_COLOR_WEIGHT = 0.01;
+// a collapse may cost this much more than the cheapest ones a pass is after
+constexpr double SIMPLIFY_ERROR_SLACK = 1.5;
+
+// LODs stop at this many triangles, or once one isn't at least this much smaller than the one before
+constexpr size_t LOD_MIN_TRIANGLES = 64;
+constexpr double LOD_MIN_REDUCTION = 0.8;
+
+// clusters of the DAG are simplified in groups of this many, halving their triangles
+constexpr size_t CLUSTER_GROUP_SIZE = 8;
+// the DAG stops once a level isn't at least this much smaller than the one below, the outlines of the groups
+// are locked and there is only so much left to take away
+constexpr double CLUSTER_MIN_REDUCTION = 0.85;
+
+// The sum of the squared distances to a set of planes, weighted by the
+// triangle areas they came from: p'Ap + 2b'p + c.
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+struct DVec3 {
+    double x, y, z;
+};
+
+static inline DVec3 sub(DVec3 a, DVec3 b) {
+    return DVec3{a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static inline DVec3 cross(DVec3 a, DVec3 b) {
+    return DVec3{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static inline double dot(DVec3 a, DVec3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static void add_plane(Quadric& q, DVec3 n, double d, double w) {
+    q.a00 += w * n.x * n.x;
+    q.a01 += w * n.x * n.y;
+    q.a02 += w * n.x * n.z;
+    q.a11 += w * n.y * n.y;
+    q.a12 += w * n.y * n.z;
+    q.a22 += w * n.z * n.z;
+    q.b0 += w * n.x * d;
+    q.b1 += w * n.y * d;
+    q.b2 += w * n.z * d;
+    q.c += w * d * d;
+    q.weight += w;
+}
+
+static void add(Quadric& q, const Quadric& other) {
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a22 += other.a22;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// the weighted mean squared distance of `p` to the planes
+static double evaluate(const Quadric& q, DVec3 p) {
+    double r = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z +
+               2 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z) +
+               2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+
+    // NOTE: rounding makes it slightly negative at times
+    return q.weight > 0 && r > 0 ? r / q.weight : 0;
+}
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+std::vector<uint32_t> simplify_mesh(const MeshData& mesh, size_t target_index_count, float* error) {
+    const size_t vertex_count = mesh.vertex_count();
+    std::vector<uint32_t> indices = mesh.indices;
+
+    auto position = [&](uint32_t v) {
+        const float* p = &mesh.positions[v * 3];
+        return DVec3{p[0], p[1], p[2]};
+    };
+
+    // vertices at the same spot are one point of the surface; only the first of them is used as a key
+    std::vector<uint32_t> point = weld_positions(mesh);
+    std::vector<uint32_t> point_size(vertex_count, 0);
+    for (uint32_t v = 0; v < vertex_count; v++) point_size[point[v]]++;
+
+    // locked: where colors meet, on a border, or where more than two triangles share an edge
+    std::vector<bool> locked(vertex_count, false);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        if (point_size[point[v]] > 1) locked[v] = true;
+    }
+    {
+        std::unordered_map<uint64_t, uint32_t> edges = count_edges(indices.data(), indices.size(), point);
+
+        for (const auto& [key, count] : edges) {
+            uint32_t a = cast(uint32_t) (key >> 32);
+            uint32_t b = cast(uint32_t) key;
+            auto reverse = edges.find(cast(uint64_t) b << 32 | a);
+            if (count != 1 || reverse == edges.end() || reverse->second != 1) {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+
+        for (uint32_t v = 0; v < vertex_count; v++) {
+            if (locked[point[v]]) locked[v] = true;
+        }
+    }
+
+    // the planes of every triangle around a point, the longer the edges the more they count
+    std::vector<Quadric> quadrics(vertex_count, Quadric{});
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        DVec3 p0 = position(indices[i]);
+        DVec3 n = cross(sub(position(indices[i + 1]), p0), sub(position(indices[i + 2]), p0));
+        double area = sqrt(dot(n, n));
+        if (area == 0) continue;
+
+        n = DVec3{n.x / area, n.y / area, n.z / area};
+        double d = -dot(n, p0);
+        for (int c = 0; c < 3; c++) add_plane(quadrics[point[indices[i + c]]], n, d, area);
+    }
+
+    auto color_distance = [&](uint32_t a, uint32_t b) {
+        const float* ca = &mesh.colors[a * 3];
+        const float* cb = &mesh.colors[b * 3];
+        double dr = ca[0] - cb[0], dg = ca[1] - cb[1], db = ca[2] - cb[2];
+        return dr * dr + dg * dg + db * db;
+    };
+
+    double max_cost = 0;
+
+    std::vector<uint32_t> offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> collapse_to(vertex_count);
+    std::vector<bool> touched(vertex_count);
+    std::vector<Collapse> candidates;
+
+    // NOTE: in passes, every one collapses a batch of the cheapest edges that don't touch each other, then
+    // rebuilds the triangles; a vertex's neighbourhood only changes between passes
+    while (indices.size() > target_index_count) {
+        const size_t triangle_count = indices.size() / 3;
+
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint32_t v : indices) offsets[v + 1]++;
+        for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+
+        adjacency.resize(indices.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = cast(uint32_t) (i / 3);
+
+        candidates.clear();
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int e = 0; e < 3; e++) {
+                uint32_t a = indices[i + e];
+                uint32_t b = indices[i + (e + 1) % 3];
+
+                for (int direction = 0; direction < 2; direction++) {
+                    if (!locked[a]) {
+                        Quadric q = quadrics[point[a]];
+                        add(q, quadrics[point[b]]);
+
+                        double cost = evaluate(q, position(b)) + SIMPLIFY_COLOR_WEIGHT * color_distance(a, b);
+                        candidates.push_back(Collapse{a, b, cost});
+                    }
+                    std::swap(a, b);
+                }
+            }
+        }
+
+        if (candidates.empty()) break;
+
+        // every collapse takes away about two triangles
+        const size_t goal = std::max<size_t>(1, (indices.size() - target_index_count) / 6);
+        const size_t cheap = std::min(goal, candidates.size()) - 1;
+        std::nth_element(candidates.begin(), candidates.begin() + cheap, candidates.end(),
+                         [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+        const double limit = candidates[cheap].cost * SIMPLIFY_ERROR_SLACK + 1e-12;
+
+        // only the ones under the limit can go this pass
+        auto cheap_end = std::partition(candidates.begin(), candidates.end(),
+                                        [limit](const Collapse& c) { return c.cost <= limit; });
+        std::sort(candidates.begin(), cheap_end, [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+        candidates.erase(cheap_end, candidates.end());
+
+        for (uint32_t v = 0; v < vertex_count; v++) collapse_to[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t collapses = 0;
+        for (const Collapse& collapse : candidates) {
+            if (collapses >= goal) break;
+
+            const uint32_t a = collapse.from;
+            const uint32_t b = collapse.to;
+            if (touched[a] || touched[b]) continue;
+
+            // no triangle around `a` may turn over when it moves to `b`
+            bool flips = false;
+            const DVec3 pb = position(b);
+            for (uint32_t k = offsets[a]; k < offsets[a + 1] && !flips; k++) {
+                const uint32_t* t = &indices[adjacency[k] * 3];
+                if (t[0] == b || t[1] == b || t[2] == b) continue;
+
+                // the triangle turned so `a` comes first
+                const int c = t[0] == a ? 0 : t[1] == a ? 1 : 2;
+                DVec3 p1 = position(t[(c + 1) % 3]);
+                DVec3 p2 = position(t[(c + 2) % 3]);
+                DVec3 pa = position(a);
+
+                DVec3 before = cross(sub(p1, pa), sub(p2, pa));
+                DVec3 after = cross(sub(p1, pb), sub(p2, pb));
+                if (dot(before, after) <= 0) flips = true;
+            }
+            if (flips) continue;
+
+            collapse_to[a] = b;
+            add(quadrics[point[b]], quadrics[point[a]]);
+            if (collapse.cost > max_cost) max_cost = collapse.cost;
+            collapses++;
+
+            // the whole neighbourhood of `a` changed, nothing else in it moves this pass
+            for (uint32_t k = offsets[a]; k < offsets[a + 1]; k++) {
+                const uint32_t* t = &indices[adjacency[k] * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+            }
+        }
+
+        if (collapses == 0) break;
+
+        // NOTE: a triangle with two corners at one point has no area anymore
+        size_t out = 0;
+        for (size_t t = 0; t < triangle_count; t++) {
+            uint32_t v0 = collapse_to[indices[t * 3]];
+            uint32_t v1 = collapse_to[indices[t * 3 + 1]];
+            uint32_t v2 = collapse_to[indices[t * 3 + 2]];
+            if (point[v0] == point[v1] || point[v1] == point[v2] || point[v0] == point[v2]) continue;
+
+            indices[out++] = v0;
+            indices[out++] = v1;
+            indices[out++] = v2;
+        }
+        indices.resize(out);
+    }
+
+    *error = cast(float) sqrt(max_cost);
+    return indices;
+}
+
+void build_lods(const MeshData& mesh, MeshLods* out) {
+    out->indices = mesh.indices;
+    out->lods[0] = MeshLod{0, cast(uint32_t) mesh.index_count(), 0.0f};
+    out->count = 1;
+
+    size_t previous = mesh.index_count();
+    while (out->count < MESH_MAX_LODS && previous / 3 >= LOD_MIN_TRIANGLES * 2) {
+        // NOTE: always from the full mesh, so the error is against it and not against the last LOD
+        float error;
+        std::vector<uint32_t> indices = simplify_mesh(mesh, previous / 2, &error);
+        if (indices.size() > previous * LOD_MIN_REDUCTION) break;
+
+        optimize_vertex_cache(indices.data(), indices.size(), mesh.vertex_count());
+
+        out->lods[out->count++] = MeshLod{cast(uint32_t) out->indices.size(), cast(uint32_t) indices.size(), error};
+        out->indices.insert(out->indices.end(), indices.begin(), indices.end());
+        previous = indices.size();
+    }
+}
+
+// grows `sphere` until it holds `other` too
+static void enclose(float* sphere, const float* other) {
+    Vec3 a = {sphere[0], sphere[1], sphere[2]};
+    Vec3 b = {other[0], other[1], other[2]};
+    float distance = (b - a).length();
+
+    if (distance + other[3] <= sphere[3]) return;
+    if (distance + sphere[3] <= other[3]) {
+        memcpy(sphere, other, 4 * sizeof(float));
+        return;
+    }
+
+    float radius = (distance + sphere[3] + other[3]) * 0.5f;
+    Vec3 center = a + (b - a) * ((radius - sphere[3]) / distance);
+    sphere[0] = center.x;
+    sphere[1] = center.y;
+    sphere[2] = center.z;
+    sphere[3] = radius;
+}
+
+// the clusters from `begin` to `end` in groups of about CLUSTER_GROUP_SIZE, each grown from the first cluster
+// left with the neighbours it shares the most vertices with; `offsets` gets where each group starts, and where
+// the last one ends
+static std::vector<uint32_t> group_clusters(const std::vector<Cluster>& clusters, size_t begin, size_t end,
+                                            const std::vector<const uint32_t*>& cluster_indices,
+                                            std::vector<uint32_t>* offsets) {
+    const size_t count = end - begin;
+
+    // every vertex with the clusters that use it
+    std::vector<std::pair<uint32_t, uint32_t>> uses;
+    for (size_t k = 0; k < count; k++) {
+        const Meshlet& meshlet = clusters[begin + k].meshlet;
+        for (uint32_t i = 0; i < meshlet.index_count; i++) {
+            uses.push_back({cluster_indices[begin + k][i], cast(uint32_t) k});
+        }
+    }
+    std::sort(uses.begin(), uses.end());
+    uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+
+    std::vector<std::unordered_map<uint32_t, uint32_t>> shared(count);
+    for (size_t i = 0; i < uses.size();) {
+        size_t run_end = i;
+        while (run_end < uses.size() && uses[run_end].first == uses[i].first) run_end++;
+
+        for (size_t a = i; a < run_end; a++) {
+            for (size_t b = i; b < run_end; b++) {
+                if (a != b) shared[uses[a].second][uses[b].second]++;
+            }
+        }
+        i = run_end;
+    }
+
+    // the group of every cluster
+    std::vector<uint32_t> group(count, UINT32_MAX);
+    std::vector<uint32_t> group_size;
+    std::unordered_map<uint32_t, uint32_t> candidates;
+
+    for (uint32_t seed = 0; seed < count; seed++) {
+        if (group[seed] != UINT32_MAX) continue;
+
+        const uint32_t id = group_size.size();
+        group_size.push_back(0);
+        candidates.clear();
+
+        uint32_t next = seed;
+        while (group_size[id] < CLUSTER_GROUP_SIZE && next != UINT32_MAX) {
+            group[next] = id;
+            group_size[id]++;
+            for (const auto& [neighbour, vertices] : shared[next]) {
+                if (group[neighbour] == UINT32_MAX) candidates[neighbour] += vertices;
+            }
+
+            next = UINT32_MAX;
+            uint32_t best = 0;
+            for (const auto& [candidate, vertices] : candidates) {
+                if (group[candidate] != UINT32_MAX) continue;
+                if (vertices > best || (vertices == best && candidate < next)) {
+                    next = candidate;
+                    best = vertices;
+                }
+            }
+        }
+    }
+
+    // NOTE: the last clusters left around a spot end up in small groups, and alone their outline is all there is,
+    // nothing would ever simplify them; they join the neighbouring group they share the most vertices with
+    for (uint32_t k = 0; k < count; k++) {
+        if (group_size[group[k]] * 2 >= CLUSTER_GROUP_SIZE) continue;
+
+        uint32_t target = UINT32_MAX;
+        uint32_t best = 0;
+        candidates.clear();
+        for (const auto& [neighbour, vertices] : shared[k]) {
+            if (group[neighbour] != group[k]) candidates[group[neighbour]] += vertices;
+        }
+        for (const auto& [candidate, vertices] : candidates) {
+            if (vertices > best || (vertices == best && candidate < target)) {
+                target = candidate;
+                best = vertices;
+            }
+        }
+
+        if (target != UINT32_MAX) {
+            group_size[group[k]]--;
+            group_size[target]++;
+            group[k] = target;
+        }
+    }
+
+    // the groups that were emptied are dropped
+    std::vector<uint32_t> start(group_size.size(), 0);
+    offsets->assign(1, 0);
+    for (size_t g = 0; g < group_size.size(); g++) {
+        start[g] = offsets->back();
+        if (group_size[g]) offsets->push_back(offsets->back() + group_size[g]);
+    }
+
+    std::vector<uint32_t> groups(count);
+    for (uint32_t k = 0; k < count; k++) groups[start[group[k]]++] = begin + k;
+
+    return groups;
+}
+
+void build_cluster_dag(const MeshData& mesh, const std::vector<Meshlet>& meshlets, uint32_t first_index,
+                       ClusterDag* out) {
+    out->clusters.clear();
+    out->indices.clear();
+
+    for (const Meshlet& meshlet : meshlets) {
+        Cluster cluster = {};
+        cluster.meshlet = meshlet;
+        memcpy(cluster.lod_sphere, meshlet.center, 3 * sizeof(float));
+        cluster.lod_sphere[3] = meshlet.radius;
+        cluster.parent_error = FLT_MAX;
+        out->clusters.push_back(cluster);
+    }
+
+    std::vector<const uint32_t*> cluster_indices;
+    std::vector<uint32_t> offsets;
+    std::unordered_map<uint32_t, uint32_t> local;
+
+    size_t level_begin = 0;
+    for (uint32_t level = 1; level < CLUSTER_MAX_LEVELS; level++) {
+        const size_t level_end = out->clusters.size();
+        if (level_end - level_begin < 2) break;
+
+        // NOTE: looked up again every level, `out->indices` grows and moves
+        cluster_indices.resize(level_end);
+        for (size_t k = level_begin; k < level_end; k++) {
+            const Meshlet& meshlet = out->clusters[k].meshlet;
+            cluster_indices[k] = out->clusters[k].level == 0 ? &mesh.indices[meshlet.first_index]
+                                                            : &out->indices[meshlet.first_index - first_index];
+        }
+
+        std::vector<uint32_t> groups = group_clusters(out->clusters, level_begin, level_end, cluster_indices, &offsets);
+
+        std::vector<Cluster> next;
+        std::vector<uint32_t> next_indices;
+        // the sphere and error of every group, set on its clusters once the level is kept
+        std::vector<float> group_bounds;
+        // whether a group has clusters on the new level, those that simplified away have no parent to switch to
+        std::vector<uint8_t> group_kept(offsets.size() - 1, 0);
+        size_t triangles_before = 0;
+
+        for (size_t g = 0; g + 1 < offsets.size(); g++) {
+            // the group's triangles as a mesh of their own, where its outline is a border and stays put
+            MeshData part;
+            std::vector<uint32_t> global;
+            local.clear();
+            for (uint32_t at = offsets[g]; at < offsets[g + 1]; at++) {
+                const Cluster& cluster = out->clusters[groups[at]];
+                for (uint32_t i = 0; i < cluster.meshlet.index_count; i++) {
+                    uint32_t v = cluster_indices[groups[at]][i];
+                    auto [it, inserted] = local.try_emplace(v, cast(uint32_t) global.size());
+                    if (inserted) {
+                        global.push_back(v);
+                        part.positions.insert(part.positions.end(), &mesh.positions[v * 3], &mesh.positions[v * 3 + 3]);
+                        part.colors.insert(part.colors.end(), &mesh.colors[v * 3], &mesh.colors[v * 3 + 3]);
+                    }
+                    part.indices.push_back(it->second);
+                }
+            }
+            triangles_before += part.index_count() / 3;
+
+            float error;
+            part.indices = simplify_mesh(part, part.index_count() / 2, &error);
+
+            // NOTE: the errors add up, a group is measured against the one below and not against level 0
+            float sphere[4];
+            float child_error = 0;
+            memcpy(sphere, out->clusters[groups[offsets[g]]].lod_sphere, sizeof(sphere));
+            for (uint32_t at = offsets[g]; at < offsets[g + 1]; at++) {
+                enclose(sphere, out->clusters[groups[at]].lod_sphere);
+                child_error = fmaxf(child_error, out->clusters[groups[at]].error);
+            }
+            group_bounds.insert(group_bounds.end(), sphere, sphere + 4);
+            group_bounds.push_back(child_error + error);
+
+            if (part.indices.empty()) continue;
+            group_kept[g] = 1;
+
+            // NOTE: a group is open, so these get no cones; they're only drawn as index ranges, nothing needs their
+            // vertices to fit in a meshlet, and the simplified triangles are fewer per vertex than the full mesh's
+            std::vector<Meshlet> parts = build_meshlets(part, MESHLET_MAX_TRIANGLES * 3);
+
+            // NOTE: growing meshlets leaves scraps of a few triangles behind, those go to the meshlet before them,
+            // their ranges follow each other
+            size_t kept = 0;
+            for (size_t m = 0; m < parts.size(); m++) {
+                if (kept == 0 || parts[m].index_count / 3 >= MESHLET_MAX_TRIANGLES / 4) {
+                    parts[kept++] = parts[m];
+                    continue;
+                }
+
+                Meshlet& previous = parts[kept - 1];
+                float bounds[4] = {previous.center[0], previous.center[1], previous.center[2], previous.radius};
+                float scrap[4] = {parts[m].center[0], parts[m].center[1], parts[m].center[2], parts[m].radius};
+                enclose(bounds, scrap);
+                memcpy(previous.center, bounds, 3 * sizeof(float));
+                previous.radius = bounds[3];
+                previous.index_count += parts[m].index_count;
+            }
+            parts.resize(kept);
+
+            for (Meshlet meshlet : parts) {
+                meshlet.first_index += first_index + out->indices.size() + next_indices.size();
+
+                Cluster cluster = {};
+                cluster.meshlet = meshlet;
+                memcpy(cluster.lod_sphere, sphere, sizeof(sphere));
+                cluster.error = child_error + error;
+                cluster.parent_error = FLT_MAX;
+                cluster.level = level;
+                next.push_back(cluster);
+            }
+            for (uint32_t v : part.indices) next_indices.push_back(global[v]);
+        }
+
+        // the level below is the top one
+        if (next_indices.size() / 3 > triangles_before * CLUSTER_MIN_REDUCTION) break;
+
+        for (size_t g = 0; g + 1 < offsets.size(); g++) {
+            // NOTE: they stay at FLT_MAX and are drawn whenever their own error allows it
+            if (!group_kept[g]) continue;
+
+            for (uint32_t at = offsets[g]; at < offsets[g + 1]; at++) {
+                Cluster& cluster = out->clusters[groups[at]];
+                memcpy(cluster.parent_sphere, &group_bounds[g * 5], 4 * sizeof(float));
+                cluster.parent_error = group_bounds[g * 5 + 4];
+            }
+        }
+
+        out->clusters.insert(out->clusters.end(), next.begin(), next.end());
+        out->indices.insert(out->indices.end(), next_indices.begin(), next_indices.end());
+        level_begin = level_end;
+    }
+}
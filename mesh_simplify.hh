@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "mesh.hh"
+#include "lod.hh"
+#include "cluster.hh"
+
+// Quadric error metric simplification (Garland and Heckbert 1997) for the
+// cooker. Edges collapse onto one of their two vertices instead of a new
+// point, so every level of detail indexes the vertices of the full mesh and
+// they all share one vertex buffer. The colors add to the cost of a
+// collapse, and the vertices on a border or where two colors meet never
+// move, so outlines and color regions keep their shape.
+
+// `mesh`'s triangles with about `target_index_count` indices, or as few as
+// it gets down to; `error` is the most the surface moved, in mesh units
+std::vector<uint32_t> simplify_mesh(const MeshData& mesh, size_t target_index_count, float* error);
+
+struct MeshLods {
+    MeshLod lods[MESH_MAX_LODS];
+    uint32_t count;
+    // all the LODs one after the other, LOD 0 first
+    std::vector<uint32_t> indices;
+};
+
+// LOD 0 is `mesh` as it is, every one after it has about half the triangles
+// of the one before, for as long as they keep getting smaller. The new ones
+// are in vertex cache order.
+void build_lods(const MeshData& mesh, MeshLods* out);
+
+struct ClusterDag {
+    // level 0 first, the levels one after the other
+    std::vector<Cluster> clusters;
+    // of every level but 0, which are ranges of the mesh's own indices
+    std::vector<uint32_t> indices;
+};
+
+// Builds the cluster DAG of cluster.hh on top of `meshlets`, the meshlets of
+// `mesh`. The indices of the levels above 0 are numbered as if they followed
+// `first_index` indices, the ones they'll be stored after. Stops once a level
+// isn't much smaller than the one below, or at CLUSTER_MAX_LEVELS.
+void build_cluster_dag(const MeshData& mesh, const std::vector<Meshlet>& meshlets, uint32_t first_index,
+                       ClusterDag* out);
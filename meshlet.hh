@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "math.hh"
+#include "cull.hh"
+
+// Meshlets split LOD 0 of a cooked mesh into small clusters of nearby
+// triangles, each one a range of the index buffer, so parts of a big mesh
+// can be culled on their own: against the frustum with a bounding sphere,
+// behind the mesh itself with a cone around the normals of its triangles,
+// and against the depth pyramid on the GPU. The runtime draws the ranges
+// that are left.
+
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet {
+    // bounding sphere, in the mesh's space
+    float center[3];
+    float radius;
+
+    // every triangle faces at most the cone's angle away from `cone_axis`, outwards. A cone_cos of 0 or
+    // less never culls; the cooker only makes narrower ones for closed meshes, the back of anything else
+    // can be seen.
+    float cone_axis[3];
+    float cone_cos;
+    float cone_sin;
+
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Meshlet) == 48, "meshlets are part of the mesh cache, and std430 structs on the GPU");
+
+// false if `meshlet` of an object at `world`, scaled by at most `scale`, is
+// outside `frustum` or on the side of the mesh that faces away from the camera
+// NOTE: the cone is moved by `world` like a direction, which is only right for rotations and uniform scales
+inline bool meshlet_visible(const Meshlet& meshlet, const Mat4& world, float scale, const Frustum& frustum,
+                            Vec3 camera_pos) {
+    const float* m = world.elems;
+    const float* c = meshlet.center;
+    Vec3 center = {m[0] * c[0] + m[4] * c[1] + m[8] * c[2] + m[12], m[1] * c[0] + m[5] * c[1] + m[9] * c[2] + m[13],
+                   m[2] * c[0] + m[6] * c[1] + m[10] * c[2] + m[14]};
+    float radius = meshlet.radius * scale;
+
+    if (!frustum.test_sphere(center, radius)) return false;
+    if (meshlet.cone_cos <= 0.0f) return true;
+
+    const float* a = meshlet.cone_axis;
+    Vec3 axis = {m[0] * a[0] + m[4] * a[1] + m[8] * a[2], m[1] * a[0] + m[5] * a[1] + m[9] * a[2],
+                 m[2] * a[0] + m[6] * a[1] + m[10] * a[2]};
+    axis.norm();
+
+    // the normal of the cone closest to the camera's direction still has to point away from all of the sphere
+    Vec3 to_meshlet = center - camera_pos;
+    float along = (to_meshlet * axis).sum();
+    float across = sqrtf(fmaxf((to_meshlet * to_meshlet).sum() - along * along, 0.0f));
+
+    return along * meshlet.cone_cos - across * meshlet.cone_sin <= radius;
+}
@@ -0,0 +1,350 @@
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+#include "obj.hh"
+#include "file.hh"
+#include "parse.hh"
+#include "jobs.hh"
+
+// the file is cut into chunks of about this size, at line breaks
+constexpr size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+// what MTL assumes without a Kd, and what faces without a material get
+constexpr Vec3 OBJ_DEFAULT_COLOR = {0.8f, 0.8f, 0.8f};
+
+struct ObjMaterialSwitch {
+    // the first triangle of the chunk that uses the material
+    size_t first_triangle;
+    std::string_view name;
+};
+
+// Everything one chunk of the file declares. Nothing depends on the other
+// chunks while parsing, indices into them get resolved afterwards.
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+
+    std::vector<float> positions;
+    // one per position, OBJ_DEFAULT_COLOR for the ones without
+    std::vector<float> colors;
+    bool has_colors = false;
+
+    // three corners per triangle, as position indices; the ones given
+    // relative to the end (negative in the file) are relative to the chunk
+    // until the positions before it are counted, `relative_corners` has them
+    std::vector<int32_t> corners;
+    std::vector<size_t> relative_corners;
+
+    std::vector<ObjMaterialSwitch> materials;
+    std::vector<std::string_view> libraries;
+
+    // the first line that didn't parse
+    const char* error = nullptr;
+    bool bad_index = false;
+};
+
+static inline std::string_view trim(const char* at, const char* end) {
+    at = skip_spaces(at, end);
+    while (end > at && is_space(end[-1])) end--;
+    return std::string_view(at, end - at);
+}
+
+static bool parse_obj_face(ObjChunk& chunk, const char* at, const char* end) {
+    const int64_t position_count = chunk.positions.size() / 3;
+
+    int32_t first = 0, prev = 0;
+    bool first_relative = false, prev_relative = false;
+    int count = 0;
+
+    while (at < end) {
+        int64_t index;
+        if (!parse_int(&at, end, &index) || index == 0) return false;
+
+        // NOTE: texture coordinates and normals aren't used, `v/vt/vn` and `v//vn` only need skipping
+        while (at < end && !is_space(*at)) at++;
+        at = skip_spaces(at, end);
+
+        bool relative = index < 0;
+        int64_t corner = relative ? position_count + index : index - 1;
+        if (corner < INT32_MIN || corner > INT32_MAX) return false;
+
+        if (count == 0) {
+            first = corner;
+            first_relative = relative;
+        } else if (count >= 2) {
+            if (first_relative) chunk.relative_corners.push_back(chunk.corners.size());
+            chunk.corners.push_back(first);
+            if (prev_relative) chunk.relative_corners.push_back(chunk.corners.size());
+            chunk.corners.push_back(prev);
+            if (relative) chunk.relative_corners.push_back(chunk.corners.size());
+            chunk.corners.push_back(corner);
+        }
+
+        prev = corner;
+        prev_relative = relative;
+        count++;
+    }
+
+    return count >= 3;
+}
+
+static bool parse_obj_line(ObjChunk& chunk, const char* at, const char* end) {
+    at = skip_spaces(at, end);
+    if (at == end || *at == '#') return true;
+
+    const char* word = at;
+    while (at < end && !is_space(*at)) at++;
+    std::string_view keyword(word, at - word);
+    at = skip_spaces(at, end);
+
+    if (keyword == "v") {
+        float values[6];
+        int count = 0;
+        while (count < 6 && parse_float(&at, end, &values[count])) {
+            count++;
+            at = skip_spaces(at, end);
+        }
+        if (count < 3) return false;
+
+        chunk.positions.insert(chunk.positions.end(), values, values + 3);
+
+        if (count == 6) {
+            chunk.colors.insert(chunk.colors.end(), values + 3, values + 6);
+            chunk.has_colors = true;
+        } else {
+            chunk.colors.insert(chunk.colors.end(), {OBJ_DEFAULT_COLOR.x, OBJ_DEFAULT_COLOR.y, OBJ_DEFAULT_COLOR.z});
+        }
+    } else if (keyword == "f") {
+        return parse_obj_face(chunk, at, end);
+    } else if (keyword == "usemtl") {
+        chunk.materials.push_back(ObjMaterialSwitch{chunk.corners.size() / 3, trim(at, end)});
+    } else if (keyword == "mtllib") {
+        // NOTE: several can be given on one line
+        while (at < end) {
+            const char* name = at;
+            while (at < end && !is_space(*at)) at++;
+            chunk.libraries.push_back(std::string_view(name, at - name));
+            at = skip_spaces(at, end);
+        }
+    }
+
+    // anything else (vt, vn, o, g, s, l, ...) doesn't matter for us
+    return true;
+}
+
+static void parse_obj_chunk(ObjChunk& chunk) {
+    const char* at = chunk.begin;
+
+    while (at < chunk.end) {
+        const char* line_end = cast(const char*) memchr(at, '\n', chunk.end - at);
+        if (!line_end) line_end = chunk.end;
+
+        if (!parse_obj_line(chunk, at, line_end)) {
+            chunk.error = at;
+            return;
+        }
+
+        at = line_end + 1;
+    }
+}
+
+// adds the Kd of every material in `path` to `colors`, keyed by name
+static bool load_mtl(const std::string& path, std::unordered_map<std::string, Vec3>& colors) {
+    MappedFile file;
+    if (!file.open(path.c_str())) return false;
+
+    const char* at = cast(const char*) file.data;
+    const char* end = at + file.size;
+
+    Vec3* current = nullptr;
+
+    while (at < end) {
+        const char* line_end = cast(const char*) memchr(at, '\n', end - at);
+        if (!line_end) line_end = end;
+
+        const char* p = skip_spaces(at, line_end);
+        const char* word = p;
+        while (p < line_end && !is_space(*p)) p++;
+        std::string_view keyword(word, p - word);
+
+        if (keyword == "newmtl") {
+            std::string_view name = trim(p, line_end);
+            current = &(colors[std::string(name)] = OBJ_DEFAULT_COLOR);
+        } else if (keyword == "Kd" && current) {
+            float rgb[3];
+            for (int i = 0; i < 3; i++) {
+                p = skip_spaces(p, line_end);
+                if (!parse_float(&p, line_end, &rgb[i])) rgb[i] = i > 0 ? rgb[i - 1] : 0.0f;
+            }
+            *current = Vec3{rgb[0], rgb[1], rgb[2]};
+        }
+
+        at = line_end + 1;
+    }
+
+    return true;
+}
+
+bool load_obj(const char* path, MeshData* out) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    const char* text = cast(const char*) file.data;
+    const char* text_end = text + file.size;
+
+    // line-aligned chunks, every cut moves forward to the next line break
+    std::vector<ObjChunk> chunks;
+    const size_t chunk_count = std::max<size_t>(1, (file.size + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE);
+    chunks.reserve(chunk_count);
+
+    const char* chunk_begin = text;
+    for (size_t i = 1; i <= chunk_count && chunk_begin < text_end; i++) {
+        const char* cut = text + file.size * i / chunk_count;
+        if (cut < chunk_begin) cut = chunk_begin;
+
+        const char* line_end = cast(const char*) memchr(cut, '\n', text_end - cut);
+        const char* chunk_end = line_end ? line_end + 1 : text_end;
+        if (i == chunk_count) chunk_end = text_end;
+
+        chunks.emplace_back();
+        chunks.back().begin = chunk_begin;
+        chunks.back().end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) parse_obj_chunk(chunks[i]);
+    });
+
+    for (const ObjChunk& chunk : chunks) {
+        if (!chunk.error) continue;
+
+        size_t line = 1 + std::count(text, chunk.error, '\n');
+        fprintf(stderr, "%s:%zu: could not parse the line\n", path, line);
+        return false;
+    }
+
+    // where every chunk's positions and triangles start in the whole file
+    std::vector<size_t> position_base(chunks.size());
+    std::vector<size_t> corner_base(chunks.size());
+    size_t position_count = 0;
+    size_t corner_count = 0;
+    bool has_colors = false;
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        position_base[i] = position_count;
+        corner_base[i] = corner_count;
+        position_count += chunks[i].positions.size() / 3;
+        corner_count += chunks[i].corners.size();
+        has_colors |= chunks[i].has_colors;
+    }
+
+    // NOTE: the corners are int32 while parsing
+    if (position_count > INT32_MAX) {
+        fprintf(stderr, "%s: too many vertices\n", path);
+        return false;
+    }
+
+    std::vector<float> positions(position_count * 3);
+    std::vector<float> colors(has_colors ? position_count * 3 : 0);
+
+    parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            ObjChunk& chunk = chunks[i];
+
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + position_base[i] * 3);
+            if (has_colors) std::copy(chunk.colors.begin(), chunk.colors.end(), colors.begin() + position_base[i] * 3);
+
+            for (size_t corner : chunk.relative_corners) chunk.corners[corner] += position_base[i];
+
+            for (int32_t corner : chunk.corners) {
+                if (corner < 0 || cast(size_t) corner >= position_count) chunk.bad_index = true;
+            }
+        }
+    });
+
+    for (const ObjChunk& chunk : chunks) {
+        if (!chunk.bad_index) continue;
+
+        fprintf(stderr, "%s: a face refers to a vertex that doesn't exist\n", path);
+        return false;
+    }
+
+    if (has_colors) {
+        // the colors are per position already, the corners are the indices as they are
+        out->positions = std::move(positions);
+        out->colors = std::move(colors);
+        out->indices.resize(corner_count);
+
+        parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                std::copy(chunks[i].corners.begin(), chunks[i].corners.end(), out->indices.begin() + corner_base[i]);
+            }
+        });
+
+        return true;
+    }
+
+    // materials by name, from all the libraries next to the file
+    std::string dir(path);
+    size_t slash = dir.rfind('/');
+    dir.resize(slash == std::string::npos ? 0 : slash + 1);
+
+    std::unordered_map<std::string, Vec3> library_colors;
+    for (const ObjChunk& chunk : chunks) {
+        for (std::string_view library : chunk.libraries) {
+            // NOTE: a missing library only costs the colors, the geometry is still fine
+            if (!load_mtl(dir + std::string(library), library_colors)) {
+                fprintf(stderr, "%s: the materials of %.*s are missing\n", path, cast(int) library.size(), library.data());
+            }
+        }
+    }
+
+    // color id 0 is for the faces without a material
+    std::unordered_map<std::string_view, uint32_t> material_ids;
+    std::vector<Vec3> material_colors = {OBJ_DEFAULT_COLOR};
+
+    MeshBuilder builder;
+    builder.init(std::move(positions));
+    builder.mesh.indices.reserve(corner_count);
+
+    uint32_t material = 0;
+
+    for (const ObjChunk& chunk : chunks) {
+        size_t next_switch = 0;
+        const size_t triangle_count = chunk.corners.size() / 3;
+
+        // NOTE: up to and including triangle_count, a switch at the very end carries over into the next chunk
+        for (size_t t = 0; t <= triangle_count; t++) {
+            while (next_switch < chunk.materials.size() && chunk.materials[next_switch].first_triangle == t) {
+                std::string_view name = chunk.materials[next_switch++].name;
+
+                auto [it, inserted] = material_ids.try_emplace(name, material_colors.size());
+                if (inserted) {
+                    auto color = library_colors.find(std::string(name));
+                    material_colors.push_back(color != library_colors.end() ? color->second : OBJ_DEFAULT_COLOR);
+                }
+                material = it->second;
+            }
+
+            if (t == triangle_count) break;
+
+            const int32_t* corners = &chunk.corners[t * 3];
+            const Vec3 color = material_colors[material];
+
+            builder.triangle(builder.vertex(corners[0], material, color),
+                             builder.vertex(corners[1], material, color),
+                             builder.vertex(corners[2], material, color));
+        }
+    }
+
+    *out = std::move(builder.mesh);
+    return true;
+}
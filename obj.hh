@@ -0,0 +1,14 @@
+#pragma once
+
+#include "mesh.hh"
+
+// Wavefront OBJ, with the diffuse colors of its MTL materials. The file is
+// mapped and cut into line-aligned chunks that are parsed in parallel on the
+// job system, then stitched together. Only positions and faces are used;
+// faces with more than 3 corners are fanned. A vertex gets its own color
+// when the file has them (`v x y z r g b`), otherwise the Kd of its face's
+// material.
+//
+// False (with the reason on stderr) if the file can't be read or parsed.
+// Call from a thread attached to the job system.
+bool load_obj(const char* path, MeshData* out);
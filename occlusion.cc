@@ -0,0 +1,255 @@
+#include <cmath>
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "occlusion.hh"
+
+static_assert(OCCLUSION_WIDTH % 8 == 0, "the rasterizer works on spans of 8 pixels");
+
+// vertices closer than this (in clip w) are treated as crossing the near plane
+constexpr float OCCLUSION_MIN_W = 1e-4f;
+
+OcclusionBuffer::OcclusionBuffer() {
+    depth.resize(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+
+    int offset = 0;
+    int w = OCCLUSION_WIDTH, h = OCCLUSION_HEIGHT;
+    for (int level = 0; level < OCCLUSION_LEVELS; level++) {
+        level_offset[level] = offset;
+        level_width[level] = w;
+        level_height[level] = h;
+
+        offset += w * h;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+
+    hiz_min.resize(offset, 1.0f);
+    hiz_max.resize(offset, 1.0f);
+}
+
+void OcclusionBuffer::clear(const Mat4& vp) {
+    view_projection = vp;
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+struct ScreenVertex {
+    float x, y, z;
+};
+
+// returns false if the vertex is behind (or on) the near plane
+static inline bool project(const Mat4& m, float x, float y, float z, ScreenVertex* out) {
+    const float* e = m.elems;
+    float cx = e[0] * x + e[4] * y + e[8]  * z + e[12];
+    float cy = e[1] * x + e[5] * y + e[9]  * z + e[13];
+    float cz = e[2] * x + e[6] * y + e[10] * z + e[14];
+    float cw = e[3] * x + e[7] * y + e[11] * z + e[15];
+
+    if (cw < OCCLUSION_MIN_W) return false;
+
+    float inv_w = 1.0f / cw;
+    out->x = (cx * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+    out->y = (cy * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+    out->z = cz * inv_w * 0.5f + 0.5f;
+
+    return true;
+}
+
+static void rasterize_triangle(float* depth, ScreenVertex v0, ScreenVertex v1, ScreenVertex v2) {
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (fabsf(area) < 1e-8f) return;
+
+    // occluders are two sided, flip the winding so the edge functions are positive inside
+    if (area < 0) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    int x0 = std::max(0, (int)floorf(std::min({v0.x, v1.x, v2.x})));
+    int x1 = std::min(OCCLUSION_WIDTH - 1, (int)ceilf(std::max({v0.x, v1.x, v2.x})));
+    int y0 = std::max(0, (int)floorf(std::min({v0.y, v1.y, v2.y})));
+    int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)ceilf(std::max({v0.y, v1.y, v2.y})));
+    if (x0 > x1 || y0 > y1) return;
+
+    // edge functions E(x, y) = a * x + b * y + c, positive on the inner side
+    auto edge = [](ScreenVertex p, ScreenVertex q, float* a, float* b, float* c) {
+        *a = p.y - q.y;
+        *b = q.x - p.x;
+        *c = p.x * q.y - p.y * q.x;
+    };
+
+    float a0, b0, c0, a1, b1, c1, a2, b2, c2;
+    edge(v1, v2, &a0, &b0, &c0);
+    edge(v2, v0, &a1, &b1, &c1);
+    edge(v0, v1, &a2, &b2, &c2);
+
+    // depth is linear in screen space, z(x, y) = za * x + zb * y + zc
+    float inv_area = 1.0f / area;
+    float za = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * inv_area;
+    float zb = (b0 * v0.z + b1 * v1.z + b2 * v2.z) * inv_area;
+    float zc = (c0 * v0.z + c1 * v1.z + c2 * v2.z) * inv_area;
+
+#if defined(__AVX__)
+    // spans of 8 pixels per step, aligned so the loads and stores never straddle rows
+    x0 &= ~7;
+
+    const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 va0 = _mm256_set1_ps(a0), va1 = _mm256_set1_ps(a1), va2 = _mm256_set1_ps(a2);
+    const __m256 vza = _mm256_set1_ps(za);
+
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5f;
+        __m256 vc0 = _mm256_set1_ps(b0 * py + c0);
+        __m256 vc1 = _mm256_set1_ps(b1 * py + c1);
+        __m256 vc2 = _mm256_set1_ps(b2 * py + c2);
+        __m256 vzc = _mm256_set1_ps(zb * py + zc);
+
+        float* row = depth + y * OCCLUSION_WIDTH;
+        for (int x = x0; x <= x1; x += 8) {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lane);
+
+            __m256 e0 = _mm256_add_ps(_mm256_mul_ps(va0, px), vc0);
+            __m256 e1 = _mm256_add_ps(_mm256_mul_ps(va1, px), vc1);
+            __m256 e2 = _mm256_add_ps(_mm256_mul_ps(va2, px), vc2);
+
+            __m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                            _mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GE_OQ),
+                                          _mm256_cmp_ps(e2, zero, _CMP_GE_OQ)));
+            if (_mm256_movemask_ps(inside) == 0) continue;
+
+            __m256 z = _mm256_add_ps(_mm256_mul_ps(vza, px), vzc);
+            __m256 d = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(d, _mm256_min_ps(d, z), inside));
+        }
+    }
+#else
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5f;
+        float* row = depth + y * OCCLUSION_WIDTH;
+
+        for (int x = x0; x <= x1; x++) {
+            float px = x + 0.5f;
+
+            if (a0 * px + b0 * py + c0 < 0) continue;
+            if (a1 * px + b1 * py + c1 < 0) continue;
+            if (a2 * px + b2 * py + c2 < 0) continue;
+
+            float z = za * px + zb * py + zc;
+            if (z < row[x]) row[x] = z;
+        }
+    }
+#endif
+}
+
+void OcclusionBuffer::rasterize(const Mat4& model, const float* positions, size_t vertex_count,
+                                const uint32_t* indices, size_t index_count) {
+    Mat4 mvp = view_projection * model;
+
+    size_t count = indices ? index_count : vertex_count;
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        ScreenVertex v[3];
+        bool ok = true;
+
+        for (int k = 0; k < 3 && ok; k++) {
+            size_t vi = indices ? indices[i + k] : i + k;
+            const float* p = positions + vi * 3;
+            ok = project(mvp, p[0], p[1], p[2], &v[k]);
+        }
+
+        if (ok) rasterize_triangle(depth.data(), v[0], v[1], v[2]);
+    }
+}
+
+void OcclusionBuffer::build_hiz() {
+    std::copy(depth.begin(), depth.end(), hiz_min.begin());
+    std::copy(depth.begin(), depth.end(), hiz_max.begin());
+
+    for (int level = 1; level < OCCLUSION_LEVELS; level++) {
+        const int src_w = level_width[level - 1], src_h = level_height[level - 1];
+        const float* src_min = hiz_min.data() + level_offset[level - 1];
+        const float* src_max = hiz_max.data() + level_offset[level - 1];
+        float* dst_min = hiz_min.data() + level_offset[level];
+        float* dst_max = hiz_max.data() + level_offset[level];
+
+        for (int y = 0; y < level_height[level]; y++) {
+            int sy0 = std::min(y * 2, src_h - 1), sy1 = std::min(y * 2 + 1, src_h - 1);
+
+            for (int x = 0; x < level_width[level]; x++) {
+                int sx0 = std::min(x * 2, src_w - 1), sx1 = std::min(x * 2 + 1, src_w - 1);
+
+                dst_min[y * level_width[level] + x] = std::min({src_min[sy0 * src_w + sx0], src_min[sy0 * src_w + sx1],
+                                                                src_min[sy1 * src_w + sx0], src_min[sy1 * src_w + sx1]});
+                dst_max[y * level_width[level] + x] = std::max({src_max[sy0 * src_w + sx0], src_max[sy0 * src_w + sx1],
+                                                                src_max[sy1 * src_w + sx0], src_max[sy1 * src_w + sx1]});
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::test_aabb(const Aabb& box) const {
+    float min_x = INFINITY, min_y = INFINITY, min_z = INFINITY;
+    float max_x = -INFINITY, max_y = -INFINITY;
+
+    for (int i = 0; i < 8; i++) {
+        ScreenVertex v;
+        Vec3 corner = {(i & 1) ? box.max.x : box.min.x,
+                       (i & 2) ? box.max.y : box.min.y,
+                       (i & 4) ? box.max.z : box.min.z};
+
+        // the box reaches behind the camera, nothing can be in front of it
+        if (!project(view_projection, corner.x, corner.y, corner.z, &v)) return true;
+
+        min_x = std::min(min_x, v.x);
+        max_x = std::max(max_x, v.x);
+        min_y = std::min(min_y, v.y);
+        max_y = std::max(max_y, v.y);
+        min_z = std::min(min_z, v.z);
+    }
+
+    if (max_x < 0 || max_y < 0 || min_x >= OCCLUSION_WIDTH || min_y >= OCCLUSION_HEIGHT) return true;
+
+    int x0 = std::max(0, (int)floorf(min_x));
+    int y0 = std::max(0, (int)floorf(min_y));
+    int x1 = std::min(OCCLUSION_WIDTH - 1, (int)floorf(max_x));
+    int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)floorf(max_y));
+
+    // pick the level where the rect covers at most 2x2 texels (3x3 when unaligned)
+    int level = 0;
+    while (level + 1 < OCCLUSION_LEVELS && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+
+    auto region = [&](int l, float* out_min, float* out_max) {
+        const int w = level_width[l];
+        const float* hmin = hiz_min.data() + level_offset[l];
+        const float* hmax = hiz_max.data() + level_offset[l];
+
+        *out_min = 1.0f;
+        *out_max = 0.0f;
+        for (int y = y0 >> l; y <= (y1 >> l); y++) {
+            for (int x = x0 >> l; x <= (x1 >> l); x++) {
+                *out_min = std::min(*out_min, hmin[y * w + x]);
+                *out_max = std::max(*out_max, hmax[y * w + x]);
+            }
+        }
+    };
+
+    // a coarser level settles most boxes with a single texel: in front of
+    // everything drawn there means visible, behind the farthest occluder means
+    // hidden. Only boxes in between need the finer level.
+    float region_min, region_max;
+    int coarse = std::min(level + 2, OCCLUSION_LEVELS - 1);
+    region(coarse, &region_min, &region_max);
+
+    if (min_z <= region_min) return true;
+    if (min_z > region_max) return false;
+
+    region(level, &region_min, &region_max);
+
+    return min_z <= region_max;
+}
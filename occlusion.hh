@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "math.hh"
+
+constexpr int OCCLUSION_WIDTH = 256;
+constexpr int OCCLUSION_HEIGHT = 128;
+constexpr int OCCLUSION_LEVELS = 9; // 256x128 down to 1x1
+
+// A small CPU depth buffer the occluders are rasterized into, with a min/max
+// depth pyramid on top of it for the bounding box tests. Depth is window
+// depth in [0, 1], 1 is the far plane. Everything runs on the CPU, no GL is
+// involved.
+struct OcclusionBuffer {
+    OcclusionBuffer();
+
+    // clears the depth to the far plane, `view_projection` is used for both
+    // rasterizing and testing until the next clear
+    void clear(const Mat4& view_projection);
+
+    // rasterizes a triangle list of tightly packed xyz positions; `indices` may
+    // be null for non-indexed geometry. Triangles crossing the near plane are
+    // skipped, which only makes the culling more conservative.
+    void rasterize(const Mat4& model, const float* positions, size_t vertex_count,
+                   const uint32_t* indices = nullptr, size_t index_count = 0);
+
+    // builds the min/max pyramid, call after all the occluders are in
+    void build_hiz();
+
+    // false if the box is fully hidden behind the occluders
+    bool test_aabb(const Aabb& box) const;
+
+    Mat4 view_projection;
+
+    std::vector<float> depth;
+
+    // level 0 is the depth buffer itself, every level halves both dimensions
+    int level_offset[OCCLUSION_LEVELS];
+    int level_width[OCCLUSION_LEVELS];
+    int level_height[OCCLUSION_LEVELS];
+    std::vector<float> hiz_min;
+    std::vector<float> hiz_max;
+};
@@ -0,0 +1,442 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.hh"
+#include "pack.hh"
+#include "hash.hh"
+#include "jobs.hh"
+#include "lz.hh"
+
+static inline size_t align_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static inline uint32_t block_count_for(uint64_t size) {
+    return cast(uint32_t) ((size + PACK_BLOCK_SIZE - 1) / PACK_BLOCK_SIZE);
+}
+
+static inline size_t block_size(uint64_t size, size_t block) {
+    const uint64_t rest = size - block * PACK_BLOCK_SIZE;
+    return rest < PACK_BLOCK_SIZE ? rest : PACK_BLOCK_SIZE;
+}
+
+static inline uint64_t hash_name(std::string_view name) {
+    return hash_bytes(name.data(), name.size());
+}
+
+// everything an entry points at has to lie inside the file, so nothing
+// later has to check it again
+static bool check_entry(const PackHeader* header, const PackEntry& entry) {
+    if (cast(uint64_t) entry.name_offset + entry.name_length > header->names_size) return false;
+    if (entry.offset > header->file_size || entry.stored_size > header->file_size - entry.offset) return false;
+
+    switch (entry.codec) {
+        case PACK_CODEC_NONE:
+            return entry.stored_size == entry.size;
+        case PACK_CODEC_LZ:
+            return entry.block_count == block_count_for(entry.size) &&
+                   cast(uint64_t) entry.block_count * sizeof(uint32_t) <= entry.stored_size;
+        default:
+            return false;
+    }
+}
+
+PackFile::~PackFile() {
+    close();
+}
+
+bool PackFile::open(const char* path) {
+    close();
+
+    // NOTE: no read ahead, a pack is much more than one run needs; read() asks for the entries it wants
+    if (!file.open(path, false)) return false;
+
+    const PackHeader* h = cast(const PackHeader*) file.data;
+    if (file.size < sizeof(PackHeader) || h->magic != PACK_MAGIC) {
+        fprintf(stderr, "%s is not a pack\n", path);
+        close();
+        return false;
+    }
+
+    if (h->version != PACK_VERSION) {
+        fprintf(stderr, "%s is from another version of glpg-cook, it has to be packed again\n", path);
+        close();
+        return false;
+    }
+
+    bool valid = h->file_size == file.size && h->entries_offset % alignof(PackEntry) == 0 &&
+                 h->entries_offset <= file.size &&
+                 h->entry_count <= (file.size - h->entries_offset) / sizeof(PackEntry) &&
+                 h->names_offset <= file.size && h->names_size <= file.size - h->names_offset;
+
+    const PackEntry* e = valid ? cast(const PackEntry*) (file.data + h->entries_offset) : nullptr;
+    for (uint64_t i = 0; valid && i < h->entry_count; i++) {
+        valid = check_entry(h, e[i]) && (i == 0 || e[i - 1].name_hash <= e[i].name_hash);
+    }
+
+    if (!valid) {
+        fprintf(stderr, "%s is damaged\n", path);
+        close();
+        return false;
+    }
+
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        close();
+        return false;
+    }
+
+    header = h;
+    entries = e;
+    names = cast(const char*) (file.data + h->names_offset);
+    return true;
+}
+
+void PackFile::close() {
+    if (fd >= 0) ::close(fd);
+    file.close();
+
+    fd = -1;
+    header = nullptr;
+    entries = nullptr;
+    names = nullptr;
+}
+
+const PackEntry* PackFile::find(std::string_view name) const {
+    if (!header) return nullptr;
+
+    const uint64_t hash = hash_name(name);
+    const PackEntry* end = entries + header->entry_count;
+    const PackEntry* at = std::lower_bound(entries, end, hash, [](const PackEntry& entry, uint64_t hash) {
+        return entry.name_hash < hash;
+    });
+
+    // NOTE: equal hashes are neighbours, the names decide between them
+    for (; at != end && at->name_hash == hash; at++) {
+        if (this->name(*at) == name) return at;
+    }
+
+    return nullptr;
+}
+
+std::string_view PackFile::name(const PackEntry& entry) const {
+    return std::string_view(names + entry.name_offset, entry.name_length);
+}
+
+const uint8_t* PackFile::data(const PackEntry& entry) const {
+    if (entry.codec != PACK_CODEC_NONE) return nullptr;
+
+    file.prefetch(entry.offset, entry.stored_size);
+    return file.data + entry.offset;
+}
+
+bool PackFile::read(const PackEntry& entry, uint8_t* out) const {
+    const uint8_t* stored = file.data + entry.offset;
+    file.prefetch(entry.offset, entry.stored_size);
+
+    if (entry.codec == PACK_CODEC_NONE) {
+        parallel_for(block_count_for(entry.size), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                memcpy(out + i * PACK_BLOCK_SIZE, stored + i * PACK_BLOCK_SIZE, block_size(entry.size, i));
+            }
+        });
+        return true;
+    }
+
+    // where every block starts, the table only has their sizes
+    const uint32_t* table = cast(const uint32_t*) stored;
+    std::vector<uint64_t> starts(entry.block_count);
+
+    uint64_t at = entry.block_count * sizeof(uint32_t);
+    for (uint32_t i = 0; i < entry.block_count; i++) {
+        starts[i] = at;
+        at += table[i] & ~PACK_BLOCK_RAW;
+    }
+
+    if (at > entry.stored_size) return false;
+
+    std::atomic<bool> ok = true;
+    parallel_for(entry.block_count, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const size_t size = block_size(entry.size, i);
+            const size_t stored_size = table[i] & ~PACK_BLOCK_RAW;
+            const uint8_t* src = stored + starts[i];
+            uint8_t* dst = out + i * PACK_BLOCK_SIZE;
+
+            if (table[i] & PACK_BLOCK_RAW) {
+                if (stored_size != size) {
+                    ok.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                memcpy(dst, src, size);
+            } else if (!lz_decompress(src, stored_size, dst, size)) {
+                ok.store(false, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    return ok.load(std::memory_order_relaxed);
+}
+
+// a piece of an entry stored as it is, already where it belongs
+static void pack_raw_read(void* data, size_t, size_t) {
+    IoRead* read = cast(IoRead*) data;
+    PackLoad* load = cast(PackLoad*) read->data;
+
+    if (read->result != read->size) load->failed.store(true, std::memory_order_relaxed);
+}
+
+// decompresses the block `read` brought in, on some worker
+static void pack_block_read(void* data, size_t, size_t) {
+    IoRead* read = cast(IoRead*) data;
+    PackLoad* load = cast(PackLoad*) read->data;
+    const PackEntry& entry = *load->entry;
+
+    const size_t block = read - &load->reads[1];
+    const size_t size = block_size(entry.size, block);
+    const uint32_t* table = cast(const uint32_t*) load->staged.data();
+    const uint32_t stored = table[block];
+
+    if (read->result != read->size) {
+        load->failed.store(true, std::memory_order_relaxed);
+    } else if (stored & PACK_BLOCK_RAW) {
+        if ((stored & ~PACK_BLOCK_RAW) != size) {
+            load->failed.store(true, std::memory_order_relaxed);
+        } else {
+            memcpy(load->out + block * PACK_BLOCK_SIZE, read->dst, size);
+        }
+    } else if (!lz_decompress(read->dst, read->size, load->out + block * PACK_BLOCK_SIZE, size)) {
+        load->failed.store(true, std::memory_order_relaxed);
+    }
+}
+
+// the block table is in, now the blocks themselves
+static void pack_table_read(void* data, size_t, size_t) {
+    IoRead* read = cast(IoRead*) data;
+    PackLoad* load = cast(PackLoad*) read->data;
+    const PackEntry& entry = *load->entry;
+
+    if (read->result != read->size) {
+        load->failed.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint32_t* table = cast(const uint32_t*) load->staged.data();
+    load->starts.resize(entry.block_count);
+
+    uint64_t at = entry.block_count * sizeof(uint32_t);
+    for (uint32_t i = 0; i < entry.block_count; i++) {
+        load->starts[i] = at;
+        at += table[i] & ~PACK_BLOCK_RAW;
+    }
+
+    if (at > entry.stored_size) {
+        load->failed.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    for (uint32_t i = 0; i < entry.block_count; i++) {
+        IoRead& block = load->reads[1 + i];
+        block.fd = load->pack->fd;
+        block.offset = entry.offset + load->starts[i];
+        block.size = table[i] & ~PACK_BLOCK_RAW;
+        block.dst = load->staged.data() + load->starts[i];
+        block.done = pack_block_read;
+        block.data = load;
+    }
+
+    // NOTE: this job still holds the counter, the load can't look done before the blocks are queued
+    io_submit(&load->reads[1], entry.block_count, &load->counter);
+}
+
+void PackFile::read_async(const PackEntry& entry, uint8_t* out, PackLoad* load) const {
+    load->pack = this;
+    load->entry = &entry;
+    load->out = out;
+    load->failed = false;
+
+    if (entry.codec == PACK_CODEC_NONE) {
+        // straight into `out`, in pieces so several are in flight at once
+        load->reads.resize(block_count_for(entry.size));
+        for (size_t i = 0; i < load->reads.size(); i++) {
+            IoRead& read = load->reads[i];
+            read.fd = fd;
+            read.offset = entry.offset + i * PACK_BLOCK_SIZE;
+            read.size = cast(uint32_t) block_size(entry.size, i);
+            read.dst = out + i * PACK_BLOCK_SIZE;
+            read.done = pack_raw_read;
+            read.data = load;
+        }
+
+        io_submit(load->reads.data(), load->reads.size(), &load->counter);
+        return;
+    }
+
+    // NOTE: sized up front, the reads are pointed at while they're in flight
+    load->staged.resize(entry.stored_size);
+    load->reads.resize(1 + entry.block_count);
+
+    IoRead& table = load->reads[0];
+    table.fd = fd;
+    table.offset = entry.offset;
+    table.size = entry.block_count * sizeof(uint32_t);
+    table.dst = load->staged.data();
+    table.done = pack_table_read;
+    table.data = load;
+
+    io_submit(&table, 1, &load->counter);
+}
+
+// one block of one input, compressed on some worker
+struct PackBlock {
+    size_t input;
+    size_t index;
+    std::vector<uint8_t> compressed;
+};
+
+bool write_pack(const char* path, const PackInput* inputs, size_t count, bool compress) {
+    // the entries go in name hash order, the data in the same order
+    std::vector<size_t> order(count);
+    std::vector<uint64_t> hashes(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+        hashes[i] = hash_name(inputs[i].name);
+    }
+
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : inputs[a].name < inputs[b].name;
+    });
+
+    size_t names_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && inputs[order[i]].name == inputs[order[i - 1]].name) {
+            fprintf(stderr, "Could not write %s: %s is in it twice\n", path, inputs[order[i]].name.c_str());
+            return false;
+        }
+        names_size += inputs[i].name.size();
+    }
+
+    if (names_size > UINT32_MAX) {
+        fprintf(stderr, "Could not write %s: the names are too long\n", path);
+        return false;
+    }
+
+    std::vector<PackBlock> blocks;
+    std::vector<size_t> first_block(count, 0);
+    if (compress) {
+        for (size_t i = 0; i < count; i++) {
+            first_block[i] = blocks.size();
+            for (size_t b = 0; b < block_count_for(inputs[i].size); b++) blocks.push_back(PackBlock{i, b, {}});
+        }
+
+        // NOTE: one block per job, so a single big input still uses every core
+        parallel_for(blocks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                PackBlock& block = blocks[i];
+                const PackInput& input = inputs[block.input];
+                const size_t size = block_size(input.size, block.index);
+
+                block.compressed.resize(lz_compress_bound(size));
+                size_t compressed = lz_compress(input.data + block.index * PACK_BLOCK_SIZE, size,
+                                                block.compressed.data(), block.compressed.size());
+
+                // stored as it is if it doesn't get smaller
+                block.compressed.resize(compressed < size ? compressed : 0);
+            }
+        });
+    }
+
+    std::vector<PackEntry> entries(count);
+    std::string names;
+    names.reserve(names_size);
+
+    size_t size = PACK_ALIGNMENT;
+    for (size_t i = 0; i < count; i++) {
+        const size_t at = order[i];
+        const PackInput& input = inputs[at];
+        PackEntry& entry = entries[i];
+
+        entry = {};
+        entry.name_hash = hashes[at];
+        entry.size = input.size;
+        entry.name_offset = cast(uint32_t) names.size();
+        entry.name_length = cast(uint32_t) input.name.size();
+        names += input.name;
+
+        entry.codec = PACK_CODEC_NONE;
+        entry.stored_size = input.size;
+
+        if (compress && input.size > 0) {
+            const uint32_t block_count = block_count_for(input.size);
+            uint64_t stored = block_count * sizeof(uint32_t);
+            for (uint32_t b = 0; b < block_count; b++) {
+                const std::vector<uint8_t>& compressed = blocks[first_block[at] + b].compressed;
+                stored += compressed.empty() ? block_size(input.size, b) : compressed.size();
+            }
+
+            // NOTE: a few percent isn't worth giving up using the entry in place
+            if (stored < input.size - input.size / 8) {
+                entry.codec = PACK_CODEC_LZ;
+                entry.block_count = block_count;
+                entry.stored_size = stored;
+            }
+        }
+
+        entry.offset = size;
+        size = align_up(size + entry.stored_size, PACK_ALIGNMENT);
+    }
+
+    PackHeader header = {};
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.entry_count = count;
+    header.entries_offset = size;
+    header.names_offset = size + count * sizeof(PackEntry);
+    header.names_size = names.size();
+    header.file_size = header.names_offset + names.size();
+
+    std::vector<uint8_t> data(header.file_size, 0);
+    memcpy(data.data(), &header, sizeof(header));
+
+    for (size_t i = 0; i < count; i++) {
+        const PackEntry& entry = entries[i];
+        const PackInput& input = inputs[order[i]];
+        uint8_t* out = data.data() + entry.offset;
+
+        if (entry.codec == PACK_CODEC_NONE) {
+            if (input.size) memcpy(out, input.data, input.size);
+            continue;
+        }
+
+        uint32_t* table = cast(uint32_t*) out;
+        out += entry.block_count * sizeof(uint32_t);
+
+        for (uint32_t b = 0; b < entry.block_count; b++) {
+            const std::vector<uint8_t>& compressed = blocks[first_block[order[i]] + b].compressed;
+            if (compressed.empty()) {
+                const size_t block = block_size(input.size, b);
+                table[b] = cast(uint32_t) block | PACK_BLOCK_RAW;
+                memcpy(out, input.data + b * PACK_BLOCK_SIZE, block);
+                out += block;
+            } else {
+                table[b] = cast(uint32_t) compressed.size();
+                memcpy(out, compressed.data(), compressed.size());
+                out += compressed.size();
+            }
+        }
+    }
+
+    if (count) memcpy(data.data() + header.entries_offset, entries.data(), count * sizeof(PackEntry));
+    if (names.size()) memcpy(data.data() + header.names_offset, names.data(), names.size());
+
+    return write_file(path, data.data(), data.size());
+}
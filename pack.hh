@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file.hh"
+#include "io.hh"
+#include "jobs.hh"
+
+// A single-file archive of assets, so a cold start is one open and one mmap
+// instead of thousands:
+//
+//   PackHeader | entry data, each at a PACK_ALIGNMENT boundary | PackEntry[] | names
+//
+// The entries are sorted by the hash of their name and looked up with a
+// binary search. An entry is either stored as it is, and then used in place
+// (the page alignment is enough for any format that maps its data), or as
+// independent LZ blocks of PACK_BLOCK_SIZE that are decoded in parallel on
+// the job system. Little-endian, like the other cooked formats.
+
+constexpr uint32_t PACK_MAGIC = 0x4B504C47;  // "GLPK"
+constexpr uint32_t PACK_VERSION = 1;
+constexpr size_t PACK_ALIGNMENT = 4096;
+constexpr size_t PACK_BLOCK_SIZE = 256 * 1024;
+
+enum PackCodec : uint32_t {
+    PACK_CODEC_NONE,
+    // the data starts with one uint32 size per block, PACK_BLOCK_RAW set for blocks stored as they are
+    PACK_CODEC_LZ,
+};
+
+constexpr uint32_t PACK_BLOCK_RAW = 0x80000000;
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    uint64_t entry_count;
+    uint64_t entries_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct PackEntry {
+    uint64_t name_hash;
+    // of the data in the file, and its size there
+    uint64_t offset;
+    uint64_t stored_size;
+    // once decompressed
+    uint64_t size;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t codec;
+    uint32_t block_count;
+};
+
+static_assert(sizeof(PackHeader) == 48 && sizeof(PackEntry) == 48, "the structs are part of the file format");
+
+struct PackLoad;
+
+struct PackFile {
+    PackFile() = default;
+    ~PackFile();
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    // false (with the reason on stderr) if the file can't be mapped or isn't a valid pack
+    bool open(const char* path);
+    void close();
+
+    // null if there is no entry of that name
+    const PackEntry* find(std::string_view name) const;
+
+    std::string_view name(const PackEntry& entry) const;
+
+    // the data of an entry stored as it is, null for compressed ones
+    const uint8_t* data(const PackEntry& entry) const;
+
+    // decompresses (or copies) the entry into `out`, which has room for
+    // `entry.size` bytes; the blocks are spread over the job system. False if
+    // the data is damaged. Call from a thread attached to the job system.
+    bool read(const PackEntry& entry, uint8_t* out) const;
+
+    // the same without blocking: the stored data is read with io_submit() and
+    // every block is decompressed as soon as it arrived; `load` tells when
+    // it's all there. `out` and `load` have to stay alive until then.
+    void read_async(const PackEntry& entry, uint8_t* out, PackLoad* load) const;
+
+    inline size_t entry_count() const {
+        return header ? header->entry_count : 0;
+    }
+
+    MappedFile file;
+    // the same file for io_submit()
+    int fd = -1;
+    const PackHeader* header = nullptr;
+    const PackEntry* entries = nullptr;
+    const char* names = nullptr;
+};
+
+// An entry on its way in, see PackFile::read_async.
+struct PackLoad {
+    inline bool done() const {
+        return counter.done();
+    }
+
+    // once done(): false if a read failed or the data is damaged
+    inline bool ok() const {
+        return !failed.load(std::memory_order_relaxed);
+    }
+
+    // runs jobs until it's done, for when there's nothing else to do
+    inline void wait() {
+        jobs_wait(&counter);
+    }
+
+    const PackFile* pack = nullptr;
+    const PackEntry* entry = nullptr;
+    uint8_t* out = nullptr;
+
+    // the stored data of a compressed entry, and where each block of it starts
+    std::vector<uint8_t> staged;
+    std::vector<uint64_t> starts;
+    // the block table first, then one per block
+    std::vector<IoRead> reads;
+
+    JobCounter counter;
+    std::atomic<bool> failed{false};
+};
+
+struct PackInput {
+    std::string name;
+    const uint8_t* data;
+    size_t size;
+};
+
+// packs `inputs` into `path`, compressing the entries that get noticeably
+// smaller when `compress`; the blocks are compressed in parallel on the job
+// system. False with the reason on stderr.
+bool write_pack(const char* path, const PackInput* inputs, size_t count, bool compress);
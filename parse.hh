@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "common.hh"
+
+// Number parsing for the text asset formats. No locale, no allocation and no
+// null terminator needed, every function takes the end of the buffer and
+// moves `*at` past what it consumed.
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_spaces(const char* at, const char* end) {
+    while (at < end && is_space(*at)) at++;
+    return at;
+}
+
+// NOTE: SWAR, all 8 bytes are checked and converted with a few integer ops
+// instead of one digit at a time (little-endian only)
+static inline bool is_eight_digits(uint64_t chunk) {
+    return (((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+            0x3333333333333333);
+}
+
+static inline uint32_t parse_eight_digits(uint64_t chunk) {
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0F) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FF) * 6553601) >> 16;
+    return cast(uint32_t) (((chunk & 0x0000FFFF0000FFFF) * 42949672960001) >> 32);
+}
+
+// digits into `*mantissa` as long as it has room, the rest only shift
+// `*exponent` when `integer`; returns the number of digits seen
+static inline size_t parse_digits(const char** at, const char* end, uint64_t* mantissa, int* significant,
+                                  int* exponent, bool integer) {
+    const char* p = *at;
+    const char* start = p;
+
+    // 8 digits at a time while all of them fit into the 19 a uint64 holds
+    while (end - p >= 8 && *significant <= 19 - 8) {
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        if (!is_eight_digits(chunk)) break;
+
+        *mantissa = *mantissa * 100000000 + parse_eight_digits(chunk);
+        *significant += 8;
+        if (!integer) *exponent -= 8;
+        p += 8;
+    }
+
+    for (; p < end && cast(unsigned) (*p - '0') < 10; p++) {
+        if (*significant < 19) {
+            *mantissa = *mantissa * 10 + (*p - '0');
+            // NOTE: leading zeros don't take up any precision
+            if (*mantissa) (*significant)++;
+            if (!integer) (*exponent)--;
+        } else if (integer) {
+            (*exponent)++;
+        }
+    }
+
+    *at = p;
+    return p - start;
+}
+
+// 10^-64 to 10^38, anything a float can hold with up to 19 mantissa digits
+constexpr int POW10_MIN = -64;
+constexpr int POW10_MAX = 38;
+
+struct Pow10Table {
+    constexpr Pow10Table() : values() {
+        double v = 1.0;
+        for (int e = 0; e <= POW10_MAX; e++, v *= 10) values[e - POW10_MIN] = v;
+
+        // NOTE: divided from 1 each time instead of accumulating, keeps every entry within an ulp
+        double d = 1.0;
+        for (int e = 1; e <= -POW10_MIN; e++) {
+            d *= 10;
+            values[-e - POW10_MIN] = 1.0 / d;
+        }
+    }
+
+    double values[POW10_MAX - POW10_MIN + 1];
+};
+
+constexpr Pow10Table POW10 = {};
+
+// decimal or scientific notation, no inf/nan; false if there is no number at `*at`
+static inline bool parse_float(const char** at, const char* end, float* out) {
+    const char* p = *at;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+
+    size_t digits = parse_digits(&p, end, &mantissa, &significant, &exponent, true);
+    if (p < end && *p == '.') {
+        p++;
+        digits += parse_digits(&p, end, &mantissa, &significant, &exponent, false);
+    }
+    if (digits == 0) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool exp_negative = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            exp_negative = *e == '-';
+            e++;
+        }
+
+        int value = 0;
+        const char* exp_start = e;
+        for (; e < end && cast(unsigned) (*e - '0') < 10; e++) {
+            if (value < 10000) value = value * 10 + (*e - '0');
+        }
+
+        // NOTE: a lone 'e' isn't part of the number
+        if (e != exp_start) {
+            exponent += exp_negative ? -value : value;
+            p = e;
+        }
+    }
+
+    // NOTE: mantissas up to 2^53 and powers up to 10^22 are exact in double,
+    // so the common case rounds once there and once more to float
+    constexpr uint64_t EXACT_MANTISSA = 1ull << 53;
+    constexpr int EXACT_POW10 = 22;
+
+    double value;
+    if (mantissa == 0 || exponent < POW10_MIN) {
+        value = 0.0;
+    } else if (exponent > POW10_MAX) {
+        value = __builtin_huge_val();
+    } else if (exponent < 0 && exponent >= -EXACT_POW10 && mantissa <= EXACT_MANTISSA) {
+        value = cast(double) mantissa / POW10.values[-exponent - POW10_MIN];
+    } else {
+        value = cast(double) mantissa * POW10.values[exponent - POW10_MIN];
+    }
+
+    *out = cast(float) (negative ? -value : value);
+    *at = p;
+    return true;
+}
+
+// false if there is no integer at `*at`
+static inline bool parse_int(const char** at, const char* end, int64_t* out) {
+    const char* p = *at;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    const char* start = p;
+    int64_t value = 0;
+    for (; p < end && cast(unsigned) (*p - '0') < 10; p++) {
+        if (value < INT64_MAX / 10) value = value * 10 + (*p - '0');
+    }
+    if (p == start) return false;
+
+    *out = negative ? -value : value;
+    *at = p;
+    return true;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "common.hh"
+
+// 32 bits: the slot index in the low 20, a generation in the high 12. The
+// generation of a slot is bumped every time it's freed, so handles to what
+// used to live there stop resolving. 0 is never a valid handle.
+constexpr int HANDLE_INDEX_BITS = 20;
+constexpr int HANDLE_GENERATION_BITS = 32 - HANDLE_INDEX_BITS;
+constexpr uint32_t HANDLE_INDEX_MASK = (1u << HANDLE_INDEX_BITS) - 1;
+constexpr uint32_t HANDLE_GENERATION_MASK = (1u << HANDLE_GENERATION_BITS) - 1;
+constexpr uint32_t HANDLE_MAX_SLOTS = HANDLE_INDEX_MASK + 1;
+
+// `Tag` only keeps handles of different pools from mixing
+template <class Tag>
+struct Handle {
+    inline bool is_null() const {
+        return value == 0;
+    }
+
+    inline uint32_t index() const {
+        return value & HANDLE_INDEX_MASK;
+    }
+
+    inline uint32_t generation() const {
+        return value >> HANDLE_INDEX_BITS;
+    }
+
+    inline bool operator==(const Handle& other) const {
+        return value == other.value;
+    }
+
+    uint32_t value = 0;
+};
+
+// The items are kept packed in `items` for iteration, destroying one moves the
+// last item into its place. Handles go through the sparse `slots`, which
+// either point at the item or, when free, at the next free slot.
+template <class T, class Tag>
+struct Pool {
+    using HandleType = Handle<Tag>;
+
+    struct Slot {
+        // index into `items`, or of the next free slot
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    HandleType create(const T& item) {
+        uint32_t slot_index;
+
+        if (free_head != NO_SLOT) {
+            slot_index = free_head;
+            free_head = slots[slot_index].index;
+        } else {
+            if (slots.size() == HANDLE_MAX_SLOTS) die("resource pool is full");
+
+            slot_index = slots.size();
+            // NOTE: generations start at 1, so no handle is ever 0
+            slots.push_back(Slot{0, 1});
+        }
+
+        Slot& slot = slots[slot_index];
+        slot.index = items.size();
+
+        items.push_back(item);
+        item_slots.push_back(slot_index);
+
+        return HandleType{(slot.generation << HANDLE_INDEX_BITS) | slot_index};
+    }
+
+    // false if the handle was stale already
+    bool destroy(HandleType handle) {
+        if (!is_valid(handle)) return false;
+
+        uint32_t slot_index = handle.index();
+        uint32_t item = slots[slot_index].index;
+        uint32_t last = items.size() - 1;
+
+        if (item != last) {
+            items[item] = items[last];
+            item_slots[item] = item_slots[last];
+            slots[item_slots[item]].index = item;
+        }
+
+        items.pop_back();
+        item_slots.pop_back();
+
+        Slot& slot = slots[slot_index];
+        slot.generation = (slot.generation + 1) & HANDLE_GENERATION_MASK;
+        if (slot.generation == 0) slot.generation = 1;
+
+        slot.index = free_head;
+        free_head = slot_index;
+
+        return true;
+    }
+
+    inline bool is_valid(HandleType handle) const {
+        uint32_t index = handle.index();
+        return !handle.is_null() && index < slots.size() && slots[index].generation == handle.generation();
+    }
+
+    // null for stale handles
+    inline T* get(HandleType handle) {
+        return is_valid(handle) ? &items[slots[handle.index()].index] : nullptr;
+    }
+
+    inline const T* get(HandleType handle) const {
+        return is_valid(handle) ? &items[slots[handle.index()].index] : nullptr;
+    }
+
+    inline size_t size() const {
+        return items.size();
+    }
+
+    // the handle of `items[i]`
+    inline HandleType handle_at(size_t i) const {
+        uint32_t slot_index = item_slots[i];
+        return HandleType{(slots[slot_index].generation << HANDLE_INDEX_BITS) | slot_index};
+    }
+
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    std::vector<T> items;
+    std::vector<uint32_t> item_slots;
+    std::vector<Slot> slots;
+    uint32_t free_head = NO_SLOT;
+};
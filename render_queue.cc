@@ -0,0 +1,151 @@
+#include <cstring>
+
+#include <algorithm>
+#include <utility>
+
+#include "common.hh"
+#include "render_queue.hh"
+#include "jobs.hh"
+
+constexpr int RADIX_BITS = 8;
+constexpr int RADIX_SIZE = 1 << RADIX_BITS;
+constexpr int RADIX_PASSES = 64 / RADIX_BITS;
+
+constexpr size_t MIN_PACKETS_PER_LIST = 128;
+
+static inline uint64_t key_field(uint32_t value, int bits) {
+    return value & ((1u << bits) - 1);
+}
+
+uint64_t make_sort_key(uint32_t pass, bool translucent, float depth, uint32_t program, uint32_t material,
+                       uint32_t mesh) {
+    if (depth < 0) depth = 0;
+    if (depth > 1) depth = 1;
+
+    const uint32_t depth_max = (1u << SORT_KEY_DEPTH_BITS) - 1;
+    uint32_t depth_bits = depth * depth_max;
+    // back to front
+    if (translucent) depth_bits = depth_max - depth_bits;
+
+    uint64_t key = key_field(pass, SORT_KEY_PASS_BITS);
+    key = (key << 1) | translucent;
+    key = (key << SORT_KEY_DEPTH_BITS) | depth_bits;
+    key = (key << SORT_KEY_PROGRAM_BITS) | key_field(program, SORT_KEY_PROGRAM_BITS);
+    key = (key << SORT_KEY_MATERIAL_BITS) | key_field(material, SORT_KEY_MATERIAL_BITS);
+    key = (key << SORT_KEY_MESH_BITS) | key_field(mesh, SORT_KEY_MESH_BITS);
+
+    return key;
+}
+
+void RenderQueue::begin() {
+    if (buckets.size() != jobs_thread_count()) buckets.resize(jobs_thread_count());
+
+    for (auto& bucket : buckets) bucket.clear();
+}
+
+void RenderQueue::push(const DrawPacket& packet) {
+    int thread = jobs_thread_index();
+    if (thread < 0) die("draws pushed from a thread that is not attached to the job system");
+
+    buckets[thread].push_back(packet);
+}
+
+void RenderQueue::sort(Arena& arena) {
+    count = 0;
+    for (const auto& bucket : buckets) count += bucket.size();
+
+    packets = arena.allocate_array<DrawPacket>(count);
+    entries = arena.allocate_array<SortEntry>(count);
+    SortEntry* scratch = arena.allocate_array<SortEntry>(count);
+
+    size_t merged = 0;
+    for (const auto& bucket : buckets) {
+        std::copy(bucket.begin(), bucket.end(), packets + merged);
+        merged += bucket.size();
+    }
+
+    // every histogram in one go, the keys are only read once for all the passes
+    uint32_t histograms[RADIX_PASSES][RADIX_SIZE];
+    memset(histograms, 0, sizeof(histograms));
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key = packets[i].key;
+        entries[i] = SortEntry{key, (uint32_t)i};
+
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    SortEntry* src = entries;
+    SortEntry* dst = scratch;
+
+    // LSD, stable, so the lower digits stay sorted within the higher ones
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t* histogram = histograms[pass];
+        const int shift = pass * RADIX_BITS;
+
+        // NOTE: most passes are over bits every key shares (unused pass bits, small ids), skip them
+        if (count == 0 || histogram[(src[0].key >> shift) & (RADIX_SIZE - 1)] == count) continue;
+
+        uint32_t offset = 0;
+        for (int digit = 0; digit < RADIX_SIZE; digit++) {
+            uint32_t n = histogram[digit];
+            histogram[digit] = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            dst[histogram[(src[i].key >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    entries = src;
+}
+
+void RenderQueue::record(CommandList& list, size_t begin, size_t end) const {
+    // NOTE: every list starts from unknown state, the lists may run after anything
+    GLuint program = 0;
+    GLuint vao = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        const DrawPacket& packet = packets[entries[i].packet];
+
+        if (packet.program != program) {
+            program = packet.program;
+            list.use_program(program);
+        }
+        if (packet.vao != vao) {
+            vao = packet.vao;
+            list.bind_vertex_array(vao);
+        }
+
+        list.uniform_mat4(packet.model_loc, *packet.model);
+        if (packet.index_type) {
+            list.draw_elements(GL_TRIANGLES, packet.index_type, packet.first, packet.count);
+        } else {
+            list.draw_arrays(GL_TRIANGLES, packet.first, packet.count);
+        }
+    }
+}
+
+void RenderQueue::submit(Arena& arena) {
+    if (count == 0) return;
+
+    // one list per thread at most, and none so short that the state setup at its start dominates
+    size_t list_count = (count + MIN_PACKETS_PER_LIST - 1) / MIN_PACKETS_PER_LIST;
+    if (list_count > jobs_thread_count()) list_count = jobs_thread_count();
+    if (list_count == 0) list_count = 1;
+    if (list_count > lists.size()) lists.resize(list_count);
+
+    parallel_for(list_count, 1, [&](size_t begin, size_t end) {
+        for (size_t l = begin; l < end; l++) {
+            lists[l].reset(arena);
+            record(lists[l], count * l / list_count, count * (l + 1) / list_count);
+        }
+    });
+
+    for (size_t l = 0; l < list_count; l++) lists[l].execute();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "gl.hh"
+#include "math.hh"
+#include "command_list.hh"
+#include "arena.hh"
+
+// Sort key layout, most significant first:
+//
+//   pass:4 | translucent:1 | depth:15 | program:10 | material:16 | mesh:18
+//
+// Opaque draws go front to back, translucent ones back to front. The depth is
+// coarse enough that neighbouring objects land in the same bucket and get
+// grouped by state inside it.
+constexpr int SORT_KEY_MESH_BITS = 18;
+constexpr int SORT_KEY_MATERIAL_BITS = 16;
+constexpr int SORT_KEY_PROGRAM_BITS = 10;
+constexpr int SORT_KEY_DEPTH_BITS = 15;
+constexpr int SORT_KEY_PASS_BITS = 4;
+
+// passes are drawn in this order
+enum RenderPass {
+    RENDER_PASS_SCENE,
+    RENDER_PASS_OVERLAY,
+};
+
+// `depth` is the view distance normalized to [0, 1], anything outside is clamped
+uint64_t make_sort_key(uint32_t pass, bool translucent, float depth, uint32_t program, uint32_t material,
+                       uint32_t mesh);
+
+// Everything needed to issue one draw, the model matrix has to stay alive
+// until the queue was submitted.
+struct DrawPacket {
+    uint64_t key;
+    const Mat4* model;
+    GLuint program;
+    GLuint vao;
+    GLint model_loc;
+    // in indices when `index_type` isn't 0, the element buffer is part of the VAO
+    GLint first;
+    GLsizei count;
+    GLenum index_type;
+};
+
+struct SortEntry {
+    uint64_t key;
+    uint32_t packet;
+};
+
+// Draws are pushed into per-thread buckets without locking, then merged and
+// radix sorted by key. The sorted packets are recorded into command lists in
+// parallel, with only the state changes between neighbouring packets, and the
+// lists are replayed in order on the GL thread.
+struct RenderQueue {
+    // empties the buckets, call on the GL thread before pushing
+    void begin();
+
+    // any thread attached to the job system
+    void push(const DrawPacket& packet);
+
+    // merges the buckets and sorts the packets by key, the result lives in
+    // `arena` until the queue was submitted
+    void sort(Arena& arena);
+
+    // records the sorted packets [begin, end) into `list`
+    void record(CommandList& list, size_t begin, size_t end) const;
+
+    // records the sorted draws with the command lists in `arena` and replays
+    // them, GL thread only
+    void submit(Arena& arena);
+
+    inline size_t size() const {
+        return count;
+    }
+
+    std::vector<std::vector<DrawPacket>> buckets;
+
+    DrawPacket* packets = nullptr;
+    SortEntry* entries = nullptr;
+    size_t count = 0;
+
+    std::vector<CommandList> lists;
+};
@@ -0,0 +1,168 @@
+#include "common.hh"
+#include "resources.hh"
+
+BufferHandle GpuResources::create_buffer(GLenum target, size_t size, const void* data, GLenum usage) {
+    Buffer buffer = {0, target, size};
+
+    glGenBuffers(1, &buffer.buffer);
+    glBindBuffer(target, buffer.buffer);
+    glBufferData(target, size, data, usage);
+
+    return buffers.create(buffer);
+}
+
+// all the positions, then the colors, out of the bound GL_ARRAY_BUFFER into the bound VAO
+static void set_vertex_layout(size_t position_bytes, GLint color_components, GLenum color_type) {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, color_components, color_type, color_type != GL_FLOAT, 0, cast(void*) position_bytes);
+}
+
+// the colors are `color_size` bytes per vertex, read as `color_components` of `color_type`
+static Mesh build_mesh(GpuResources& resources, const float* positions, const void* colors, size_t color_size,
+                       GLint color_components, GLenum color_type, GLsizei vertex_count, const GLuint* indices,
+                       GLsizei index_count) {
+    Mesh mesh = {};
+    mesh.vertex_count = vertex_count;
+    mesh.index_count = index_count;
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    const size_t position_bytes = vertex_count * 3 * sizeof(float);
+    const size_t color_bytes = vertex_count * color_size;
+
+    mesh.vertices = resources.create_buffer(GL_ARRAY_BUFFER, position_bytes + color_bytes, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, position_bytes, positions);
+    glBufferSubData(GL_ARRAY_BUFFER, position_bytes, color_bytes, colors);
+
+    set_vertex_layout(position_bytes, color_components, color_type);
+
+    if (indices || index_count) {
+        // NOTE: the element buffer binding is VAO state, so this sticks to the mesh
+        mesh.indices = resources.create_buffer(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(GLuint), indices,
+                                               GL_STATIC_DRAW);
+        mesh.index_type = GL_UNSIGNED_INT;
+    }
+
+    return mesh;
+}
+
+MeshHandle GpuResources::create_mesh(const float* positions, const float* colors, GLsizei vertex_count,
+                                     const GLuint* indices, GLsizei index_count) {
+    return meshes.create(build_mesh(*this, positions, colors, 3 * sizeof(float), 3, GL_FLOAT, vertex_count, indices,
+                                    index_count));
+}
+
+MeshHandle GpuResources::create_mesh(const float* positions, const uint8_t* colors_rgba8, GLsizei vertex_count,
+                                     const GLuint* indices, GLsizei index_count) {
+    // NOTE: the alpha goes into the vec3 attribute fine, it's just dropped
+    return meshes.create(build_mesh(*this, positions, colors_rgba8, 4, 4, GL_UNSIGNED_BYTE, vertex_count, indices,
+                                    index_count));
+}
+
+MeshHandle GpuResources::create_mesh(BufferHandle vertices, BufferHandle indices, GLsizei vertex_count,
+                                     GLsizei index_count) {
+    Mesh mesh = {};
+    mesh.vertices = vertices;
+    mesh.indices = indices;
+    mesh.vertex_count = vertex_count;
+    mesh.index_count = index_count;
+
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.get(vertices)->buffer);
+    set_vertex_layout(vertex_count * 3 * sizeof(float), 4, GL_UNSIGNED_BYTE);
+
+    if (const Buffer* buffer = buffers.get(indices)) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->buffer);
+        mesh.index_type = GL_UNSIGNED_INT;
+    }
+
+    return meshes.create(mesh);
+}
+
+MeshHandle GpuResources::add_mesh(const Mesh& mesh) {
+    return meshes.create(mesh);
+}
+
+BufferHandle GpuResources::add_buffer(const Buffer& buffer) {
+    return buffers.create(buffer);
+}
+
+TextureHandle GpuResources::add_texture(const Texture& texture) {
+    return textures.create(texture);
+}
+
+ProgramHandle GpuResources::create_program(const char* vert_src, const char* frag_src) {
+    auto vert = create_shader(GL_VERTEX_SHADER, vert_src);
+    auto frag = create_shader(GL_FRAGMENT_SHADER, frag_src);
+
+    Program program;
+    program.program = ::create_program(vert, frag);
+    program.model_loc = glGetUniformLocation(program.program, "model");
+
+    glDeleteShader(vert);
+    glDeleteShader(frag);
+
+    return programs.create(program);
+}
+
+TextureHandle GpuResources::create_texture(int width, int height, GLenum internal_format, GLenum format,
+                                           GLenum type, const void* data) {
+    Texture texture = {0, width, height, internal_format};
+
+    glGenTextures(1, &texture.texture);
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return textures.create(texture);
+}
+
+void GpuResources::destroy(BufferHandle handle) {
+    const Buffer* buffer = buffers.get(handle);
+    if (!buffer) return;
+
+    glDeleteBuffers(1, &buffer->buffer);
+    buffers.destroy(handle);
+}
+
+void GpuResources::destroy(MeshHandle handle) {
+    const Mesh* mesh = meshes.get(handle);
+    if (!mesh) return;
+
+    glDeleteVertexArrays(1, &mesh->vao);
+    destroy(mesh->vertices);
+    destroy(mesh->indices);
+    meshes.destroy(handle);
+}
+
+void GpuResources::destroy(ProgramHandle handle) {
+    const Program* program = programs.get(handle);
+    if (!program) return;
+
+    glDeleteProgram(program->program);
+    programs.destroy(handle);
+}
+
+void GpuResources::destroy(TextureHandle handle) {
+    const Texture* texture = textures.get(handle);
+    if (!texture) return;
+
+    glDeleteTextures(1, &texture->texture);
+    textures.destroy(handle);
+}
+
+void GpuResources::destroy_all() {
+    // NOTE: from the back, destroying moves the last item into the freed spot
+    while (meshes.size()) destroy(meshes.handle_at(meshes.size() - 1));
+    while (buffers.size()) destroy(buffers.handle_at(buffers.size() - 1));
+    while (programs.size()) destroy(programs.handle_at(programs.size() - 1));
+    while (textures.size()) destroy(textures.handle_at(textures.size() - 1));
+}
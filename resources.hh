@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gl.hh"
+#include "pool.hh"
+
+using BufferHandle = Handle<struct BufferTag>;
+using MeshHandle = Handle<struct MeshTag>;
+using ProgramHandle = Handle<struct ProgramTag>;
+using TextureHandle = Handle<struct TextureTag>;
+
+struct Buffer {
+    GLuint buffer;
+    GLenum target;
+    size_t size;
+};
+
+// positions on attribute 0 and colors on attribute 1; `create_mesh` lays
+// them out as all the positions (vec3), then all the colors (vec3 or
+// normalized rgba8)
+struct Mesh {
+    GLuint vao;
+    // the buffers that go with the mesh, null if it has none or they are shared
+    BufferHandle vertices;
+    BufferHandle indices;
+    GLsizei vertex_count;
+    GLsizei index_count;
+    // GL_UNSIGNED_INT/SHORT/BYTE, 0 when the mesh isn't indexed
+    GLenum index_type;
+    // where the indices start in the element buffer, in indices
+    GLint first_index;
+};
+
+struct Program {
+    GLuint program;
+    // -1 if the program doesn't have a `model` uniform
+    GLint model_loc;
+};
+
+struct Texture {
+    GLuint texture;
+    int width;
+    int height;
+    GLenum internal_format;
+};
+
+// Owns every GL object it hands out a handle for. Destroying through a stale
+// handle is a no-op, and resolving one gives null.
+struct GpuResources {
+    BufferHandle create_buffer(GLenum target, size_t size, const void* data, GLenum usage);
+    // null `indices` with a count leave the index buffer for the caller to fill
+    MeshHandle create_mesh(const float* positions, const float* colors, GLsizei vertex_count,
+                           const GLuint* indices = nullptr, GLsizei index_count = 0);
+    MeshHandle create_mesh(const float* positions, const uint8_t* colors_rgba8, GLsizei vertex_count,
+                           const GLuint* indices = nullptr, GLsizei index_count = 0);
+    // over buffers in the rgba8 layout above that were uploaded elsewhere (see GpuLoader), the mesh owns them
+    MeshHandle create_mesh(BufferHandle vertices, BufferHandle indices, GLsizei vertex_count, GLsizei index_count);
+    // takes over a mesh whose vertex array was set up by the caller
+    MeshHandle add_mesh(const Mesh& mesh);
+    // takes over a buffer or texture made by the caller
+    BufferHandle add_buffer(const Buffer& buffer);
+    TextureHandle add_texture(const Texture& texture);
+    ProgramHandle create_program(const char* vert_src, const char* frag_src);
+    TextureHandle create_texture(int width, int height, GLenum internal_format, GLenum format, GLenum type,
+                                 const void* data);
+
+    void destroy(BufferHandle handle);
+    // the mesh's buffers go with it
+    void destroy(MeshHandle handle);
+    void destroy(ProgramHandle handle);
+    void destroy(TextureHandle handle);
+
+    void destroy_all();
+
+    inline const Buffer* get(BufferHandle handle) const {
+        return buffers.get(handle);
+    }
+
+    inline const Mesh* get(MeshHandle handle) const {
+        return meshes.get(handle);
+    }
+
+    inline const Program* get(ProgramHandle handle) const {
+        return programs.get(handle);
+    }
+
+    inline const Texture* get(TextureHandle handle) const {
+        return textures.get(handle);
+    }
+
+    Pool<Buffer, BufferTag> buffers;
+    Pool<Mesh, MeshTag> meshes;
+    Pool<Program, ProgramTag> programs;
+    Pool<Texture, TextureTag> textures;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "math.hh"
+
+// Built-in geometry, generated at compile time. Assigned to a constexpr
+// variable the arrays are baked into rodata and nothing runs at startup:
+//
+//   static constexpr auto box = make_box(Vec3{0.5f, 0.5f, 0.5f});
+//
+// The layout is what GpuResources::create_mesh takes, and the indices are
+// counter-clockwise seen from the outside. Flat shapes get their own vertices
+// for every face so each face has one color.
+template <size_t V, size_t I>
+struct ShapeMesh {
+    static constexpr size_t VERTEX_COUNT = V;
+    static constexpr size_t INDEX_COUNT = I;
+
+    float positions[V * 3];
+    float colors[V * 3];
+    uint32_t indices[I];
+};
+
+// cycled through for the faces of the flat shapes
+constexpr Vec3 SHAPE_FACE_COLORS[] = {
+    {1.0f, 0.0f, 0.0f},
+    {0.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 1.0f},
+    {0.5f, 0.5f, 0.0f},
+    {0.0f, 1.0f, 1.0f},
+    {0.8f, 0.8f, 0.8f},
+};
+constexpr size_t SHAPE_FACE_COLOR_COUNT = sizeof(SHAPE_FACE_COLORS) / sizeof(SHAPE_FACE_COLORS[0]);
+
+template <size_t V, size_t I>
+struct ShapeBuilder {
+    constexpr uint32_t vertex(Vec3 p, Vec3 color) {
+        mesh.positions[vertex_count * 3 + 0] = p.x;
+        mesh.positions[vertex_count * 3 + 1] = p.y;
+        mesh.positions[vertex_count * 3 + 2] = p.z;
+        mesh.colors[vertex_count * 3 + 0] = color.x;
+        mesh.colors[vertex_count * 3 + 1] = color.y;
+        mesh.colors[vertex_count * 3 + 2] = color.z;
+        return vertex_count++;
+    }
+
+    constexpr void triangle(uint32_t a, uint32_t b, uint32_t c) {
+        mesh.indices[index_count++] = a;
+        mesh.indices[index_count++] = b;
+        mesh.indices[index_count++] = c;
+    }
+
+    constexpr void flat_triangle(Vec3 a, Vec3 b, Vec3 c) {
+        Vec3 color = next_face_color();
+        uint32_t first = vertex(a, color);
+        vertex(b, color);
+        vertex(c, color);
+        triangle(first, first + 1, first + 2);
+    }
+
+    // `a` to `d` go around the quad
+    constexpr void flat_quad(Vec3 a, Vec3 b, Vec3 c, Vec3 d) {
+        Vec3 color = next_face_color();
+        uint32_t first = vertex(a, color);
+        vertex(b, color);
+        vertex(c, color);
+        vertex(d, color);
+        triangle(first, first + 1, first + 2);
+        triangle(first, first + 2, first + 3);
+    }
+
+    // a convex polygon as a triangle fan, `points` go around it
+    constexpr void flat_polygon(const Vec3* points, size_t count) {
+        Vec3 color = next_face_color();
+        uint32_t first = vertex(points[0], color);
+        for (size_t i = 1; i < count; i++) vertex(points[i], color);
+        for (uint32_t i = 1; i + 1 < count; i++) triangle(first, first + i, first + i + 1);
+    }
+
+    constexpr Vec3 next_face_color() {
+        return SHAPE_FACE_COLORS[face_count++ % SHAPE_FACE_COLOR_COUNT];
+    }
+
+    // NOTE: a constant expression can't leave anything uninitialized
+    ShapeMesh<V, I> mesh = {};
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    size_t face_count = 0;
+};
+
+// the corner of a regular polygon in the xz plane, the first edge faces +z
+constexpr Vec3 shape_ring_point(size_t i, size_t sides, float radius, float y) {
+    float s, c;
+    fast_sincos((i - 0.5f) * 2.0f * cast(float) M_PI / sides, &s, &c);
+    return Vec3{radius * s, y, radius * c};
+}
+
+constexpr ShapeMesh<24, 36> make_box(Vec3 half_extents) {
+    ShapeBuilder<24, 36> b;
+    const float x = half_extents.x, y = half_extents.y, z = half_extents.z;
+
+    b.flat_quad(Vec3{-x, -y,  z}, Vec3{ x, -y,  z}, Vec3{ x,  y,  z}, Vec3{-x,  y,  z});
+    b.flat_quad(Vec3{ x, -y, -z}, Vec3{-x, -y, -z}, Vec3{-x,  y, -z}, Vec3{ x,  y, -z});
+    b.flat_quad(Vec3{ x, -y,  z}, Vec3{ x, -y, -z}, Vec3{ x,  y, -z}, Vec3{ x,  y,  z});
+    b.flat_quad(Vec3{-x, -y, -z}, Vec3{-x, -y,  z}, Vec3{-x,  y,  z}, Vec3{-x,  y, -z});
+    b.flat_quad(Vec3{-x,  y,  z}, Vec3{ x,  y,  z}, Vec3{ x,  y, -z}, Vec3{-x,  y, -z});
+    b.flat_quad(Vec3{-x, -y, -z}, Vec3{ x, -y, -z}, Vec3{ x, -y,  z}, Vec3{-x, -y,  z});
+
+    return b.mesh;
+}
+
+// `SIDES` triangles meeting at the apex over a regular polygon base with the
+// given circumradius, centered on the origin
+template <size_t SIDES>
+constexpr ShapeMesh<SIDES * 4, SIDES * 3 + (SIDES - 2) * 3> make_pyramid(float radius, float height) {
+    static_assert(SIDES >= 3, "a pyramid needs at least 3 sides");
+
+    ShapeBuilder<SIDES * 4, SIDES * 3 + (SIDES - 2) * 3> b;
+    const Vec3 apex = {0.0f, height * 0.5f, 0.0f};
+
+    Vec3 base[SIDES];
+    for (size_t i = 0; i < SIDES; i++) base[i] = shape_ring_point(i, SIDES, radius, -height * 0.5f);
+
+    for (size_t i = 0; i < SIDES; i++) b.flat_triangle(base[i], base[(i + 1) % SIDES], apex);
+
+    // NOTE: reversed, the base faces down
+    Vec3 bottom[SIDES];
+    for (size_t i = 0; i < SIDES; i++) bottom[i] = base[SIDES - 1 - i];
+    b.flat_polygon(bottom, SIDES);
+
+    return b.mesh;
+}
+
+// a regular polygon with the given circumradius extruded along y
+template <size_t SIDES>
+constexpr ShapeMesh<SIDES * 6, SIDES * 6 + (SIDES - 2) * 6> make_prism(float radius, float height) {
+    static_assert(SIDES >= 3, "a prism needs at least 3 sides");
+
+    ShapeBuilder<SIDES * 6, SIDES * 6 + (SIDES - 2) * 6> b;
+
+    Vec3 bottom[SIDES], top[SIDES];
+    for (size_t i = 0; i < SIDES; i++) {
+        bottom[i] = shape_ring_point(i, SIDES, radius, -height * 0.5f);
+        top[i] = shape_ring_point(i, SIDES, radius, height * 0.5f);
+    }
+
+    for (size_t i = 0; i < SIDES; i++) {
+        size_t j = (i + 1) % SIDES;
+        b.flat_quad(bottom[i], bottom[j], top[j], top[i]);
+    }
+
+    b.flat_polygon(top, SIDES);
+
+    Vec3 reversed[SIDES];
+    for (size_t i = 0; i < SIDES; i++) reversed[i] = bottom[SIDES - 1 - i];
+    b.flat_polygon(reversed, SIDES);
+
+    return b.mesh;
+}
+
+// UV sphere; the vertices are shared and colored by their normal
+template <size_t SEGMENTS, size_t RINGS>
+constexpr ShapeMesh<(SEGMENTS + 1) * (RINGS + 1), SEGMENTS * RINGS * 6> make_sphere(float radius) {
+    static_assert(SEGMENTS >= 3 && RINGS >= 2, "too few segments for a sphere");
+
+    ShapeBuilder<(SEGMENTS + 1) * (RINGS + 1), SEGMENTS * RINGS * 6> b;
+
+    // NOTE: the seam column is duplicated, the indices don't wrap around
+    for (size_t ring = 0; ring <= RINGS; ring++) {
+        float ring_sin, ring_cos;
+        fast_sincos(cast(float) M_PI * ring / RINGS, &ring_sin, &ring_cos);
+
+        for (size_t segment = 0; segment <= SEGMENTS; segment++) {
+            float segment_sin, segment_cos;
+            fast_sincos(2.0f * cast(float) M_PI * segment / SEGMENTS, &segment_sin, &segment_cos);
+
+            Vec3 normal = {ring_sin * segment_sin, ring_cos, ring_sin * segment_cos};
+            b.vertex(normal * radius, normal * 0.5f + Vec3{0.5f, 0.5f, 0.5f});
+        }
+    }
+
+    for (uint32_t ring = 0; ring < RINGS; ring++) {
+        for (uint32_t segment = 0; segment < SEGMENTS; segment++) {
+            uint32_t a = ring * (SEGMENTS + 1) + segment;
+            uint32_t c = a + SEGMENTS + 1;
+
+            b.triangle(a, c, c + 1);
+            b.triangle(a, c + 1, a + 1);
+        }
+    }
+
+    return b.mesh;
+}
+
+// `CELLS` x `CELLS` quads in the xz plane facing +y, colored by position
+template <size_t CELLS>
+constexpr ShapeMesh<(CELLS + 1) * (CELLS + 1), CELLS * CELLS * 6> make_grid(float half_size) {
+    static_assert(CELLS >= 1, "a grid needs at least one cell");
+
+    ShapeBuilder<(CELLS + 1) * (CELLS + 1), CELLS * CELLS * 6> b;
+
+    for (size_t z = 0; z <= CELLS; z++) {
+        for (size_t x = 0; x <= CELLS; x++) {
+            float u = cast(float) x / CELLS;
+            float v = cast(float) z / CELLS;
+            b.vertex(Vec3{(u * 2 - 1) * half_size, 0.0f, (v * 2 - 1) * half_size}, Vec3{u, 0.5f, v});
+        }
+    }
+
+    for (uint32_t z = 0; z < CELLS; z++) {
+        for (uint32_t x = 0; x < CELLS; x++) {
+            uint32_t a = z * (CELLS + 1) + x;
+            uint32_t c = a + CELLS + 1;
+
+            b.triangle(a, c, c + 1);
+            b.triangle(a, c + 1, a + 1);
+        }
+    }
+
+    return b.mesh;
+}
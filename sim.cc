@@ -0,0 +1,290 @@
+#include <cstdio>
+#include <cmath>
+
+#include <algorithm>
+
+#include <GLFW/glfw3.h>
+
+#include "common.hh"
+#include "sim.hh"
+#include "jobs.hh"
+
+// a grid of pyramids in front of the camera, the first row is centered at z = -5
+constexpr int SCENE_SIDE = 32;
+
+// the nearby objects double as occluders for everything behind them
+constexpr size_t MAX_OCCLUDERS = 32;
+constexpr float OCCLUDER_DISTANCE = 8.0f;
+
+// radians per second, every object is a bit ahead of the previous one
+constexpr float SPIN_SPEED = 1.0f;
+constexpr float SPIN_PHASE_STEP = 0.1f;
+
+void Simulation::init(const Mat4& projection, float z_far, const float* positions, size_t vertex_count,
+                      const uint32_t* indices, size_t index_count, bool cull_on_cpu) {
+    camera.set_projection(projection, z_far);
+    occluder_positions = positions;
+    occluder_vertex_count = vertex_count;
+    occluder_indices = indices;
+    occluder_index_count = index_count;
+    cpu_culling = cull_on_cpu;
+
+    // Every row hangs off its own node, and all the rows are added before the
+    // objects so the object matrices end up contiguous in `transforms.world`.
+    const size_t count = SCENE_SIDE * SCENE_SIDE;
+
+    uint32_t scene_root = transforms.add(TRANSFORM_NO_PARENT, Vec3{0.0f, 0.0f, 0.0f});
+
+    uint32_t row_nodes[SCENE_SIDE];
+    for (int z = 0; z < SCENE_SIDE; z++) {
+        row_nodes[z] = transforms.add(scene_root, Vec3{0.0f, 0.0f, -5.0f - z * 2.0f});
+    }
+
+    first_object_node = transforms.size();
+    for (int z = 0; z < SCENE_SIDE; z++) {
+        for (int x = 0; x < SCENE_SIDE; x++) {
+            transforms.add(row_nodes[z], Vec3{(x - SCENE_SIDE / 2) * 2.0f, 0.0f, 0.0f});
+        }
+    }
+
+    transforms.update();
+
+    object_local_bounds = Aabb::from_center(Vec3{0.0f, 0.0f, 0.0f}, Vec3{0.5f, 0.5f, 0.5f});
+
+    const Mat4* object_world = transforms.world.data() + first_object_node;
+
+    object_bounds.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        object_bounds[i] = transform_aabb(object_world[i], object_local_bounds);
+    }
+
+    object_bvh.build(object_bounds.data(), count);
+
+    transform_version = 1;
+    changed_begin = 0;
+    changed_end = count;
+
+    frame_arena.init(FRAME_ARENA_SIZE);
+
+    // NOTE: sized once up front, so publishing a frame never allocates
+    for (FrameSnapshot& snapshot : frames.slots) {
+        snapshot.object_world.resize(count);
+        snapshot.object_bounds.resize(count);
+    }
+}
+
+void Simulation::start() {
+    last_time = glfwGetTime();
+    running = true;
+    thread = std::thread([this] { run(); });
+}
+
+void Simulation::stop() {
+    running = false;
+    // wake it up if it waits for the renderer
+    consumed.store(UINT64_MAX);
+    consumed.notify_all();
+
+    thread.join();
+}
+
+void Simulation::set_input(const InputState& state) {
+    std::lock_guard<std::mutex> lock(input_mutex);
+
+    float dx = input.mouse_dx + state.mouse_dx;
+    float dy = input.mouse_dy + state.mouse_dy;
+
+    input = state;
+    input.mouse_dx = dx;
+    input.mouse_dy = dy;
+}
+
+const FrameSnapshot& Simulation::acquire_frame() {
+    uint64_t seen = frames.front().frame;
+
+    for (;;) {
+        uint64_t latest = published.load(std::memory_order_acquire);
+        if (latest > seen) break;
+
+        published.wait(latest, std::memory_order_acquire);
+    }
+
+    frames.update();
+
+    consumed.store(frames.front().frame, std::memory_order_release);
+    consumed.notify_one();
+
+    return frames.front();
+}
+
+void Simulation::run() {
+    jobs_attach_thread();
+
+    while (running.load(std::memory_order_acquire)) {
+        InputState state;
+        {
+            std::lock_guard<std::mutex> lock(input_mutex);
+            state = input;
+
+            input.mouse_dx = 0;
+            input.mouse_dy = 0;
+        }
+
+        frame_arena.next();
+        tick(state);
+
+        FrameSnapshot& snapshot = frames.back();
+        write_snapshot(snapshot);
+        snapshot.frame = ++frame;
+
+        frames.publish();
+        published.store(frame, std::memory_order_release);
+        published.notify_one();
+
+        // don't run ahead by more than a frame, the renderer would only get
+        // to see every other snapshot and the input lag grows
+        for (;;) {
+            uint64_t done = consumed.load(std::memory_order_acquire);
+            if (done >= frame) break;
+
+            consumed.wait(done, std::memory_order_acquire);
+        }
+    }
+}
+
+void Simulation::tick(const InputState& state) {
+    double now = glfwGetTime();
+    delta_time = now - last_time;
+    last_time = now;
+    time = now;
+
+    printf("%f\n", delta_time);
+
+    const float camera_speed = 5.f * delta_time;
+
+    float forward = 0, right = 0;
+    if (state.forward) forward += camera_speed;
+    if (state.back) forward -= camera_speed;
+    if (state.right) right += camera_speed;
+    if (state.left) right -= camera_speed;
+
+    camera.add_mouse_delta(state.mouse_dx, state.mouse_dy);
+    camera.move(forward, right);
+    camera.update();
+
+    // pick whatever is in the middle of the screen on click
+    if (state.pick && !mouse_was_down) {
+        float t;
+        int64_t picked = object_bvh.raycast(Ray{camera.position, camera.front}, camera.z_far, &t);
+        if (picked >= 0) printf("picked object %ld at distance %f\n", picked, t);
+    }
+    mouse_was_down = state.pick;
+
+    if (state.spin && !spin_was_down) spinning = !spinning;
+    spin_was_down = state.spin;
+
+    if (spinning) {
+        // NOTE: kept small, the fast sincos is only accurate to 8192 radians
+        spin_angle = fmodf(spin_angle + SPIN_SPEED * delta_time, 2.0f * M_PI);
+
+        ScratchScope scratch;
+        float* angles = scratch.arena.allocate_array<float>(object_count());
+        for (size_t i = 0; i < object_count(); i++) angles[i] = spin_angle + i * SPIN_PHASE_STEP;
+
+        transforms.set_rotations(first_object_node, object_count(), Vec3{0.0f, 1.0f, 0.0f}, angles);
+    }
+
+    if (transforms.update()) {
+        const Mat4* object_world = transforms.world.data() + first_object_node;
+
+        parallel_for(object_count(), 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (!transforms.changed[first_object_node + i]) continue;
+                object_bounds[i] = transform_aabb(object_world[i], object_local_bounds);
+            }
+        });
+
+        object_bvh.refit(object_bounds.data());
+
+        changed_begin = transforms.changed_begin > first_object_node ? transforms.changed_begin - first_object_node : 0;
+        changed_end = transforms.changed_end > first_object_node ? transforms.changed_end - first_object_node : 0;
+        transform_version++;
+    }
+}
+
+void Simulation::write_snapshot(FrameSnapshot& snapshot) {
+    snapshot.time = time;
+    // NOTE: plain copies, the camera only rebuilds these when it moved
+    snapshot.camera_version = camera.version;
+    snapshot.camera_pos = camera.position;
+    snapshot.view = camera.view;
+    snapshot.projection = camera.projection;
+    snapshot.view_projection = camera.view_projection;
+    snapshot.frustum = camera.frustum;
+
+    // NOTE: the slot may be a couple of versions behind, so it gets everything and not just the last range
+    if (snapshot.transform_version != transform_version) {
+        const Mat4* object_world = transforms.world.data() + first_object_node;
+
+        std::copy(object_world, object_world + object_count(), snapshot.object_world.begin());
+        std::copy(object_bounds.begin(), object_bounds.end(), snapshot.object_bounds.begin());
+
+        snapshot.transform_version = transform_version;
+        snapshot.changed_begin = changed_begin;
+        snapshot.changed_end = changed_end;
+    }
+
+    if (!cpu_culling) return;
+
+    uint32_t* visible = frame_arena.current().allocate_array<uint32_t>(object_count());
+
+    // NOTE: copied, the last result is in the other half of the frame arena, which is reset next tick
+    if (culled_visible && culled_camera_version == camera.version && culled_transform_version == transform_version) {
+        std::copy(culled_visible, culled_visible + culled_count, visible);
+
+        culled_visible = visible;
+        snapshot.visible = visible;
+        snapshot.visible_count = culled_count;
+        return;
+    }
+
+    size_t visible_count = object_bvh.cull(snapshot.frustum, visible);
+
+    occlusion.clear(snapshot.view_projection);
+
+    const Mat4* object_world = snapshot.object_world.data();
+
+    size_t occluder_count = 0;
+    for (size_t i = 0; i < visible_count && occluder_count < MAX_OCCLUDERS; i++) {
+        uint32_t object = visible[i];
+        if ((object_bounds[object].center() - camera.position).length() > OCCLUDER_DISTANCE) continue;
+
+        occlusion.rasterize(object_world[object], occluder_positions, occluder_vertex_count, occluder_indices,
+                            occluder_index_count);
+        occluder_count++;
+    }
+
+    occlusion.build_hiz();
+
+    ScratchScope scratch;
+    uint8_t* unoccluded = scratch.arena.allocate_array<uint8_t>(visible_count);
+
+    parallel_for(visible_count, 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            unoccluded[i] = occlusion.test_aabb(object_bounds[visible[i]]);
+        }
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < visible_count; i++) {
+        if (unoccluded[i]) visible[kept++] = visible[i];
+    }
+
+    culled_camera_version = camera.version;
+    culled_transform_version = transform_version;
+    culled_visible = visible;
+    culled_count = kept;
+
+    snapshot.visible = visible;
+    snapshot.visible_count = kept;
+}
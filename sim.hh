@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "math.hh"
+#include "cull.hh"
+#include "bvh.hh"
+#include "occlusion.hh"
+#include "transform.hh"
+#include "triple_buffer.hh"
+#include "arena.hh"
+#include "camera.hh"
+
+// What the main thread saw of the keyboard and mouse at its last poll, GLFW
+// only lets the main thread ask.
+struct InputState {
+    bool forward = false;
+    bool back = false;
+    bool left = false;
+    bool right = false;
+    // left mouse button held
+    bool pick = false;
+    // toggles the objects spinning
+    bool spin = false;
+
+    // cursor movement since the simulation last took the input
+    float mouse_dx = 0;
+    float mouse_dy = 0;
+};
+
+// Everything the render thread needs for one frame. Written by the simulation
+// thread only, and never touched again once published.
+struct FrameSnapshot {
+    uint64_t frame = 0;
+    float time = 0;
+
+    // bumped whenever the camera moved
+    uint64_t camera_version = 0;
+    Vec3 camera_pos;
+    Mat4 view;
+    Mat4 projection;
+    Mat4 view_projection;
+    Frustum frustum;
+
+    // bumped every time an object moved; the renderer compares it to what it
+    // uploaded last, `changed_begin`/`changed_end` is the object range that
+    // moved between `transform_version - 1` and `transform_version`
+    uint64_t transform_version = 0;
+    size_t changed_begin = 0;
+    size_t changed_end = 0;
+    std::vector<Mat4> object_world;
+    std::vector<Aabb> object_bounds;
+
+    // only filled with CPU culling, lives in the simulation's frame arena
+    const uint32_t* visible = nullptr;
+    size_t visible_count = 0;
+};
+
+// Input, camera and scene updates on their own thread. Every tick ends with a
+// snapshot in a triple buffer, so frame N+1 is simulated while the GL thread
+// submits frame N and blocks on the swap.
+struct Simulation {
+    // the occluder mesh must stay alive as long as the simulation runs
+    void init(const Mat4& projection, float z_far, const float* occluder_positions, size_t occluder_vertex_count,
+              const uint32_t* occluder_indices, size_t occluder_index_count, bool cpu_culling);
+
+    void start();
+    void stop();
+
+    // main thread; the mouse movement adds up until the simulation takes it
+    void set_input(const InputState& input);
+
+    // render thread; blocks until there is a snapshot newer than the last one
+    // it got, the reference stays valid until the next call
+    const FrameSnapshot& acquire_frame();
+
+    void run();
+    void tick(const InputState& input);
+    void write_snapshot(FrameSnapshot& snapshot);
+
+    inline size_t object_count() const {
+        return object_bounds.size();
+    }
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    std::mutex input_mutex;
+    InputState input;
+
+    TripleBuffer<FrameSnapshot> frames;
+    // last frame number published by the simulation and picked up by the
+    // renderer; the simulation stays at most one frame ahead
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> consumed{0};
+    uint64_t frame = 0;
+
+    // per tick data the snapshots point to; being at most one frame ahead, the
+    // renderer is done with a frame by the time its arena comes around again
+    FrameArena frame_arena;
+
+    bool cpu_culling = false;
+
+    double last_time = 0;
+    float time = 0;
+    float delta_time = 0;
+
+    Camera camera;
+    bool mouse_was_down = false;
+
+    bool spinning = false;
+    bool spin_was_down = false;
+    float spin_angle = 0;
+
+    TransformHierarchy transforms;
+    uint32_t first_object_node = 0;
+    Aabb object_local_bounds;
+    std::vector<Aabb> object_bounds;
+    Bvh object_bvh;
+
+    uint64_t transform_version = 0;
+    size_t changed_begin = 0;
+    size_t changed_end = 0;
+
+    // the culling result is reused as long as neither the camera nor the objects moved
+    uint64_t culled_camera_version = 0;
+    uint64_t culled_transform_version = 0;
+    const uint32_t* culled_visible = nullptr;
+    size_t culled_count = 0;
+
+    const float* occluder_positions = nullptr;
+    size_t occluder_vertex_count = 0;
+    const uint32_t* occluder_indices = nullptr;
+    size_t occluder_index_count = 0;
+    OcclusionBuffer occlusion;
+};
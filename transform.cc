@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "transform.hh"
+#include "fast_trig.hh"
+
+uint32_t TransformHierarchy::add(int32_t parent_index, Vec3 translation, Vec3 scale) {
+    uint32_t node = size();
+    if (parent_index >= (int32_t)node) die("transform parents must be added before their children");
+
+    parent.push_back(parent_index);
+
+    pos_x.push_back(translation.x);
+    pos_y.push_back(translation.y);
+    pos_z.push_back(translation.z);
+
+    rot_x.push_back(0);
+    rot_y.push_back(0);
+    rot_z.push_back(0);
+    rot_w.push_back(1);
+
+    scale_x.push_back(scale.x);
+    scale_y.push_back(scale.y);
+    scale_z.push_back(scale.z);
+
+    dirty.push_back(1);
+    changed.push_back(0);
+    world.emplace_back();
+
+    return node;
+}
+
+void TransformHierarchy::set_translation(uint32_t node, Vec3 translation) {
+    pos_x[node] = translation.x;
+    pos_y[node] = translation.y;
+    pos_z[node] = translation.z;
+    dirty[node] = 1;
+}
+
+void TransformHierarchy::set_scale(uint32_t node, Vec3 scale) {
+    scale_x[node] = scale.x;
+    scale_y[node] = scale.y;
+    scale_z[node] = scale.z;
+    dirty[node] = 1;
+}
+
+void TransformHierarchy::set_rotation(uint32_t node, const Quat& rotation) {
+    rot_x[node] = rotation.x;
+    rot_y[node] = rotation.y;
+    rot_z[node] = rotation.z;
+    rot_w[node] = rotation.w;
+    dirty[node] = 1;
+}
+
+void TransformHierarchy::set_rotations(uint32_t first, size_t count, Vec3 axis, const float* angles) {
+    axis_angle_quats(axis, angles, rot_x.data() + first, rot_y.data() + first, rot_z.data() + first,
+                     rot_w.data() + first, count);
+    memset(dirty.data() + first, 1, count);
+}
+
+static inline Mat4 local_matrix(const TransformHierarchy& t, size_t i) {
+    Mat4 m = t.rotation(i).to_mat4();
+
+    const float scale[3] = {t.scale_x[i], t.scale_y[i], t.scale_z[i]};
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 3; row++) m.elems[col * 4 + row] *= scale[col];
+    }
+
+    m.elems[12] = t.pos_x[i];
+    m.elems[13] = t.pos_y[i];
+    m.elems[14] = t.pos_z[i];
+
+    return m;
+}
+
+bool TransformHierarchy::update() {
+    const size_t count = size();
+
+    changed_begin = count;
+    changed_end = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t p = parent[i];
+
+        // the parent was already visited, so its flag is final for this pass
+        bool needs_update = dirty[i] || (p >= 0 && changed[p]);
+        changed[i] = needs_update;
+        if (!needs_update) continue;
+
+        dirty[i] = 0;
+
+        Mat4 local = local_matrix(*this, i);
+        world[i] = p >= 0 ? world[p] * local : local;
+
+        if (i < changed_begin) changed_begin = i;
+        changed_end = i + 1;
+    }
+
+    return changed_end > changed_begin;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "math.hh"
+
+constexpr int32_t TRANSFORM_NO_PARENT = -1;
+
+// Scene transforms with local TRS in SoA arrays. Nodes are only ever appended
+// after their parent, so a single forward pass over the arrays sees every
+// parent before its children. Only the subtrees under nodes marked dirty get
+// their world matrices recomputed.
+struct TransformHierarchy {
+    uint32_t add(int32_t parent, Vec3 translation, Vec3 scale = Vec3{1, 1, 1});
+
+    void set_translation(uint32_t node, Vec3 translation);
+    void set_scale(uint32_t node, Vec3 scale);
+    void set_rotation(uint32_t node, const Quat& rotation);
+    // nodes [first, first + count) get rotated by `angles[i]` radians around
+    // `axis`, all sines and cosines in one batch
+    void set_rotations(uint32_t first, size_t count, Vec3 axis, const float* angles);
+
+    inline Quat rotation(uint32_t node) const {
+        return Quat{rot_x[node], rot_y[node], rot_z[node], rot_w[node]};
+    }
+
+    // recomputes the world matrices of the dirty subtrees, returns true if any
+    // changed; the changed ones are flagged in `changed` until the next update
+    bool update();
+
+    inline size_t size() const {
+        return parent.size();
+    }
+
+    std::vector<int32_t> parent;
+
+    std::vector<float> pos_x, pos_y, pos_z;
+    std::vector<float> rot_x, rot_y, rot_z, rot_w;
+    std::vector<float> scale_x, scale_y, scale_z;
+
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> changed;
+
+    // contiguous, ready to be uploaded as is; [changed_begin, changed_end) covers
+    // everything the last update touched
+    std::vector<Mat4> world;
+    size_t changed_begin = 0;
+    size_t changed_end = 0;
+};
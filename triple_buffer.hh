@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer / single consumer triple buffer. The writer fills
+// `back()` and publishes it, the reader picks up the most recent published slot
+// with `update()`. Neither side ever waits for the other, slots the reader
+// didn't get to in time are simply overwritten.
+template <class T>
+struct TripleBuffer {
+    // writer side
+    inline T& back() {
+        return slots[back_index];
+    }
+
+    inline void publish() {
+        back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // reader side, true if a newer slot was swapped in
+    inline bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    inline const T& front() const {
+        return slots[front_index];
+    }
+
+    static constexpr int FRESH = 4;
+    static constexpr int INDEX_MASK = 3;
+
+    T slots[3];
+
+    int back_index = 0;
+    int front_index = 1;
+    // the slot in between, FRESH is set while it holds something the reader hasn't seen
+    std::atomic<int> middle{2};
+};